@@ -0,0 +1,132 @@
+#include "DWIAsyncVolumeWriter.h"
+#include <iostream>
+#include <cstdlib>
+#include "DWIConvertTrace.h"
+
+DWIAsyncVolumeWriter
+::DWIAsyncVolumeWriter(std::ostream &out, const std::string &fileName,
+                       unsigned int queueDepth) :
+  m_Output(out),
+  m_FileName(fileName),
+  m_QueueDepth(queueDepth > 0 ? queueDepth : 1),
+  m_ThreadID(-1),
+  m_Done(false),
+  m_Failed(false)
+{
+  this->m_QueueChanged = itk::ConditionVariable::New();
+  this->m_Threader = itk::MultiThreader::New();
+}
+
+DWIAsyncVolumeWriter
+::~DWIAsyncVolumeWriter()
+{
+  this->Finish();
+}
+
+int
+DWIAsyncVolumeWriter
+::Start()
+{
+  this->m_Done = false;
+  this->m_Failed = false;
+  this->m_ThreadID =
+    this->m_Threader->SpawnThread(DWIAsyncVolumeWriter::WriterThread,this);
+  return this->m_ThreadID < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int
+DWIAsyncVolumeWriter
+::Push(itk::LightObject *owner, const char *data, size_t size)
+{
+  Buffer buffer;
+  buffer.Owner = owner;
+  buffer.Data = data;
+  buffer.Size = size;
+
+  this->m_Mutex.Lock();
+  while(this->m_Queue.size() >= this->m_QueueDepth && !this->m_Failed)
+    {
+    this->m_QueueChanged->Wait(&this->m_Mutex);
+    }
+  const bool failed = this->m_Failed;
+  if(!failed)
+    {
+    this->m_Queue.push_back(buffer);
+    }
+  this->m_Mutex.Unlock();
+  this->m_QueueChanged->Broadcast();
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int
+DWIAsyncVolumeWriter
+::Finish()
+{
+  if(this->m_ThreadID >= 0)
+    {
+    this->m_Mutex.Lock();
+    this->m_Done = true;
+    this->m_Mutex.Unlock();
+    this->m_QueueChanged->Broadcast();
+    // waits for the thread to return
+    this->m_Threader->TerminateThread(this->m_ThreadID);
+    this->m_ThreadID = -1;
+    }
+  return this->m_Failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+ITK_THREAD_RETURN_TYPE
+DWIAsyncVolumeWriter
+::WriterThread(void *arg)
+{
+  itk::MultiThreader::ThreadInfoStruct *info =
+    static_cast<itk::MultiThreader::ThreadInfoStruct *>(arg);
+  static_cast<DWIAsyncVolumeWriter *>(info->UserData)->WriteQueued();
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+void
+DWIAsyncVolumeWriter
+::WriteQueued()
+{
+  this->m_Mutex.Lock();
+  for(;;)
+    {
+    while(this->m_Queue.empty() && !this->m_Done)
+      {
+      this->m_QueueChanged->Wait(&this->m_Mutex);
+      }
+    if(this->m_Queue.empty())
+      {
+      break;
+      }
+    // the buffer stays in the queue while it's written, so that
+    // Push counts it against the queue depth
+    Buffer &buffer = this->m_Queue.front();
+    this->m_Mutex.Unlock();
+
+    bool good;
+    {
+    DWIConvertTraceSpan span("write chunk",this->m_FileName,buffer.Size);
+    this->m_Output.write(buffer.Data,buffer.Size);
+    good = this->m_Output.good();
+    }
+
+    this->m_Mutex.Lock();
+    this->m_Queue.pop_front();
+    if(!good)
+      {
+      std::cerr << "Error writing volume data" << std::endl;
+      this->m_Failed = true;
+      this->m_Queue.clear();
+      }
+    this->m_Mutex.Unlock();
+    this->m_QueueChanged->Broadcast();
+    this->m_Mutex.Lock();
+    if(this->m_Failed)
+      {
+      break;
+      }
+    }
+  this->m_Mutex.Unlock();
+}
@@ -0,0 +1,63 @@
+#ifndef __DWIAsyncVolumeWriter_h
+#define __DWIAsyncVolumeWriter_h
+#include <ostream>
+#include <string>
+#include <deque>
+#include "itkLightObject.h"
+#include "itkMultiThreader.h"
+#include "itkMutexLock.h"
+#include "itkConditionVariable.h"
+
+/** \class DWIAsyncVolumeWriter
+ *  Write buffers to an output stream from a separate I/O thread, so
+ *  that writing volume N overlaps assembling volume N+1.  At most
+ *  queueDepth buffers are pending at once (two gives double
+ *  buffering); Push blocks until there's room.  The owner passed with
+ *  each buffer keeps it alive until it has been written.  fileName,
+ *  the file out writes to, tags the trace spans of the writes.
+ */
+class DWIAsyncVolumeWriter
+{
+public:
+  DWIAsyncVolumeWriter(std::ostream &out, const std::string &fileName,
+                       unsigned int queueDepth = 2);
+  /** waits for pending writes */
+  ~DWIAsyncVolumeWriter();
+
+  /** start the I/O thread */
+  int Start();
+
+  /** queue size bytes at data for writing */
+  int Push(itk::LightObject *owner, const char *data, size_t size);
+
+  /** write everything still queued and stop the I/O thread; returns
+   *  EXIT_FAILURE if any write failed */
+  int Finish();
+
+private:
+  DWIAsyncVolumeWriter(const DWIAsyncVolumeWriter &); // not implemented
+  void operator=(const DWIAsyncVolumeWriter &); // not implemented
+
+  struct Buffer
+  {
+    itk::LightObject::Pointer Owner;
+    const char               *Data;
+    size_t                    Size;
+  };
+
+  static ITK_THREAD_RETURN_TYPE WriterThread(void *arg);
+  void WriteQueued();
+
+  std::ostream               &m_Output;
+  const std::string           m_FileName;
+  const unsigned int          m_QueueDepth;
+  std::deque<Buffer>          m_Queue;
+  itk::SimpleMutexLock        m_Mutex;
+  itk::ConditionVariable::Pointer m_QueueChanged;
+  itk::MultiThreader::Pointer m_Threader;
+  int                         m_ThreadID;
+  bool                        m_Done;
+  bool                        m_Failed;
+};
+
+#endif // __DWIAsyncVolumeWriter_h
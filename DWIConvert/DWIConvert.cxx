@@ -33,6 +33,17 @@ DICOM Data Dictionary: http://medical.nema.org/Dicom/2011/11_06pu.pdf
 #undef HAVE_SSTREAM
 #include "itkDCMTKImageIO.h"
 #include "itkRawImageIO.h"
+#include "itkByteSwapper.h"
+#include "DWIMappedOutputFile.h"
+#include "DWIAsyncVolumeWriter.h"
+#include "DWIConvertShard.h"
+#include "DWIConvertFingerprint.h"
+#include "DWIConvertDigest.h"
+#include "DWIConvertProfile.h"
+#include "DWIConvertTrace.h"
+#include "DWIConvertIOAccounting.h"
+#include "DWIConvertLog.h"
+#include "DWIConvertLib.h"
 #include "itkImage.h"
 #include "itkImageRegionConstIterator.h"
 #include "itkImageRegionIterator.h"
@@ -40,6 +51,8 @@ DICOM Data Dictionary: http://medical.nema.org/Dicom/2011/11_06pu.pdf
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
 #include "itkImageSeriesReader.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleFastMutexLock.h"
 #include "itksys/Directory.hxx"
 #include "itksys/SystemTools.hxx"
 #include "itksys/Base64.h"
@@ -261,8 +274,41 @@ AddFlagsToDictionary()
 
 }
 
+/** Read the file names of a series from listName, one per line;
+ *  "-" reads them from standard input.  Blank lines and lines
+ *  starting with # are skipped.
+ */
+int
+ReadDicomFileList(const std::string &listName,
+                  std::vector<std::string> &fileNames)
+{
+  std::ifstream listFile;
+  if(listName != "-")
+    {
+    listFile.open(listName.c_str());
+    if(!listFile.good())
+      {
+      std::cerr << "Can't open DICOM file list " << listName << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+  std::istream &list = listName == "-" ?
+    static_cast<std::istream &>(std::cin) : listFile;
+  std::string line;
+  while(std::getline(list,line))
+    {
+    // paths may contain spaces, so only line ends are trimmed
+    const size_t end = line.find_last_not_of(" \t\r");
+    if(end == std::string::npos || line[0] == '#')
+      {
+      continue;
+      }
+    fileNames.push_back(line.substr(0,end + 1));
+    }
+  return EXIT_SUCCESS;
+}
+
 /** Free the headers for all dicom files.
- *  also calls the DJDecoder cleanup.
  */
 void FreeHeaders(std::vector<itk::DCMTKFileReader *> &allHeaders)
 {
@@ -271,7 +317,129 @@ void FreeHeaders(std::vector<itk::DCMTKFileReader *> &allHeaders)
     {
     delete (*it);
     }
-  DJDecoderRegistration::cleanup();
+}
+
+namespace
+{
+itk::SimpleFastMutexLock DWIConvertDictionaryLock;
+bool                     DWIConvertDictionaryLoaded(false);
+}
+
+/** Register the DCMTK codecs, and the private tags once per process.
+ *  Calls are counted, and each needs a matching DWIConvertCleanup.
+ *  Safe to call from several threads, e.g. batch conversion workers.
+ */
+void
+DWIConvertInitialize()
+{
+  itk::DCMTKFileReader::RegisterCodecs();
+  DWIConvertDictionaryLock.Lock();
+  if(!DWIConvertDictionaryLoaded)
+    {
+    // the dictionary entries are never removed, since readers in
+    // other threads may be using them
+    AddFlagsToDictionary();
+    DWIConvertDictionaryLoaded = true;
+    }
+  DWIConvertDictionaryLock.Unlock();
+}
+
+/** Release a DWIConvertInitialize; the codecs are unregistered when
+ *  the last one is released. */
+void
+DWIConvertCleanup()
+{
+  itk::DCMTKFileReader::UnregisterCodecs();
+}
+
+/** Holds a DWIConvertInitialize for as long as it exists. */
+class DWIConvertInitializeGuard
+{
+public:
+  DWIConvertInitializeGuard() { DWIConvertInitialize(); }
+  ~DWIConvertInitializeGuard() { DWIConvertCleanup(); }
+};
+
+struct LoadHeadersInfo
+{
+  const std::vector<std::string>        *FileNames;
+  std::vector<itk::DCMTKFileReader *>   *Headers;
+  // char, not bool: the threads set flags of neighbouring files at
+  // once, which vector<bool> packs into the same word
+  std::vector<char>                     *Failed;
+  unsigned int                           NumberOfThreads;
+};
+
+ITK_THREAD_RETURN_TYPE
+LoadHeadersThread(void *arg)
+{
+  itk::MultiThreader::ThreadInfoStruct *threadInfo =
+    static_cast<itk::MultiThreader::ThreadInfoStruct *>(arg);
+  LoadHeadersInfo *info = static_cast<LoadHeadersInfo *>(threadInfo->UserData);
+  for(unsigned int i = threadInfo->ThreadID; i < info->FileNames->size();
+      i += info->NumberOfThreads)
+    {
+    try
+      {
+      (*info->Headers)[i]->LoadFile();
+      }
+    catch(...)
+      {
+      (*info->Failed)[i] = 1;
+      }
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+/** Load the headers of all files in a series, spreading the files
+ *  over numberOfThreads threads.
+ */
+int
+LoadDicomHeaders(const std::vector<std::string> &fileNames,
+                 std::vector<itk::DCMTKFileReader *> &allHeaders,
+                 unsigned int numberOfThreads)
+{
+  allHeaders.resize(fileNames.size());
+  for(unsigned i = 0; i < allHeaders.size(); ++i)
+    {
+    allHeaders[i] = new itk::DCMTKFileReader;
+    allHeaders[i]->SetFileName(fileNames[i]);
+    }
+  if(numberOfThreads == 0)
+    {
+    numberOfThreads = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+    }
+  if(numberOfThreads > fileNames.size())
+    {
+    numberOfThreads = fileNames.size();
+    }
+  if(numberOfThreads < 1)
+    {
+    numberOfThreads = 1;
+    }
+  std::vector<char> failed(fileNames.size(),0);
+  LoadHeadersInfo info;
+  info.FileNames = &fileNames;
+  info.Headers = &allHeaders;
+  info.Failed = &failed;
+  info.NumberOfThreads = numberOfThreads;
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetNumberOfThreads(numberOfThreads);
+  // SetNumberOfThreads clamps to the global maximum
+  info.NumberOfThreads = threader->GetNumberOfThreads();
+  threader->SetSingleMethod(LoadHeadersThread,&info);
+  threader->SingleMethodExecute();
+
+  for(unsigned i = 0; i < failed.size(); ++i)
+    {
+    if(failed[i] != 0)
+      {
+      std::cerr << "Error reading slice" << fileNames[i] << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+  return EXIT_SUCCESS;
 }
 
 typedef short PixelValueType;
@@ -372,23 +540,23 @@ DeInterleaveVolume(VolumeType::Pointer &volume,
     VolumeType::IndexType idx = I.GetIndex();
 
     // extract all values in one "column"
-    for (unsigned int k = 0; k < NSlices; ++k)
+    for (size_t k = 0; k < NSlices; ++k)
       {
       idx[2] = k;
       v[k] = volume->GetPixel( idx );
       }
 
     // permute
-    for (int k = 0; k < NVolumes; ++k)
+    for (size_t k = 0; k < NVolumes; ++k)
       {
-      for (int m = 0; m < SlicesPerVolume; ++m)
+      for (size_t m = 0; m < SlicesPerVolume; ++m)
         {
         w[(k * SlicesPerVolume) + m] = v[ (m * NVolumes) + k];
         }
       }
 
     // put things back in order
-    for (unsigned int k = 0; k < NSlices; ++k)
+    for (size_t k = 0; k < NSlices; ++k)
       {
       idx[2] = k;
       volume->SetPixel( idx, w[k] );
@@ -397,66 +565,822 @@ DeInterleaveVolume(VolumeType::Pointer &volume,
 
 }
 
-int main(int argc, char *argv[])
+/** Read a list of DICOM slices, or a single multi-frame file, into
+ *  a volume.
+ */
+int
+ReadSeries(const std::vector<std::string> &fileNames,
+           VolumeType::Pointer &volume)
+{
+  typedef itk::ImageSeriesReader< VolumeType > ReaderType;
+  typedef itk::ImageFileReader< VolumeType >   SingleFileReaderType;
+
+  itk::DCMTKImageIO::Pointer dcmtkIO = itk::DCMTKImageIO::New();
+  try
+    {
+    if(fileNames.size() > 1)
+      {
+      ReaderType::Pointer reader = ReaderType::New();
+      reader->SetImageIO( dcmtkIO );
+      reader->SetFileNames( fileNames );
+      reader->Update();
+      volume = reader->GetOutput();
+      }
+    else
+      {
+      SingleFileReaderType::Pointer reader =
+        SingleFileReaderType::New();
+      reader->SetImageIO( dcmtkIO );
+      reader->SetFileName( fileNames[0] );
+      reader->Update();
+      volume = reader->GetOutput();
+      }
+    }
+  catch (itk::ExceptionObject &excp)
+    {
+    std::cerr << "Exception thrown while reading the series" << std::endl;
+    std::cerr << excp << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+
+/** Copy one slice out of a Siemens mosaic.
+ *  Slice mosaicIndex of img is an mMosaic x mMosaic grid of slices;
+ *  sliceIndex picks the block within that grid, which is copied into
+ *  slice dmSliceIndex of dmImage.
+ */
+void
+DeMosaicSlice(VolumeType *img,
+              unsigned int mosaicIndex,
+              unsigned int sliceIndex,
+              unsigned int mMosaic,
+              VolumeType *dmImage,
+              unsigned int dmSliceIndex)
+{
+  VolumeType::RegionType dmRegion = dmImage->GetLargestPossibleRegion();
+  const VolumeType::SizeType dmSize = dmRegion.GetSize();
+  dmRegion.SetSize(2, 1);
+  dmRegion.SetIndex(2, dmSliceIndex);
+
+  const unsigned int colMosaic = sliceIndex/mMosaic;
+  const unsigned int rawMosaic = sliceIndex - mMosaic*colMosaic;
+
+  VolumeType::RegionType region = img->GetLargestPossibleRegion();
+  region.SetSize(0, dmSize[0]);
+  region.SetSize(1, dmSize[1]);
+  region.SetSize(2, 1);
+  region.SetIndex( 0, rawMosaic*dmSize[0] );
+  region.SetIndex( 1, colMosaic*dmSize[1] );
+  region.SetIndex( 2, mosaicIndex );
+
+  itk::ImageRegionIteratorWithIndex<VolumeType> dmIt( dmImage, dmRegion );
+  itk::ImageRegionConstIteratorWithIndex<VolumeType> imIt( img, region );
+  for ( dmIt.GoToBegin(), imIt.GoToBegin(); !dmIt.IsAtEnd(); ++dmIt, ++imIt)
+    {
+    dmIt.Set( imIt.Get() );
+    }
+}
+
+/** Queue the voxels of a volume for the raw (little endian) data
+ *  stream, digesting them if digests isn't 0.  The volume is byte
+ *  swapped in place, so it shouldn't be used afterwards.
+ */
+int
+QueueVolumeData(DWIAsyncVolumeWriter &writer, VolumeType *volume,
+                DWIConvertVolumeDigests *digests)
+{
+  const size_t nVoxels = volume->GetBufferedRegion().GetNumberOfPixels();
+  itk::ByteSwapper<PixelValueType>::
+    SwapRangeFromSystemToLittleEndian(volume->GetBufferPointer(),nVoxels);
+  if(digests != 0)
+    {
+    digests->AddVolume(volume->GetBufferPointer(),nVoxels);
+    }
+  return writer.Push(volume,
+                     reinterpret_cast<char *>(volume->GetBufferPointer()),
+                     nVoxels*sizeof(PixelValueType));
+}
+
+/** Assemble one gradient volume straight from its slice files.
+ *  volumeIndex counts volumes in the input series, i.e. before any
+ *  bad gradients are dropped.
+ */
+int
+ReadStreamedVolume(const std::vector<std::string> &inputFileNames,
+                   unsigned int volumeIndex,
+                   unsigned int nVolume,
+                   unsigned int nSliceInVolume,
+                   bool sliceInterleaved,
+                   bool SliceMosaic,
+                   unsigned int mMosaic,
+                   VolumeType::Pointer &volume)
+{
+  if(SliceMosaic)
+    {
+    // one file per volume, with all the slices tiled in one mosaic
+    std::vector<std::string> mosaicFileName(1,inputFileNames[volumeIndex]);
+    VolumeType::Pointer mosaic;
+    if(ReadSeries(mosaicFileName,mosaic) != EXIT_SUCCESS)
+      {
+      return EXIT_FAILURE;
+      }
+    VolumeType::RegionType region = mosaic->GetLargestPossibleRegion();
+    VolumeType::SizeType dmSize = region.GetSize();
+    dmSize[0] /= mMosaic;
+    dmSize[1] /= mMosaic;
+    dmSize[2] = nSliceInVolume;
+    region.SetSize(dmSize);
+
+    volume = VolumeType::New();
+    volume->CopyInformation( mosaic );
+    volume->SetRegions( region );
+    volume->Allocate();
+    for(unsigned int k = 0; k < nSliceInVolume; ++k)
+      {
+      DeMosaicSlice(mosaic,0,k,mMosaic,volume,k);
+      }
+    return EXIT_SUCCESS;
+    }
+
+  std::vector<std::string> volumeFileNames(nSliceInVolume);
+  for(unsigned int k = 0; k < nSliceInVolume; ++k)
+    {
+    if(sliceInterleaved)
+      {
+      // same permutation as DeInterleaveVolume
+      volumeFileNames[k] = inputFileNames[(k * nVolume) + volumeIndex];
+      }
+    else
+      {
+      volumeFileNames[k] = inputFileNames[(volumeIndex * nSliceInVolume) + k];
+      }
+    }
+  return ReadSeries(volumeFileNames,volume);
+}
+
+/** Write the usable gradient volumes one at a time, so that peak
+ *  memory use stays around a few volumes rather than the whole DWI
+ *  data set.  Writes are done by a separate I/O thread with double
+ *  buffering, so writing a volume overlaps decoding the next one.
+ */
+int
+WriteStreamedVolumes(std::ostream &dataStream,
+                     const std::string &dataFileName,
+                     const std::vector<std::string> &inputFileNames,
+                     unsigned int nUsableVolumes,
+                     unsigned int nVolume,
+                     unsigned int nSliceInVolume,
+                     bool sliceInterleaved,
+                     bool SliceMosaic,
+                     unsigned int mMosaic,
+                     const std::vector<unsigned int> &bad_gradient_indices,
+                     DWIConvertVolumeDigests *digests)
+{
+  DWIAsyncVolumeWriter writer(dataStream,dataFileName);
+  if(writer.Start() != EXIT_SUCCESS)
+    {
+    std::cerr << "Can't start the output thread" << std::endl;
+    return EXIT_FAILURE;
+    }
+  unsigned int written = 0;
+  for(unsigned int k = 0; written < nUsableVolumes; ++k)
+    {
+    if(SliceMosaic &&
+       std::find(bad_gradient_indices.begin(),
+                 bad_gradient_indices.end(),k) != bad_gradient_indices.end())
+      {
+      continue;
+      }
+    VolumeType::Pointer volume;
+    if(ReadStreamedVolume(inputFileNames,k,nVolume,nSliceInVolume,
+                          sliceInterleaved,SliceMosaic,mMosaic,
+                          volume) != EXIT_SUCCESS ||
+       QueueVolumeData(writer,volume,digests) != EXIT_SUCCESS)
+      {
+      writer.Finish();
+      return EXIT_FAILURE;
+      }
+    ++written;
+    }
+  return writer.Finish();
+}
+
+template <typename TInput>
+void
+ConvertSliceBuffer(const void *input, PixelValueType *output,
+                   size_t count)
+{
+  const TInput *in = static_cast<const TInput *>(input);
+  for(size_t i = 0; i < count; ++i)
+    {
+    output[i] = static_cast<PixelValueType>(in[i]);
+    }
+}
+
+/** Copy a decoded single-frame DICOM slice into dest, converting to
+ *  PixelValueType the same way the ImageSeriesReader does.
+ */
+int
+CopyDicomSlice(const DicomImage &image,
+               const std::string &fileName,
+               PixelValueType *dest,
+               size_t nPixels)
+{
+  if(image.getStatus() != EIS_Normal)
+    {
+    std::cerr << "Error: cannot load DICOM image " << fileName << " ("
+              << DicomImage::getString(image.getStatus()) << ")" << std::endl;
+    return EXIT_FAILURE;
+    }
+  const DiPixel *interData = image.getInterData();
+  if(interData == 0 || interData->getCount() != nPixels)
+    {
+    std::cerr << "Unexpected slice size in " << fileName << std::endl;
+    return EXIT_FAILURE;
+    }
+  const void *data = interData->getData();
+  switch(interData->getRepresentation())
+    {
+    case EPR_Uint8:
+      ConvertSliceBuffer<Uint8>(data,dest,nPixels); break;
+    case EPR_Sint8:
+      ConvertSliceBuffer<Sint8>(data,dest,nPixels); break;
+    case EPR_Uint16:
+      ConvertSliceBuffer<Uint16>(data,dest,nPixels); break;
+    case EPR_Sint16:
+      ConvertSliceBuffer<Sint16>(data,dest,nPixels); break;
+    case EPR_Uint32:
+      ConvertSliceBuffer<Uint32>(data,dest,nPixels); break;
+    case EPR_Sint32:
+      ConvertSliceBuffer<Sint32>(data,dest,nPixels); break;
+    default:
+      std::cerr << "Unsupported pixel representation in "
+                << fileName << std::endl;
+      return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+
+/** Decode one single-frame DICOM slice, from its file or from the
+ *  dataset kept in memory under its name, straight into dest.
+ */
+int
+DecodeDicomSlice(const std::string &fileName,
+                 PixelValueType *dest,
+                 size_t nPixels)
+{
+  DWIConvertTraceSpan span("decode",fileName);
+  DWIConvertIOAccess access(fileName,DWIConvertIOAccounting::PixelDecode);
+  DicomImage *image = itk::DCMTKFileReader::NewDicomImage(fileName);
+  const int rval = CopyDicomSlice(*image,fileName,dest,nPixels);
+  delete image;
+  return rval;
+}
+
+/** Assemble the usable gradient volumes directly in the data region
+ *  of a memory-mapped output file.  Plain slices are decoded straight
+ *  into place; mosaics are demosaiced into a volume that uses the
+ *  mapped memory as its buffer.
+ */
+int
+AssembleMappedVolumes(PixelValueType *data,
+                      const std::vector<std::string> &inputFileNames,
+                      unsigned int nUsableVolumes,
+                      unsigned int nVolume,
+                      unsigned int nSliceInVolume,
+                      unsigned int nRows,
+                      unsigned int nCols,
+                      bool sliceInterleaved,
+                      bool SliceMosaic,
+                      unsigned int mMosaic,
+                      const std::vector<unsigned int> &bad_gradient_indices,
+                      DWIConvertVolumeDigests *digests)
+{
+  // offsets into data can pass 4G voxels, and unsigned long is 32
+  // bits on Windows
+  const size_t slicePixels = static_cast<size_t>(nRows) * nCols;
+  const size_t volumePixels = slicePixels * nSliceInVolume;
+
+  unsigned int written = 0;
+  for(unsigned int k = 0; written < nUsableVolumes; ++k)
+    {
+    PixelValueType *volumeData = data + static_cast<size_t>(written) * volumePixels;
+    if(SliceMosaic)
+      {
+      if(std::find(bad_gradient_indices.begin(),
+                   bad_gradient_indices.end(),k) != bad_gradient_indices.end())
+        {
+        continue;
+        }
+      std::vector<std::string> mosaicFileName(1,inputFileNames[k]);
+      VolumeType::Pointer mosaic;
+      if(ReadSeries(mosaicFileName,mosaic) != EXIT_SUCCESS)
+        {
+        return EXIT_FAILURE;
+        }
+      VolumeType::RegionType region = mosaic->GetLargestPossibleRegion();
+      VolumeType::SizeType dmSize = region.GetSize();
+      dmSize[0] /= mMosaic;
+      dmSize[1] /= mMosaic;
+      dmSize[2] = nSliceInVolume;
+      region.SetSize(dmSize);
+
+      VolumeType::Pointer volume = VolumeType::New();
+      volume->CopyInformation( mosaic );
+      volume->SetRegions( region );
+      volume->GetPixelContainer()->SetImportPointer(volumeData,
+                                                    volumePixels,false);
+      for(unsigned int s = 0; s < nSliceInVolume; ++s)
+        {
+        DeMosaicSlice(mosaic,0,s,mMosaic,volume,s);
+        }
+      }
+    else
+      {
+      for(unsigned int s = 0; s < nSliceInVolume; ++s)
+        {
+        const size_t fileIndex = sliceInterleaved ?
+          (static_cast<size_t>(s) * nVolume) + k :
+          (static_cast<size_t>(k) * nSliceInVolume) + s;
+        if(DecodeDicomSlice(inputFileNames[fileIndex],
+                            volumeData + s * slicePixels,
+                            slicePixels) != EXIT_SUCCESS)
+          {
+          return EXIT_FAILURE;
+          }
+        }
+      }
+    itk::ByteSwapper<PixelValueType>::
+      SwapRangeFromSystemToLittleEndian(volumeData,volumePixels);
+    if(digests != 0)
+      {
+      digests->AddVolume(volumeData,volumePixels);
+      }
+    ++written;
+    }
+  return EXIT_SUCCESS;
+}
+
+/** output file names without a directory go in outputDirectory */
+std::string
+OutputFileName(const std::string &fileName,
+               const std::string &outputDirectory)
+{
+  std::string outputFileName(fileName);
+  if(fileName.find("/") == std::string::npos &&
+     fileName.find("\\") == std::string::npos)
+    {
+    if(outputFileName.size() != 0)
+      {
+      outputFileName = outputDirectory;
+      outputFileName += "/";
+      outputFileName += fileName;
+      }
+    }
+  return outputFileName;
+}
+
+/** FSL output of gradients & BValues: unless given explicitly, the
+ *  .bval and .bvec files are named after the NIfTI volume.
+ */
+int
+FSLGradientFileNames(const std::string &niftiFileName,
+                     const std::string &outputBValues,
+                     const std::string &outputBVectors,
+                     std::string &bValFileName,
+                     std::string &bVecFileName)
+{
+  size_t extensionPos;
+  extensionPos = niftiFileName.find(".nii.gz");
+  if(extensionPos == std::string::npos)
+    {
+    extensionPos = niftiFileName.find(".nii");
+    if(extensionPos == std::string::npos)
+      {
+      std::cerr << "FSL Format output chosen, "
+                << "but output Volume not a recognized "
+                << "NIfTI filename " << niftiFileName
+                << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+  if(outputBValues == "")
+    {
+    bValFileName = niftiFileName.substr(0,extensionPos);
+    bValFileName += ".bval";
+    }
+  else
+    {
+    bValFileName = outputBValues;
+    }
+  if(outputBVectors == "")
+    {
+    bVecFileName = niftiFileName.substr(0,extensionPos);
+    bVecFileName += ".bvec";
+    }
+  else
+    {
+    bVecFileName = outputBVectors;
+    }
+  return EXIT_SUCCESS;
+}
+
+/** name a per-series output by inserting _<series UID> before the
+ *  extension */
+std::string
+SeriesOutputName(const std::string &fileName, const std::string &seriesUID)
+{
+  size_t extensionPos = fileName.find(".nii.gz");
+  if(extensionPos == std::string::npos)
+    {
+    extensionPos = fileName.rfind('.');
+    const size_t slashPos = fileName.find_last_of("/\\");
+    if(slashPos != std::string::npos && extensionPos != std::string::npos &&
+       extensionPos < slashPos)
+      {
+      extensionPos = std::string::npos;
+      }
+    }
+  std::string seriesName = fileName.substr(0,extensionPos);
+  seriesName += "_";
+  seriesName += seriesUID;
+  if(extensionPos != std::string::npos)
+    {
+    seriesName += fileName.substr(extensionPos);
+    }
+  return seriesName;
+}
+
+/** copy a converted series into result: each volume of the stacked
+ *  slices becomes one component of a vector image, and the metadata
+ *  holds the keys ITK reads from the NRRD header DWIConvert writes,
+ *  with the gradients numbered by component.
+ */
+void
+FillResult(const VolumeType *dmImage,
+           unsigned int nSliceInVolume,
+           unsigned int nVolumes,
+           const itk::Matrix<double,3,3> &spaceDirection,
+           const itk::Vector<double,3> &origin,
+           const itk::Matrix<double,3,3> &measurementFrame,
+           double bValue,
+           const std::vector<std::vector<double> > &gradients,
+           const std::vector<double> &bValues,
+           DWIConvertResult &result)
+{
+  typedef DWIConvertResult::ImageType ImageType;
+  const VolumeType::SizeType stackSize =
+    dmImage->GetLargestPossibleRegion().GetSize();
+  ImageType::SizeType size;
+  size[0] = stackSize[0];
+  size[1] = stackSize[1];
+  size[2] = nSliceInVolume;
+
+  ImageType::SpacingType spacing;
+  ImageType::DirectionType direction;
+  ImageType::PointType imageOrigin;
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    // the NRRD space directions are the direction cosines times the
+    // spacing
+    spacing[i] = sqrt(spaceDirection[0][i] * spaceDirection[0][i] +
+                      spaceDirection[1][i] * spaceDirection[1][i] +
+                      spaceDirection[2][i] * spaceDirection[2][i]);
+    for(unsigned int j = 0; j < 3; ++j)
+      {
+      direction[j][i] = spaceDirection[j][i] / spacing[i];
+      }
+    imageOrigin[i] = origin[i];
+    }
+
+  ImageType::Pointer image = ImageType::New();
+  image->SetRegions(size);
+  image->SetVectorLength(nVolumes);
+  image->SetSpacing(spacing);
+  image->SetDirection(direction);
+  image->SetOrigin(imageOrigin);
+  image->Allocate();
+
+  const size_t nPixels =
+    static_cast<size_t>(size[0]) * size[1] * size[2];
+  const PixelValueType *in = dmImage->GetBufferPointer();
+  PixelValueType *out = image->GetBufferPointer();
+  for(unsigned int v = 0; v < nVolumes; ++v)
+    {
+    const PixelValueType *volume = in + v * nPixels;
+    for(size_t p = 0; p < nPixels; ++p)
+      {
+      out[p * nVolumes + v] = volume[p];
+      }
+    }
+
+  itk::MetaDataDictionary &dict = image->GetMetaDataDictionary();
+  itk::EncapsulateMetaData<std::string>(dict,"modality","DWMRI");
+  std::ostringstream bValueString;
+  bValueString << bValue;
+  itk::EncapsulateMetaData<std::string>(dict,"DWMRI_b-value",
+                                        bValueString.str());
+  for(unsigned int v = 0; v < gradients.size(); ++v)
+    {
+    std::ostringstream key, value;
+    key << "DWMRI_gradient_" << std::setw(4) << std::setfill('0') << v;
+    value << gradients[v][0] << "   " << gradients[v][1] << "   "
+          << gradients[v][2];
+    itk::EncapsulateMetaData<std::string>(dict,key.str(),value.str());
+    }
+  std::vector<std::vector<double> > frame(3,std::vector<double>(3));
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    for(unsigned int j = 0; j < 3; ++j)
+      {
+      frame[i][j] = measurementFrame[j][i];
+      }
+    }
+  itk::EncapsulateMetaData<std::vector<std::vector<double> > >(
+    dict,"NRRD_measurement frame",frame);
+
+  result.Image = image;
+  result.Gradients = gradients;
+  result.BValues = bValues;
+  result.BValue = bValue;
+  result.MeasurementFrame = measurementFrame;
+}
+
+int DWIConvertSeries(int argc, char *argv[],
+                     const std::vector<std::string> *seriesFileNames,
+                     DWIConvertResult *result = 0);
+
+/** record the fingerprint of a finished conversion, if skipUnchanged
+ *  asked for one */
+int
+RecordFingerprint(const std::string &outputName,
+                  const std::string &fingerprint)
+{
+  if(fingerprint == "")
+    {
+    return EXIT_SUCCESS;
+    }
+  return DWIConvertWriteFingerprint(outputName,fingerprint);
+}
+
+/** Convert the given files of one series, with the same arguments as
+ *  this run except those that select several series, and with the
+ *  output names made unique by the series UID.
+ */
+int
+ConvertOneSeries(int argc, char *argv[],
+                 const std::string &seriesUID,
+                 const std::vector<std::string> &fileNames)
+{
+  std::vector<std::string> args;
+  for(int i = 0; i < argc; ++i)
+    {
+    const std::string arg(argv[i]);
+    if(arg == "--convertAllSeries" || arg == "--watchDicomDirectory")
+      {
+      continue;
+      }
+    args.push_back(arg);
+    // the outputs; gradientVectorFile, an input, is passed on as is
+    if((arg == "--outputVolume" || arg == "--fslNIFTIFile" ||
+        arg == "--outputBValues" || arg == "--outputBVectors" ||
+        arg == "--profileReport") &&
+       i + 1 < argc)
+      {
+      ++i;
+      args.push_back(SeriesOutputName(argv[i],seriesUID));
+      }
+    }
+  std::vector<char *> seriesArgv;
+  for(unsigned int i = 0; i < args.size(); ++i)
+    {
+    seriesArgv.push_back(const_cast<char *>(args[i].c_str()));
+    }
+  seriesArgv.push_back(0);
+  return DWIConvertSeries(static_cast<int>(args.size()),&seriesArgv[0],
+                          &fileNames);
+}
+
+/** Convert every series of a directory scan that carries diffusion
+ *  tags, by re-running the conversion on each series' files with
+ *  the output names made unique by the series UID.  With shardCount
+ *  > 1 only this shard's share of the series is converted; series
+ *  recorded in the journal as done are skipped.
+ */
+int
+ConvertAllSeries(int argc, char *argv[],
+                 const itk::DCMTKSeriesFileNames::SeriesCatalogType &catalog,
+                 unsigned int shardIndex,
+                 unsigned int shardCount,
+                 const std::string &journalName)
+{
+  typedef itk::DCMTKSeriesFileNames::SeriesInfo SeriesInfo;
+  std::vector<const SeriesInfo *> dwiSeries;
+  std::vector<DWIConvertWorkItem> items;
+  for(itk::DCMTKSeriesFileNames::SeriesCatalogType::const_iterator it =
+        catalog.begin(); it != catalog.end(); ++it)
+    {
+    const SeriesInfo &info = it->second;
+    if(!info.HasDiffusionTags)
+      {
+      DWIConvertLogInfo() << "Skipping series " << info.SeriesNumber << " "
+        << info.SeriesDescription << " (" << info.SeriesUID
+        << "): no diffusion information" << std::endl;
+      continue;
+      }
+    dwiSeries.push_back(&info);
+    DWIConvertWorkItem item;
+    item.Key = info.SeriesUID;
+    item.Cost = DWIConvertEstimateCost(info.FileNames.size(),
+                                       static_cast<double>(info.NumberOfBytes));
+    items.push_back(item);
+    }
+  const std::vector<unsigned int> shard =
+    DWIConvertAssignShard(items,shardIndex,shardCount);
+
+  DWIConvertJournal journal;
+  if(journal.Open(journalName) != EXIT_SUCCESS)
+    {
+    return EXIT_FAILURE;
+    }
+
+  unsigned int converted = 0, failed = 0, alreadyDone = 0;
+  for(unsigned int s = 0; s < shard.size(); ++s)
+    {
+    const SeriesInfo &info = *dwiSeries[shard[s]];
+    if(journal.IsDone(info.SeriesUID))
+      {
+      ++alreadyDone;
+      continue;
+      }
+    DWIConvertLogInfo() << "Converting series " << info.SeriesNumber << " "
+      << info.SeriesDescription << " (" << info.SeriesUID << ")"
+      << std::endl;
+    if(ConvertOneSeries(argc,argv,info.SeriesUID,info.FileNames) == EXIT_SUCCESS)
+      {
+      journal.MarkDone(info.SeriesUID);
+      ++converted;
+      }
+    else
+      {
+      std::cerr << "Failed to convert series " << info.SeriesUID << std::endl;
+      ++failed;
+      }
+    }
+  DWIConvertLogInfo() << converted << " series converted, "
+    << alreadyDone << " already done, "
+    << failed << " failed" << std::endl;
+  return (failed == 0 && converted + alreadyDone > 0) ?
+    EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int DWIConvertMain(int argc, char *argv[])
+{
+  return DWIConvertSeries(argc,argv,0);
+}
+
+int
+DWIConvertToImage(const std::vector<std::string> &fileNames,
+                  const std::vector<std::string> &options,
+                  DWIConvertResult &result)
+{
+  if(fileNames.empty())
+    {
+    std::cerr << "No DICOM files to convert" << std::endl;
+    return EXIT_FAILURE;
+    }
+  std::vector<std::string> args(1,"DWIConvert");
+  args.insert(args.end(),options.begin(),options.end());
+  std::vector<char *> argv;
+  for(unsigned int i = 0; i < args.size(); ++i)
+    {
+    argv.push_back(const_cast<char *>(args[i].c_str()));
+    }
+  argv.push_back(0);
+  return DWIConvertSeries(static_cast<int>(args.size()),&argv[0],
+                          &fileNames,&result);
+}
+
+int
+DWIConvertToImage(const itk::DCMTKSeriesFileNames::SeriesInfo &series,
+                  const std::vector<std::string> &options,
+                  DWIConvertResult &result)
+{
+  return DWIConvertToImage(series.FileNames,options,result);
+}
+
+/** The conversion; if seriesFileNames is given, those files are
+ *  converted instead of scanning inputDicomDirectory.  If result is
+ *  given, a DWI series is returned in it instead of being written.
+ */
+int DWIConvertSeries(int argc, char *argv[],
+                     const std::vector<std::string> *seriesFileNames,
+                     DWIConvertResult *result)
 {
   PARSE_ARGS;
 
+  if(nrrdDataAlignment < 0)
+    {
+    std::cerr << "nrrdDataAlignment must not be negative" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  if(result != 0 && conversionMode != "DicomToNrrd")
+    {
+    std::cerr << "Only DicomToNrrd conversions can return an image"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+
   if(conversionMode == "FSLToNrrd")
     {
     extern int FSLToNrrd(const std::string &inputVolume,
                          const std::string &outputVolume,
                          const std::string &inputBValues,
-                         const std::string &inputBVectors);
+                         const std::string &inputBVectors,
+                         unsigned int dataAlignment);
 
     return FSLToNrrd(inputVolume, outputVolume,
-                     inputBValues, inputBVectors);
+                     inputBValues, inputBVectors,
+                     nrrdDataAlignment);
     }
   if(conversionMode == "NrrdToFSL")
     {
-    extern int NrrdToFSL(const std::string &inputVolume,
-                         const std::string &outputVolume,
-                         const std::string &outputBValues,
-                         const std::string &outputBVectors);
-    return NrrdToFSL(inputVolume,outputVolume,
-                     outputBValues,outputBVectors);
+    extern int NrrdToFSL(const std::string &inputVolume,
+                         const std::string &outputVolume,
+                         const std::string &outputBValues,
+                         const std::string &outputBVectors);
+    return NrrdToFSL(inputVolume,outputVolume,
+                     outputBValues,outputBVectors);
+    }
+
+
+  if(numberOfThreads < 0)
+    {
+    std::cerr << "numberOfThreads must not be negative" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if(shardCount < 1 || shardIndex < 0 || shardIndex >= shardCount)
+    {
+    std::cerr << "shardIndex must be in [0,shardCount)" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if(!DWIConvertLog::IsValid(logLevel,logFormat))
+    {
+    std::cerr << "logLevel must be quiet, info or debug, "
+              << "and logFormat text or json" << std::endl;
+    return EXIT_FAILURE;
     }
 
+  const DWIConvertInitializeGuard initializeGuard;
+  // a trace covers the whole run, including every series of a batch;
+  // the conversions it starts find it already open
+  const DWIConvertTraceFile trace(traceFile);
+  const DWIConvertIOReportFile ioReport(ioReportFile);
+  // likewise the log, flushed before the I/O report is written.  Only
+  // a run from the command line opens it: DWIConvertToImage may run on
+  // several threads at once, and the log level is process-wide
+  const DWIConvertLogScope log(logLevel,logFormat,
+                               seriesFileNames == 0 && result == 0);
+
+  if(batchManifest != "")
+    {
+    extern int DWIConvertBatch(const std::string &batchManifest,
+                               const std::string &batchReport,
+                               unsigned int numberOfThreads,
+                               unsigned int shardIndex,
+                               unsigned int shardCount,
+                               const std::string &batchJournal);
+    return DWIConvertBatch(batchManifest,batchReport,numberOfThreads,
+                           shardIndex,shardCount,batchJournal);
+    }
 
-  // needed for lossless JPeg, otherwise
-  //
-  DJDecoderRegistration::registerCodecs();
-
-  typedef itk::ImageSeriesReader< VolumeType > ReaderType;
-  typedef itk::ImageFileReader< VolumeType >   SingleFileReaderType;
   typedef itk::DCMTKSeriesFileNames             InputNamesGeneratorType;
 
-  AddFlagsToDictionary();
   bool nrrdFormat(true);
   //
   // check for required parameters
-  if(inputDicomDirectory == "")
+  if(seriesFileNames == 0 && inputDicomDirectory == "" &&
+     inputDicomFileList == "" && storageSCPPort == 0)
     {
     std::cerr << "Missing DICOM input directory path" << std::endl;
     return EXIT_FAILURE;
     }
 
-  if(outputVolume == "")
+  if(result == 0 && outputVolume == "")
     {
     std::cerr << "Missing DICOM output volume name" << std::endl;
     return EXIT_FAILURE;
     }
 
-  std::string outputVolumeHeaderName(outputVolume);
-  if(outputVolume.find("/") == std::string::npos &&
-     outputVolume.find("\\") == std::string::npos)
-    {
-    if(outputVolumeHeaderName.size() != 0)
-      {
-      outputVolumeHeaderName = outputDirectory;
-      outputVolumeHeaderName += "/";
-      outputVolumeHeaderName += outputVolume;
-      }
-    }
+  const std::string outputVolumeHeaderName =
+    OutputFileName(outputVolume,outputDirectory);
+  // DicomToNrrd can also write the FSL files in the same pass
+  const bool writeFSLFiles = result == 0 &&
+    (conversionMode == "DicomToFSL" || fslNIFTIFile != "");
+  const std::string outputFSLVolumeName = conversionMode == "DicomToFSL" ?
+    outputVolumeHeaderName : OutputFileName(fslNIFTIFile,outputDirectory);
 
   // decide whether the output is a single file or
   // header/raw pair
@@ -473,55 +1397,72 @@ int main(int argc, char *argv[])
       nrrdFormat = false;
       }
     }
-  else
+  if(writeFSLFiles &&
+     FSLGradientFileNames(outputFSLVolumeName,outputBValues,outputBVectors,
+                          outputFSLBValFilename,
+                          outputFSLBVecFilename) != EXIT_SUCCESS)
     {
-      // FSL output of gradients & BValues
-      std::string fslPrefix;
-      size_t extensionPos;
-      extensionPos = outputVolumeHeaderName.find(".nii.gz");
-      if(extensionPos == std::string::npos)
-        {
-        extensionPos = outputVolumeHeaderName.find(".nii");
-        if(extensionPos == std::string::npos)
-          {
-          std::cerr << "FSL Format output chosen, "
-                    << "but output Volume not a recognized "
-                    << "NIfTI filename " << outputVolumeHeaderName
-                    << std::endl;
-          exit(1);
-          }
-        }
-      if(outputBValues == "")
-        {
-        outputFSLBValFilename = outputVolumeHeaderName.substr(0,extensionPos);
-        outputFSLBValFilename += ".bval";
-        }
-      else
-        {
-        outputFSLBValFilename = outputBValues;
-        }
-      if(outputBVectors == "")
-        {
-        outputFSLBVecFilename = outputVolumeHeaderName.substr(0,extensionPos);
-        outputFSLBVecFilename += ".bvec";
-        }
-      else
-        {
-        outputFSLBVecFilename = outputBVectors;
-        }
+    return EXIT_FAILURE;
+    }
+
+  if(seriesFileNames == 0 && storageSCPPort != 0)
+    {
+    extern int DWIConvertStorageSCP(int argc, char *argv[],
+                                    int port,
+                                    const std::string &aeTitle,
+                                    int timeout,
+                                    double settleTime, double idleExit,
+                                    const std::string &journalName);
+    return DWIConvertStorageSCP(argc,argv,storageSCPPort,storageSCPAETitle,
+                                storageSCPTimeout,watchSettleTime,
+                                watchIdleExit,batchJournal);
     }
 
-  ReaderType::FileNamesContainer inputFileNames;
+  // with profileReport, the time and resources each phase of the
+  // conversion takes are written when it returns
+  DWIConvertProfile profile(result == 0 ? profileReport : std::string());
+  profile.Phase("directoryScan");
+
+  std::vector<std::string> inputFileNames;
   //
   // get the names of all slices in the directory
   InputNamesGeneratorType::Pointer inputNames = InputNamesGeneratorType::New();
-  if(itksys::SystemTools::FileIsDirectory(inputDicomDirectory.c_str()))
+  const bool scanDirectory = seriesFileNames == 0 &&
+    inputDicomFileList == "" &&
+    itksys::SystemTools::FileIsDirectory(inputDicomDirectory.c_str());
+  if(seriesFileNames != 0)
+    {
+    inputFileNames = *seriesFileNames;
+    }
+  else if(inputDicomFileList != "")
+    {
+    if(ReadDicomFileList(inputDicomFileList,inputFileNames) != EXIT_SUCCESS)
+      {
+      return EXIT_FAILURE;
+      }
+    }
+  else if(scanDirectory)
     {
+    if(watchDicomDirectory)
+      {
+      extern int DWIConvertWatch(int argc, char *argv[],
+                                 const std::string &directory,
+                                 double settleTime, double idleExit,
+                                 const std::string &journalName);
+      return DWIConvertWatch(argc,argv,inputDicomDirectory,
+                             watchSettleTime,watchIdleExit,batchJournal);
+      }
     inputNames->SetUseSeriesDetails( true);
     inputNames->SetLoadSequences( true );
     inputNames->SetLoadPrivateTags( true );
     inputNames->SetInputDirectory(inputDicomDirectory);
-    inputFileNames = inputNames->GetInputFileNames();
+    if(convertAllSeries)
+      {
+      // one scan of the directory serves all the series, each of
+      // which is fingerprinted by its own files
+      return ConvertAllSeries(argc,argv,inputNames->GetSeriesCatalog(),
+                              shardIndex,shardCount,batchJournal);
+      }
     }
   else if(itksys::SystemTools::FileExists(inputDicomDirectory.c_str()))
     // or, if it isn't a directory, maybe it is
@@ -530,6 +1471,61 @@ int main(int argc, char *argv[])
     inputFileNames.push_back(inputDicomDirectory);
     }
 
+  // with skipUnchanged, a series whose inputs, options and converter
+  // haven't changed since its outputs were written isn't converted
+  // again.  A directory is fingerprinted by its listing, before the
+  // scan opens any file in it.
+  std::string fingerprint;
+  if(skipUnchanged && result == 0)
+    {
+    std::vector<std::string> directoryFiles;
+    if(scanDirectory)
+      {
+      DWIConvertListDirectory(inputDicomDirectory,directoryFiles);
+      }
+    fingerprint = DWIConvertFingerprint(argc,argv,
+                                        scanDirectory ? directoryFiles : inputFileNames);
+    // every output, not only the one the fingerprint is kept with
+    std::vector<std::string> outputNames;
+    if(conversionMode != "DicomToFSL" && !nrrdFormat)
+      {
+      outputNames.push_back(outputVolumeDataName);
+      }
+    if(writeFSLFiles)
+      {
+      outputNames.push_back(outputFSLVolumeName);
+      outputNames.push_back(outputFSLBValFilename);
+      outputNames.push_back(outputFSLBVecFilename);
+      }
+    bool unchanged =
+      DWIConvertFingerprintMatches(outputVolumeHeaderName,fingerprint);
+    for(unsigned int i = 0; unchanged && i < outputNames.size(); ++i)
+      {
+      unchanged = itksys::SystemTools::FileExists(outputNames[i].c_str());
+      }
+    if(unchanged)
+      {
+      DWIConvertLogInfo() << "Skipping " << outputVolumeHeaderName
+        << ": unchanged since it was written" << std::endl;
+      return EXIT_SUCCESS;
+      }
+    // outputs being rewritten must not look up to date if this fails
+    itksys::SystemTools::RemoveFile(
+      DWIConvertFingerprintFileName(outputVolumeHeaderName).c_str());
+    }
+
+  if(scanDirectory)
+    {
+    if(inputSeriesUID != "")
+      {
+      inputFileNames = inputNames->GetFileNames(inputSeriesUID);
+      }
+    else
+      {
+      inputFileNames = inputNames->GetInputFileNames();
+      }
+    }
+
   const size_t nFiles = inputFileNames.size();
 
   if(nFiles < 1)
@@ -575,23 +1571,44 @@ int main(int argc, char *argv[])
     }
 #endif
 
+  // digests of an earlier conversion don't describe the output being
+  // written, whether or not this one writes new ones
+  if(result == 0)
+    {
+    itksys::SystemTools::RemoveFile(
+      DWIConvertDigestFileName(outputVolumeHeaderName).c_str());
+    }
+
   //////////////////////////////////////////////////
   // load all files in the dicom series.
   //////////////////////////////////////////////////
-  std::vector<itk::DCMTKFileReader *> allHeaders(inputFileNames.size());
-  for(unsigned i = 0; i < allHeaders.size(); ++i)
+  profile.Phase("headerLoad");
+  std::vector<itk::DCMTKFileReader *> allHeaders;
+  if(LoadDicomHeaders(inputFileNames,allHeaders,numberOfThreads) != EXIT_SUCCESS)
     {
-    allHeaders[i] = new itk::DCMTKFileReader;
-    allHeaders[i]->SetFileName(inputFileNames[i]);
-    try
-      {
-      allHeaders[i]->LoadFile();
-      }
-    catch(...)
+    FreeHeaders(allHeaders);
+    return EXIT_FAILURE;
+    }
+
+  if(seriesFileNames == 0 && inputDicomFileList != "")
+    {
+    // a listed series is in no particular order; sort it by instance
+    // number, as the directory scan does
+    std::stable_sort(allHeaders.begin(),allHeaders.end(),
+                     itk::CompareDCMTKFileReaders);
+    std::string seriesUID;
+    allHeaders[0]->GetElementUI(0x0020,0x000e,seriesUID,false);
+    for(unsigned i = 1; i < allHeaders.size(); ++i)
       {
-      std::cerr << "Error reading slice" << inputFileNames[i] << std::endl;
-      FreeHeaders(allHeaders);
-      return EXIT_FAILURE;
+      std::string uid;
+      allHeaders[i]->GetElementUI(0x0020,0x000e,uid,false);
+      if(uid != seriesUID)
+        {
+        std::cerr << "The files in " << inputDicomFileList
+                  << " belong to more than one series" << std::endl;
+        FreeHeaders(allHeaders);
+        return EXIT_FAILURE;
+        }
       }
     }
 
@@ -630,11 +1647,20 @@ int main(int argc, char *argv[])
     FreeHeaders(allHeaders);
     return EXIT_FAILURE;
     }
+  profile.SetInfo("vendor",vendor);
+  profile.SetInfo("modality",modality);
+  profile.SetCount("numberOfFiles",inputFileNames.size());
 
   //
   // IF it's a PET or SPECT file, just write it out as a float image.
   if(StringContains(modality,"PT") || StringContains(modality,"ST"))
     {
+    if(result != 0)
+      {
+      std::cerr << "Not a DWI series" << std::endl;
+      FreeHeaders(allHeaders);
+      return EXIT_FAILURE;
+      }
     typedef itk::Image<float, 3> USVolumeType;
     itk::ImageSeriesReader<USVolumeType>::Pointer seriesReader =
       itk::ImageSeriesReader<USVolumeType>::New();
@@ -645,6 +1671,7 @@ int main(int argc, char *argv[])
 
     nrrdImageWriter->SetFileName( outputVolumeHeaderName );
     nrrdImageWriter->SetInput( seriesReader->GetOutput() );
+    profile.Phase("outputWrite");
     try
       {
       nrrdImageWriter->Update();
@@ -657,7 +1684,7 @@ int main(int argc, char *argv[])
       return EXIT_FAILURE;
       }
     FreeHeaders(allHeaders);
-    return EXIT_SUCCESS;
+    return RecordFingerprint(outputVolumeHeaderName,fingerprint);
     }
 
   //
@@ -685,58 +1712,25 @@ int main(int argc, char *argv[])
 
      //////////////////////////////////////////////////
     // 1) Read the input series as an array of slices
-    unsigned int nSlice;
+    const unsigned int nSlice = inputFileNames.size();
+    const bool multiSliceVolume = (nSlice == 1);
+    // When streaming or memory mapping the output, the pixel data of a
+    // multi-file series isn't read here; it's read volume by volume as
+    // the output is written, or all at once later if it turns out it
+    // can't be assembled that way.
+    const bool deferRead = (streamOutput || memoryMapOutput) &&
+      !multiSliceVolume && !writeFSLFiles && result == 0;
+    profile.SetFlag("mosaic",SliceMosaic);
+    profile.SetFlag("multiFrame",multiSliceVolume);
+    profile.SetFlag("deferredRead",deferRead);
     VolumeType::Pointer readerOutput;
-    itk::DCMTKImageIO::Pointer dcmtkIO = itk::DCMTKImageIO::New();
-    bool multiSliceVolume;
-    if(inputFileNames.size() > 1)
-      {
-      ReaderType::Pointer reader = ReaderType::New();
-      reader->SetImageIO( dcmtkIO );
-      reader->SetFileNames( inputFileNames );
-      nSlice
-        = inputFileNames.size();
-      try
-        {
-        reader->Update();
-        }
-      catch (itk::ExceptionObject &excp)
-        {
-        std::cerr << "Exception thrown while reading the series" << std::endl;
-        std::cerr << excp << std::endl;
-        FreeHeaders(allHeaders);
-        return EXIT_FAILURE;
-        }
-      readerOutput = reader->GetOutput();
-      multiSliceVolume = false;
-#if 0
-          itk::ImageFileWriter< VolumeType >::Pointer writer = itk::ImageFileWriter< VolumeType >::New();
-          writer->SetFileName( "dwiconvert.nrrd");
-          writer->SetInput( readerOutput );
-          writer->Update();
-#endif
-      }
-    else
+    profile.Phase("pixelDecode");
+    if(!deferRead && ReadSeries(inputFileNames,readerOutput) != EXIT_SUCCESS)
       {
-      SingleFileReaderType::Pointer reader =
-        SingleFileReaderType::New();
-      reader->SetImageIO( dcmtkIO );
-      reader->SetFileName( inputFileNames[0] );
-      nSlice = inputFileNames.size();
-      try
-        {
-        reader->Update();
-        }
-      catch (itk::ExceptionObject &excp)
-        {
-        std::cerr << "Exception thrown while reading the series" << std::endl;
-        std::cerr << excp << std::endl;
-        FreeHeaders(allHeaders);
-        return EXIT_FAILURE;
-        }
-      readerOutput = reader->GetOutput();
-      multiSliceVolume = true;
+      FreeHeaders(allHeaders);
+      return EXIT_FAILURE;
       }
+    profile.Phase("sliceOrdering");
 
     // get image dims and resolution
     unsigned short nRows, nCols;
@@ -765,6 +1759,7 @@ int main(int argc, char *argv[])
 
     unsigned int numberOfSlicesPerVolume;
     std::map<std::string,int> sliceLocations;
+    bool sliceInterleaved(false);
     if(!multiSliceVolume)
       {
       // Make a hash of the sliceLocations in order to get the correct
@@ -791,28 +1786,25 @@ int main(int argc, char *argv[])
         }
 
       numberOfSlicesPerVolume=sliceLocations.size();
-      std::cout << "=================== numberOfSlicesPerVolume:" << numberOfSlicesPerVolume << std::endl;
+      DWIConvertLogDebug() << "=================== numberOfSlicesPerVolume:" << numberOfSlicesPerVolume << std::endl;
 
       if ( nSlice >= 2)
         {
         if(sliceLocationIndicator[0] != sliceLocationIndicator[1])
           {
-          std::cout << "Dicom images are ordered in a volume interleaving way." << std::endl;
+          DWIConvertLogDebug() << "Dicom images are ordered in a volume interleaving way." << std::endl;
           }
         else
           {
-          std::cout << "Dicom images are ordered in a slice interleaving way." << std::endl;
+          DWIConvertLogDebug() << "Dicom images are ordered in a slice interleaving way." << std::endl;
           // reorder slices into a volume interleaving manner
-          DeInterleaveVolume(readerOutput,numberOfSlicesPerVolume,nSlice);
-#if 0
-          itk::ImageFileWriter< VolumeType >::Pointer rawWriter = itk::ImageFileWriter< VolumeType >::New();
-          itk::RawImageIO<PixelValueType, 3>::Pointer rawIO = itk::RawImageIO<PixelValueType, 3>::New();
-          rawWriter->SetImageIO( rawIO );
-          rawIO->SetByteOrderToLittleEndian();
-          rawWriter->SetFileName( "dwiconvert.raw");
-          rawWriter->SetInput( readerOutput );
-          rawWriter->Update();
-#endif
+          sliceInterleaved = true;
+          if(readerOutput.IsNotNull())
+            {
+            profile.Phase("deinterleaveDemosaic");
+            DeInterleaveVolume(readerOutput,numberOfSlicesPerVolume,nSlice);
+            profile.Phase("sliceOrdering");
+            }
           }
         }
       }
@@ -844,17 +1836,17 @@ int main(int argc, char *argv[])
     LPSDirCos[1][2] = (LPSDirCos[2][0]*LPSDirCos[0][1]-LPSDirCos[0][0]*LPSDirCos[2][1]);
     LPSDirCos[2][2] = (LPSDirCos[0][0]*LPSDirCos[1][1]-LPSDirCos[1][0]*LPSDirCos[0][1]);
 
-    std::cout << "ImageOrientationPatient (0020:0037): ";
-    std::cout << "LPS Orientation Matrix" << std::endl;
-    std::cout << LPSDirCos << std::endl;
+    DWIConvertLogDebug() << "ImageOrientationPatient (0020:0037): "
+      << "LPS Orientation Matrix" << std::endl
+      << LPSDirCos << std::endl;
 
     itk::Matrix<double,3,3> SpacingMatrix;
     SpacingMatrix.Fill(0.0);
     SpacingMatrix[0][0]=xRes;
     SpacingMatrix[1][1]=yRes;
     SpacingMatrix[2][2]=sliceSpacing;
-    std::cout << "SpacingMatrix" << std::endl;
-    std::cout << SpacingMatrix << std::endl;
+    DWIConvertLogDebug() << "SpacingMatrix" << std::endl
+      << SpacingMatrix << std::endl;
 
     itk::Matrix<double,3,3> OrientationMatrix;
     OrientationMatrix.SetIdentity();
@@ -863,8 +1855,8 @@ int main(int argc, char *argv[])
     std::string nrrdSpaceDefinition="left-posterior-superior";;
     NRRDSpaceDirection=LPSDirCos*OrientationMatrix*SpacingMatrix;
 
-    std::cout << "NRRDSpaceDirection" << std::endl;
-    std::cout << NRRDSpaceDirection << std::endl;
+    DWIConvertLogDebug() << "NRRDSpaceDirection" << std::endl
+      << NRRDSpaceDirection << std::endl;
 
     unsigned int mMosaic = 0;   // number of raws in each mosaic block;
     unsigned int nMosaic = 0;   // number of columns in each mosaic block
@@ -886,13 +1878,13 @@ int main(int argc, char *argv[])
       // has the measurement frame represented as an identity matrix.
       double image0Origin[3];
       allHeaders[0]->GetElementDS(0x0020, 0x0032, 3, image0Origin);
-      std::cout << "Slice 0: " << image0Origin[0] << " " << image0Origin[1] << " " << image0Origin[2] << std::endl;
+      DWIConvertLogDebug() << "Slice 0: " << image0Origin[0] << " " << image0Origin[1] << " " << image0Origin[2] << std::endl;
 
       // assume volume interleaving, i.e. the second dicom file stores
       // the second slice in the same volume as the first dicom file
       double image1Origin[3];
       allHeaders[1]->GetElementDS(0x0020, 0x0032, 3, image1Origin);
-      std::cout << "Slice 0: " << image1Origin[0] << " " << image1Origin[1] << " " << image1Origin[2] << std::endl;
+      DWIConvertLogDebug() << "Slice 0: " << image1Origin[0] << " " << image1Origin[1] << " " << image1Origin[2] << std::endl;
 
       image1Origin[0] -= image0Origin[0];
       image1Origin[1] -= image0Origin[1];
@@ -909,7 +1901,7 @@ int main(int argc, char *argv[])
       {
       MeasurementFrame.SetIdentity(); //The DICOM version of SIEMENS that uses private tags
       // has the measurement frame represented as an identity matrix.
-      std::cout << "Siemens SliceMosaic......" << std::endl;
+      DWIConvertLogDebug() << "Siemens SliceMosaic......" << std::endl;
 
       SliceOrderIS = false;
 
@@ -922,8 +1914,8 @@ int main(int argc, char *argv[])
       int nItems = ExtractSiemensDiffusionInformation(tag, "SliceNormalVector", valueArray);
       if (nItems != 3)  // did not find enough information
         {
-        std::cout << "Warning: Cannot find complete information on SliceNormalVector in 0029|1010" << std::endl;
-        std::cout << "         Slice order may be wrong." << std::endl;
+        DWIConvertLogWarning() << "Warning: Cannot find complete information on SliceNormalVector in 0029|1010" << std::endl
+          << "         Slice order may be wrong." << std::endl;
         }
       else if (valueArray[2] > 0)
         {
@@ -935,8 +1927,8 @@ int main(int argc, char *argv[])
       nItems = ExtractSiemensDiffusionInformation(tag, "NumberOfImagesInMosaic", valueArray);
       if (nItems == 0)  // did not find enough information
         {
-        std::cout << "Warning: Cannot find complete information on NumberOfImagesInMosaic in 0029|1010" << std:: endl;
-        std::cout << "         Resulting image may contain empty slices." << std::endl;
+        DWIConvertLogWarning() << "Warning: Cannot find complete information on NumberOfImagesInMosaic in 0029|1010" << std:: endl
+          << "         Resulting image may contain empty slices." << std::endl;
         }
       else
         {
@@ -944,8 +1936,8 @@ int main(int argc, char *argv[])
         mMosaic = static_cast<int> (ceil(sqrt(valueArray[0])));
         nMosaic = mMosaic;
         }
-      std::cout << "Mosaic in " << mMosaic << " X " << nMosaic
-                << " blocks (total number of blocks = " << valueArray[0] << ")." << std::endl;
+      DWIConvertLogInfo() << "Mosaic in " << mMosaic << " X " << nMosaic
+        << " blocks (total number of blocks = " << valueArray[0] << ")." << std::endl;
       }
     else if (!multiSliceVolume &&  StringContains(vendor,"PHILIPS") && nSlice > 1)
       // so this is not a philips multi-frame single dicom file
@@ -958,14 +1950,14 @@ int main(int argc, char *argv[])
 
       double  image0Origin[3];
       allHeaders[0]->GetElementDS(0x0020, 0x0032, 3, image0Origin);
-      std::cout << "Slice 0: " << image0Origin[0] << " " << image0Origin[1] << " " << image0Origin[2] << std::endl;
+      DWIConvertLogDebug() << "Slice 0: " << image0Origin[0] << " " << image0Origin[1] << " " << image0Origin[2] << std::endl;
 
       // assume volume interleaving, i.e. the second dicom file stores
       // the second slice in the same volume as the first dicom file
       double  image1Origin[3];
       allHeaders[nVolume]->GetElementDS(0x0020, 0x0032, 3, image1Origin);
-      std::cout << "Slice " << nVolume << ": " << image1Origin[0] << " "
-                << image1Origin[1] << " " << image1Origin[2] << std::endl;
+      DWIConvertLogDebug() << "Slice " << nVolume << ": " << image1Origin[0] << " "
+        << image1Origin[1] << " " << image1Origin[2] << std::endl;
 
       image1Origin[0] -= image0Origin[0];
       image1Origin[1] -= image0Origin[1];
@@ -987,34 +1979,63 @@ int main(int argc, char *argv[])
       }
     else
       {
-      std::cout << " Warning: vendor type not valid" << std::endl;
+      DWIConvertLogWarning() << " Warning: vendor type not valid" << std::endl;
+      profile.Phase("pixelDecode");
       // treate the dicom series as an ordinary image and write a straight nrrd file.
+      if(readerOutput.IsNull())
+        {
+        if(ReadSeries(inputFileNames,readerOutput) != EXIT_SUCCESS)
+          {
+          FreeHeaders(allHeaders);
+          return EXIT_FAILURE;
+          }
+        if(sliceInterleaved)
+          {
+          profile.Phase("deinterleaveDemosaic");
+          DeInterleaveVolume(readerOutput,numberOfSlicesPerVolume,nSlice);
+          }
+        }
+      if(result != 0)
+        {
+        std::cerr << "Not a DWI series" << std::endl;
+        FreeHeaders(allHeaders);
+        return EXIT_FAILURE;
+        }
+      if(writeFSLFiles && conversionMode != "DicomToFSL")
+        {
+        // no gradients to write to the .bval and .bvec files
+        std::cerr << "fslNIFTIFile needs a DWI series, and this one is "
+                  << "from an unknown vendor" << std::endl;
+        FreeHeaders(allHeaders);
+        return EXIT_FAILURE;
+        }
+      profile.Phase("outputWrite");
       WriteVolume<VolumeType>( readerOutput, outputVolumeHeaderName );
       FreeHeaders(allHeaders);
-      return EXIT_SUCCESS;
+      return RecordFingerprint(outputVolumeHeaderName,fingerprint);
       }
 
     if ( SliceOrderIS )
       {
-      std::cout << "Slice order is IS" << std::endl;
+      DWIConvertLogDebug() << "Slice order is IS" << std::endl;
       }
     else
       {
-      std::cout << "Slice order is SI" << std::endl;
+      DWIConvertLogDebug() << "Slice order is SI" << std::endl;
       NRRDSpaceDirection[0][2] = -NRRDSpaceDirection[0][2];
       NRRDSpaceDirection[1][2] = -NRRDSpaceDirection[1][2];
       NRRDSpaceDirection[2][2] = -NRRDSpaceDirection[2][2];
       }
 
-    std::cout << "Row: " << (NRRDSpaceDirection[0][0])  << ", "
-              << (NRRDSpaceDirection[1][0]) << ", "
-              << (NRRDSpaceDirection[2][0]) << std::endl;
-    std::cout << "Col: " << (NRRDSpaceDirection[0][1])
-              << ", " << (NRRDSpaceDirection[1][1])
-              << ", " << (NRRDSpaceDirection[2][1]) << std::endl;
-    std::cout << "Sli: " << (NRRDSpaceDirection[0][2])
-              << ", " << (NRRDSpaceDirection[1][2]) << ", "
-              << (NRRDSpaceDirection[2][2]) << std::endl;
+    DWIConvertLogDebug() << "Row: " << (NRRDSpaceDirection[0][0])  << ", "
+      << (NRRDSpaceDirection[1][0]) << ", "
+      << (NRRDSpaceDirection[2][0]) << std::endl
+      << "Col: " << (NRRDSpaceDirection[0][1])
+      << ", " << (NRRDSpaceDirection[1][1])
+      << ", " << (NRRDSpaceDirection[2][1]) << std::endl
+      << "Sli: " << (NRRDSpaceDirection[0][2])
+      << ", " << (NRRDSpaceDirection[1][2]) << ", "
+      << (NRRDSpaceDirection[2][2]) << std::endl;
 
     const float orthoSliceSpacing = fabs((NRRDSpaceDirection[2][2]));
 
@@ -1029,11 +2050,12 @@ int main(int argc, char *argv[])
     std::vector< vnl_vector_fixed<double, 3> > DiffusionVectors;
     std::vector< vnl_vector_fixed<double, 3> > UnmodifiedDiffusionVectorsInDicomLPSCoordinateSystem;
     std::vector< unsigned int>  bad_gradient_indices;
-    std::vector<int> ignorePhilipsSliceMultiFrame;
+    std::vector<unsigned long> ignorePhilipsSliceMultiFrame;
 
     ////////////////////////////////////////////////////////////
     // vendor dependent tags.
     // read in gradient vectors and determin nBaseline and nMeasurement
+    profile.Phase("gradientExtraction");
 
     if ( StringContains(vendor,"GE") )
       {
@@ -1053,9 +2075,9 @@ int main(int argc, char *argv[])
       nVolume = nSlice/nSliceInVolume;
 
       // assume volume interleaving
-      std::cout << "Number of Slices: " << nSlice << std::endl;
-      std::cout << "Number of Volume: " << nVolume << std::endl;
-      std::cout << "Number of Slices in each volume: " << nSliceInVolume << std::endl;
+      DWIConvertLogInfo() << "Number of Slices: " << nSlice << std::endl
+        << "Number of Volume: " << nVolume << std::endl
+        << "Number of Slices in each volume: " << nSliceInVolume << std::endl;
 
       for (unsigned int k = 0; k < nSlice; k += nSliceInVolume)
         {
@@ -1094,7 +2116,7 @@ int main(int argc, char *argv[])
           DiffusionVectors.push_back(vect3d);
           }
 
-        std::cout << "B-value: " << b <<
+        DWIConvertLogDebug() << "B-value: " << b <<
           "; diffusion direction: " << vect3d[0] << ", " << vect3d[1] << ", " << vect3d[2] << std::endl;
         }
       }
@@ -1103,9 +2125,9 @@ int main(int argc, char *argv[])
       if(nSlice > 1 )
         {
         // assume volume interleaving
-        std::cout << "Number of Slices: " << nSlice << std::endl;
-        std::cout << "Number of Volumes: " << nVolume << std::endl;
-        std::cout << "Number of Slices in each volume: " << nSliceInVolume << std::endl;
+        DWIConvertLogInfo() << "Number of Slices: " << nSlice << std::endl
+          << "Number of Volumes: " << nVolume << std::endl
+          << "Number of Slices in each volume: " << nSliceInVolume << std::endl;
 
         std::string tmpString = "";
         //NOTE:  Philips interleaves the directions, so the all gradient directions can be
@@ -1185,10 +2207,10 @@ int main(int argc, char *argv[])
                 allHeaders[k]->GetElementSQ(0x0018,0x9076,DiffusionSeqEntry);
                 // const unsigned int
                 // n=DiffusionSeqEntry->GetNumberOfSQItems();
-                unsigned int n = DiffusionSeqEntry.card();
+                const unsigned long n = DiffusionSeqEntry.card();
                 if( n == 0 )
                   {
-                  std::cout << "ERROR:  Sequence entry 0018|9076 has no items." << std::endl;
+                  DWIConvertLogError() << "ERROR:  Sequence entry 0018|9076 has no items." << std::endl;
                   FreeHeaders(allHeaders);
                   return EXIT_FAILURE;
                   }
@@ -1197,8 +2219,8 @@ int main(int argc, char *argv[])
               vect3d[0] = doubleArray[0];
               vect3d[1] = doubleArray[1];
               vect3d[2] = doubleArray[2];
-              std::cout << "===== gradient orientations:" << k << " "
-                        << inputFileNames[k] << " (0018,9089) " << " " << vect3d << std::endl;
+              DWIConvertLogDebug() << "===== gradient orientations:" << k << " "
+                << inputFileNames[k] << " (0018,9089) " << " " << vect3d << std::endl;
               }
             else
               {
@@ -1218,13 +2240,13 @@ int main(int argc, char *argv[])
             }
           else // Have no idea why we'd be here so error out
             {
-            std::cout << "ERROR: DiffusionDirectionality was "
-                      << DiffusionDirectionality << "  Don't know what to do with that..." << std::endl;
+            DWIConvertLogError() << "ERROR: DiffusionDirectionality was "
+              << DiffusionDirectionality << "  Don't know what to do with that..." << std::endl;
             FreeHeaders(allHeaders);
             return EXIT_FAILURE;
             }
 
-          std::cout << "B-value: " << b <<
+          DWIConvertLogDebug() << "B-value: " << b <<
             "; diffusion direction: " << vect3d[0] << ", " << vect3d[1] << ", " << vect3d[2] << std::endl;
           }
         }
@@ -1244,13 +2266,13 @@ int main(int argc, char *argv[])
         double dwbValue;
 
         allHeaders[0]->GetElementSQ(0x5200,0x9230,perFrameFunctionalGroup);
-        int nItems = perFrameFunctionalGroup.card();
+        // enhanced files can hold more than 65535 frames
+        const unsigned long nItems = perFrameFunctionalGroup.card();
 
         // have to determine if volume slices are interleaved
         std::string origins[2];
 
-        for(unsigned long i = 0;
-            i < static_cast<unsigned long>(perFrameFunctionalGroup.card()); ++i)
+        for(unsigned long i = 0; i < nItems; ++i)
           {
           itk::DCMTKItem curItem;
           perFrameFunctionalGroup.GetElementItem(i,curItem);
@@ -1334,16 +2356,16 @@ int main(int argc, char *argv[])
         if(origins[0] == origins[1])
           {
           // interleaved image
-          DeInterleaveVolume(readerOutput,numberOfSlicesPerVolume,perFrameFunctionalGroup.card());
+          DeInterleaveVolume(readerOutput,numberOfSlicesPerVolume,nItems);
           }
 
 
-        std::cout << "LPS Matrix: " << std::endl << LPSDirCos << std::endl;
-        std::cout << "Volume Origin: " << std::endl << ImageOrigin[0] << ","
-                  << ImageOrigin[1] << ","  << ImageOrigin[2] << "," << std::endl;
-        std::cout << "Number of slices per volume: " << numberOfSlicesPerVolume << std::endl;
-        std::cout << "Slice matrix size: " << nRows << " X " << nCols << std::endl;
-        std::cout << "Image resolution: " << xRes << ", " << yRes << ", " << sliceSpacing << std::endl;
+        DWIConvertLogDebug() << "LPS Matrix: " << std::endl << LPSDirCos << std::endl
+          << "Volume Origin: " << std::endl << ImageOrigin[0] << ","
+          << ImageOrigin[1] << ","  << ImageOrigin[2] << "," << std::endl;
+        DWIConvertLogInfo() << "Number of slices per volume: " << numberOfSlicesPerVolume << std::endl
+          << "Slice matrix size: " << nRows << " X " << nCols << std::endl
+          << "Image resolution: " << xRes << ", " << yRes << ", " << sliceSpacing << std::endl;
 
         NRRDSpaceDirection=LPSDirCos*OrientationMatrix*SpacingMatrix;
 
@@ -1355,9 +2377,9 @@ int main(int argc, char *argv[])
 
         for( unsigned int k2 = 0; k2 < bValues.size(); ++k2 )
           {
-          std::cout << k2 << ": direction: " <<  DiffusionVectors[k2][0]
-                    << ", " << DiffusionVectors[k2][1] << ", " << DiffusionVectors[k2][2]
-                    << ", b-value: " << bValues[k2] << std::endl;
+          DWIConvertLogDebug() << k2 << ": direction: " <<  DiffusionVectors[k2][0]
+            << ", " << DiffusionVectors[k2][1] << ", " << DiffusionVectors[k2][2]
+            << ", b-value: " << bValues[k2] << std::endl;
           }
 
         }
@@ -1369,20 +2391,20 @@ int main(int argc, char *argv[])
 
       if ( !SliceMosaic )
         {
-        std::cout << orthoSliceSpacing << std::endl;
+        DWIConvertLogDebug() << orthoSliceSpacing << std::endl;
         nSliceInVolume = numberOfSlicesPerVolume;
         nVolume = nSlice/nSliceInVolume;
-        std::cout << "Number of Slices: " << nSlice << std::endl;
-        std::cout << "Number of Volume: " << nVolume << std::endl;
-        std::cout << "Number of Slices in each volume: " << nSliceInVolume << std::endl;
+        DWIConvertLogInfo() << "Number of Slices: " << nSlice << std::endl
+          << "Number of Volume: " << nVolume << std::endl
+          << "Number of Slices in each volume: " << nSliceInVolume << std::endl;
         nStride = nSliceInVolume;
         }
       else
         {
-        std::cout << "Data in Siemens Mosaic Format" << std::endl;
+        DWIConvertLogInfo() << "Data in Siemens Mosaic Format" << std::endl;
         nVolume = nSlice;
-        std::cout << "Number of Volume: " << nVolume << std::endl;
-        std::cout << "Number of Slices in each volume: " << nSliceInVolume << std::endl;
+        DWIConvertLogInfo() << "Number of Volume: " << nVolume << std::endl
+          << "Number of Slices in each volume: " << nSliceInVolume << std::endl;
         nStride = 1;
         }
 
@@ -1407,7 +2429,7 @@ int main(int argc, char *argv[])
           //
           // B_Value is missing -- the punt position is to count this
           // volume as having a B_value & Gradient Direction of zero
-          std::cout << "Warning: Cannot find complete information on B_value in 0029|1010" << std::endl;
+          DWIConvertLogWarning() << "Warning: Cannot find complete information on B_value in 0029|1010" << std::endl;
           bValues.push_back( 0.0 );
           vect3d.fill( 0.0 );
           UnmodifiedDiffusionVectorsInDicomLPSCoordinateSystem.push_back(vect3d);
@@ -1435,8 +2457,8 @@ int main(int argc, char *argv[])
 
           if (nItems == 6)
             {
-            std::cout << "=============================================" << std::endl;
-            std::cout << "BMatrix calculations..." << std::endl;
+            DWIConvertLogDebug() << "=============================================" << std::endl
+              << "BMatrix calculations..." << std::endl;
             // UNC comments: We get the value of the b-value tag in the header.
             // We won't use it as is, but just to locate the B0 images.
             // This check must be added, otherwise the bmatrix of the B0 is not
@@ -1476,28 +2498,28 @@ int main(int argc, char *argv[])
             vect3d[1] = svd.U(1,0);
             vect3d[2] = svd.U(2,0);
 
-            std::cout << "BMatrix: " << std::endl;
-            std::cout << bMatrix[0][0] << std::endl;
-            std::cout << bMatrix[0][1] << "\t" << bMatrix[1][1] << std::endl;
-            std::cout << bMatrix[0][2] << "\t" << bMatrix[1][2] << "\t" << bMatrix[2][2] << std::endl;
+            DWIConvertLogDebug() << "BMatrix: " << std::endl
+              << bMatrix[0][0] << std::endl
+              << bMatrix[0][1] << "\t" << bMatrix[1][1] << std::endl
+              << bMatrix[0][2] << "\t" << bMatrix[1][2] << "\t" << bMatrix[2][2] << std::endl;
 
             // UNC comments: The b-value si the trace of the bmatrix
             bvalue = bMatrix[0][0] + bMatrix[1][1] + bMatrix[2][2];
-            std::cout << bvalue << std::endl;
+            DWIConvertLogDebug() << bvalue << std::endl;
             // UNC comments: Even if the bmatrix is null, the svd decomposition set the 1st eigenvector
             // to (1,0,0). So we force the gradient direction to 0 if the bvalue is null
             if((b0_image == true) || (bvalue == 0))
               {
-              std::cout << "B0 image detected: gradient direction and bvalue forced to 0" << std::endl;
+              DWIConvertLogDebug() << "B0 image detected: gradient direction and bvalue forced to 0" << std::endl;
               vect3d[0] = 0;
               vect3d[1] = 0;
               vect3d[2] = 0;
-              std::cout << "Gradient coordinates: " << vect3d[0] << " " << vect3d[1] << " " << vect3d[2] << std::endl;
+              DWIConvertLogDebug() << "Gradient coordinates: " << vect3d[0] << " " << vect3d[1] << " " << vect3d[2] << std::endl;
               bValues.push_back(0);
               }
             else
               {
-              std::cout << "Gradient coordinates: " << vect3d[0] << " " << vect3d[1] << " " << vect3d[2] << std::endl;
+              DWIConvertLogDebug() << "Gradient coordinates: " << vect3d[0] << " " << vect3d[1] << " " << vect3d[2] << std::endl;
               bValues.push_back(bvalue);
               }
             DiffusionVectors.push_back(vect3d);
@@ -1522,7 +2544,7 @@ int main(int argc, char *argv[])
         {
         for (unsigned int k = 0; k < nSlice; k += nStride )
           {
-          std::cout << "=======================================" << std::endl << std::endl;
+          DWIConvertLogDebug() << "=======================================" << std::endl << std::endl;
           std::string diffusionInfoString;
           allHeaders[k]->GetElementOB(0x0029, 0x1010, diffusionInfoString );
 
@@ -1534,17 +2556,17 @@ int main(int argc, char *argv[])
           int nItems = ExtractSiemensDiffusionInformation(diffusionInfoString, "DiffusionGradientDirection", valueArray);
           if (nItems != 3)  // did not find enough information
             {
-            std::cout << "Warning: Cannot find complete information on DiffusionGradientDirection in 0029|1010" << std::endl;
+            DWIConvertLogWarning() << "Warning: Cannot find complete information on DiffusionGradientDirection in 0029|1010" << std::endl;
             vect3d.fill( 0 );
             UnmodifiedDiffusionVectorsInDicomLPSCoordinateSystem.push_back(vect3d);
             DiffusionVectors.push_back(vect3d);
             }
           else
             {
-            std::cout << "Number of Directions : " << nItems << std::endl;
-            std::cout << "   Directions 0: " << valueArray[0] << std::endl;
-            std::cout << "   Directions 1: " << valueArray[1] << std::endl;
-            std::cout << "   Directions 2: " << valueArray[2] << std::endl;
+            DWIConvertLogDebug() << "Number of Directions : " << nItems << std::endl
+              << "   Directions 0: " << valueArray[0] << std::endl
+              << "   Directions 1: " << valueArray[1] << std::endl
+              << "   Directions 2: " << valueArray[2] << std::endl;
             double DiffusionVector_magnitude;
             vect3d[0] = valueArray[0];
             vect3d[1] = valueArray[1];
@@ -1552,13 +2574,13 @@ int main(int argc, char *argv[])
 
             DiffusionVector_magnitude = sqrt((vect3d[0]*vect3d[0]) + (vect3d[1]*vect3d[1]) + (vect3d[2]*vect3d[2]));
 
-            std::cout << "DiffusionVector_magnitude " << DiffusionVector_magnitude << std::endl;
+            DWIConvertLogDebug() << "DiffusionVector_magnitude " << DiffusionVector_magnitude << std::endl;
             if(DiffusionVector_magnitude <= smallGradientThreshold)
               {
-              std::cout << "ERROR: Gradient vector with unreasonably small magnitude exists." << std::endl;
-              std::cout << "Gradient #" << k << " with magnitude " << DiffusionVector_magnitude << std::endl;
-              std::cout << "Please set useBMatrixGradientDirections to calculate gradient directions "
-                        << "from the scanner B Matrix to alleviate this problem." << std::endl;
+              DWIConvertLogError() << "ERROR: Gradient vector with unreasonably small magnitude exists." << std::endl
+                << "Gradient #" << k << " with magnitude " << DiffusionVector_magnitude << std::endl
+                << "Please set useBMatrixGradientDirections to calculate gradient directions "
+                << "from the scanner B Matrix to alleviate this problem." << std::endl;
               FreeHeaders(allHeaders);
               return EXIT_FAILURE;
               }
@@ -1567,15 +2589,15 @@ int main(int argc, char *argv[])
             // vect3d.normalize();
             DiffusionVectors.push_back(vect3d);
             int p = bValues.size();
-            std::cout << "Image#: " << k << " BV: " << bValues[p-1] << " GD: " << DiffusionVectors[k/nStride] << std::endl;
+            DWIConvertLogDebug() << "Image#: " << k << " BV: " << bValues[p-1] << " GD: " << DiffusionVectors[k/nStride] << std::endl;
             }
           }
         }
       }
     else
       {
-      std::cout << "ERROR: Unknown scanner vendor " << vendor << std::endl;
-      std::cout << "       this dti file format is properly handled." << std::endl;
+      DWIConvertLogError() << "ERROR: Unknown scanner vendor " << vendor << std::endl
+        << "       this dti file format is properly handled." << std::endl;
       FreeHeaders(allHeaders);
       return EXIT_FAILURE;
       }
@@ -1591,8 +2613,35 @@ int main(int argc, char *argv[])
     // Update the number of volumes based on the
     // number to ignore from the header information
     const unsigned int nUsableVolumes = nVolume-nIgnoreVolume-bad_gradient_indices.size();
-    std::cout << "Number of usable volumes: " << nUsableVolumes << std::endl;
+    DWIConvertLogInfo() << "Number of usable volumes: " << nUsableVolumes << std::endl;
+    profile.SetCount("numberOfVolumes",nUsableVolumes);
+
+    // Volumes that Philips marks to be ignored aren't dropped from
+    // the image, so those series are always converted in memory.
+    const bool streamVolumes = deferRead && nIgnoreVolume == 0 &&
+      nUsableVolumes > 1;
+    profile.SetFlag("streamed",streamVolumes);
+    if(deferRead && !streamVolumes)
+      {
+      DWIConvertLogInfo() << "Output can't be streamed or mapped for this series, "
+        << "converting in memory" << std::endl;
+      }
+    if(!streamVolumes && readerOutput.IsNull())
+      {
+      profile.Phase("pixelDecode");
+      if(ReadSeries(inputFileNames,readerOutput) != EXIT_SUCCESS)
+        {
+        FreeHeaders(allHeaders);
+        return EXIT_FAILURE;
+        }
+      if(sliceInterleaved)
+        {
+        profile.Phase("deinterleaveDemosaic");
+        DeInterleaveVolume(readerOutput,numberOfSlicesPerVolume,nSlice);
+        }
+      }
 
+    profile.Phase("deinterleaveDemosaic");
     if ( StringContains(vendor, "GE") ||
          (StringContains(vendor, "SIEMENS") && !SliceMosaic) )
       {
@@ -1616,80 +2665,57 @@ int main(int argc, char *argv[])
                          nCols*(NRRDSpaceDirection[2][1]) +
                          nSliceInVolume*(NRRDSpaceDirection[2][2]))/2.0;
 
-      VolumeType::Pointer img = readerOutput;
-
-      VolumeType::RegionType region = img->GetLargestPossibleRegion();
-      VolumeType::SizeType size = region.GetSize();
-
-      VolumeType::SizeType dmSize = size;
-      unsigned int original_slice_number = dmSize[2] * nSliceInVolume;
-      dmSize[0] /= mMosaic;
-      dmSize[1] /= nMosaic;
-      dmSize[2] = nUsableVolumes * nSliceInVolume;
-
-      region.SetSize( dmSize );
-      dmImage = VolumeType::New();
-      dmImage->CopyInformation( img );
-      dmImage->SetRegions( region );
-      dmImage->Allocate();
-
-      VolumeType::RegionType dmRegion = dmImage->GetLargestPossibleRegion();
-      dmRegion.SetSize(2, 1);
-      region.SetSize(0, dmSize[0]);
-      region.SetSize(1, dmSize[1]);
-      region.SetSize(2, 1);
-
-      //    int rawMosaic = 0;
-      //    int colMosaic = 0;
-
-      bool bad_slice = false;
-      unsigned int bad_slice_counter = 0;
-      for (unsigned int k = 0; k < original_slice_number; ++k)
+      if(!streamVolumes)
         {
-        for ( unsigned int j = 0; j < bad_gradient_indices.size(); ++j)
+        VolumeType::Pointer img = readerOutput;
+
+        VolumeType::RegionType region = img->GetLargestPossibleRegion();
+        VolumeType::SizeType size = region.GetSize();
+
+        VolumeType::SizeType dmSize = size;
+        unsigned int original_slice_number = dmSize[2] * nSliceInVolume;
+        dmSize[0] /= mMosaic;
+        dmSize[1] /= nMosaic;
+        dmSize[2] = nUsableVolumes * nSliceInVolume;
+
+        region.SetSize( dmSize );
+        dmImage = VolumeType::New();
+        dmImage->CopyInformation( img );
+        dmImage->SetRegions( region );
+        dmImage->Allocate();
+
+        bool bad_slice = false;
+        unsigned int bad_slice_counter = 0;
+        for (unsigned int k = 0; k < original_slice_number; ++k)
           {
-          unsigned int start_bad_slice_number = bad_gradient_indices[j] * nSliceInVolume;
-          unsigned int end_bad_slice_number = start_bad_slice_number + (nSliceInVolume - 1);
-
-          if (k >= start_bad_slice_number && k <= end_bad_slice_number)
-            {
-            bad_slice = true;
-            ++bad_slice_counter;
-            break;
-            }
-          else
+          for ( unsigned int j = 0; j < bad_gradient_indices.size(); ++j)
             {
-            bad_slice = false;
-            }
-          }
-
-        if (bad_slice == false)
-          {
-          unsigned int new_k = k - bad_slice_counter;
-
-          dmRegion.SetIndex(2, new_k);
-          itk::ImageRegionIteratorWithIndex<VolumeType> dmIt( dmImage, dmRegion );
+            unsigned int start_bad_slice_number = bad_gradient_indices[j] * nSliceInVolume;
+            unsigned int end_bad_slice_number = start_bad_slice_number + (nSliceInVolume - 1);
 
-          // figure out the mosaic region for this slice
-          int sliceIndex = k;
-
-          //int nBlockPerSlice = mMosaic*nMosaic;
-          int slcMosaic = sliceIndex/(nSliceInVolume);
-          sliceIndex -= slcMosaic*nSliceInVolume;
-          int colMosaic = sliceIndex/mMosaic;
-          int rawMosaic = sliceIndex - mMosaic*colMosaic;
-          region.SetIndex( 0, rawMosaic*dmSize[0] );
-          region.SetIndex( 1, colMosaic*dmSize[1] );
-          region.SetIndex( 2, slcMosaic );
+            if (k >= start_bad_slice_number && k <= end_bad_slice_number)
+              {
+              bad_slice = true;
+              ++bad_slice_counter;
+              break;
+              }
+            else
+              {
+              bad_slice = false;
+              }
+            }
 
-          itk::ImageRegionConstIteratorWithIndex<VolumeType> imIt( img, region );
-          for ( dmIt.GoToBegin(), imIt.GoToBegin(); !dmIt.IsAtEnd(); ++dmIt, ++imIt)
+          if (bad_slice == false)
             {
-            dmIt.Set( imIt.Get() );
+            unsigned int new_k = k - bad_slice_counter;
+
+            // figure out the mosaic region for this slice
+            const unsigned int slcMosaic = k/(nSliceInVolume);
+            DeMosaicSlice(img,slcMosaic,k - slcMosaic*nSliceInVolume,
+                          mMosaic,dmImage,new_k);
             }
           }
         }
-
       }
     else if (StringContains(vendor, "PHILIPS"))
       {
@@ -1745,20 +2771,20 @@ int main(int argc, char *argv[])
       //Verify sizes
       if( count != bValues.size() )
         {
-        std::cout << "ERROR:  bValues are the wrong size." <<  count << " != " << bValues.size() << std::endl;
+        DWIConvertLogError() << "ERROR:  bValues are the wrong size." <<  count << " != " << bValues.size() << std::endl;
         FreeHeaders(allHeaders);
         return EXIT_FAILURE;
         }
       if( count != DiffusionVectors.size() )
         {
-        std::cout << "ERROR:  DiffusionVectors are the wrong size." <<  count << " != " << DiffusionVectors.size() << std::endl;
+        DWIConvertLogError() << "ERROR:  DiffusionVectors are the wrong size." <<  count << " != " << DiffusionVectors.size() << std::endl;
         FreeHeaders(allHeaders);
         return EXIT_FAILURE;
         }
       if( count != UnmodifiedDiffusionVectorsInDicomLPSCoordinateSystem.size() )
         {
-        std::cout << "ERROR:  UnmodifiedDiffusionVectorsInDicomLPSCoordinateSystem are the wrong size."
-                  <<  count << " != " << UnmodifiedDiffusionVectorsInDicomLPSCoordinateSystem.size() << std::endl;
+        DWIConvertLogError() << "ERROR:  UnmodifiedDiffusionVectorsInDicomLPSCoordinateSystem are the wrong size."
+          <<  count << " != " << UnmodifiedDiffusionVectorsInDicomLPSCoordinateSystem.size() << std::endl;
         FreeHeaders(allHeaders);
         return EXIT_FAILURE;
         }
@@ -1772,17 +2798,44 @@ int main(int argc, char *argv[])
       }
     else
       {
-      std::cout << "Warning:  invalid vendor found." << std::endl;
+      DWIConvertLogWarning() << "Warning:  invalid vendor found." << std::endl;
+      if(result != 0)
+        {
+        std::cerr << "Not a DWI series" << std::endl;
+        FreeHeaders(allHeaders);
+        return EXIT_FAILURE;
+        }
+      profile.Phase("outputWrite");
       WriteVolume<VolumeType>( readerOutput, outputVolumeHeaderName );
       FreeHeaders(allHeaders);
-      return EXIT_SUCCESS;
+      return RecordFingerprint(outputVolumeHeaderName,fingerprint);
       }
 
+    if(result != 0 && nUsableVolumes == 1)
+      {
+      std::cerr << "Not a DWI series" << std::endl;
+      FreeHeaders(allHeaders);
+      return EXIT_FAILURE;
+      }
+    if(writeFSLFiles && conversionMode != "DicomToFSL" &&
+       nUsableVolumes == 1 && nrrdFormat && !streamVolumes)
+      {
+      // written below as a plain volume, without gradients
+      std::cerr << "fslNIFTIFile needs a DWI series, and this one has "
+                << "a single volume" << std::endl;
+      FreeHeaders(allHeaders);
+      return EXIT_FAILURE;
+      }
     //
     // FSLOutput requires a NIfT file
-    if(conversionMode != "DicomToFSL")
+    profile.Phase("outputWrite");
+    if(conversionMode != "DicomToFSL" && result == 0)
       {
-      if(!nrrdFormat)
+      if(streamVolumes)
+        {
+        // the voxels are written after the header
+        }
+      else if(!nrrdFormat)
         {
         itk::ImageFileWriter< VolumeType >::Pointer rawWriter = itk::ImageFileWriter< VolumeType >::New();
         itk::RawImageIO<PixelValueType, 3>::Pointer rawIO = itk::RawImageIO<PixelValueType, 3>::New();
@@ -1811,17 +2864,22 @@ int main(int argc, char *argv[])
         // converts a DICOM volume to whatever format you specify by way
         // of the output filename.
         FreeHeaders(allHeaders);
-        return rval;
+        if(rval != EXIT_SUCCESS)
+          {
+          return rval;
+          }
+        return RecordFingerprint(outputVolumeHeaderName,fingerprint);
         }
       }
-    else
+    if(writeFSLFiles)
       {
-      if(Write4DVolume(dmImage,nUsableVolumes,outputVolumeHeaderName) != EXIT_SUCCESS)
+      if(Write4DVolume(dmImage,nUsableVolumes,outputFSLVolumeName) != EXIT_SUCCESS)
         {
         FreeHeaders(allHeaders);
         return EXIT_FAILURE;
         }
       }
+    profile.Phase("gradientExtraction");
     const vnl_matrix_fixed<double,3,3> InverseMeasurementFrame= MeasurementFrame.GetInverse();
 
     //  float bValue = 0;
@@ -1844,8 +2902,13 @@ int main(int argc, char *argv[])
       // x y z
       // etc
       std::ifstream gradientFile(gradientVectorFile.c_str(),std::ifstream::in);
-      unsigned int numGradients;
-      gradientFile >> numGradients;
+      unsigned int numGradients(0);
+      if(!(gradientFile >> numGradients))
+        {
+        std::cerr << "Can't read the number of gradients from "
+                  << gradientVectorFile << std::endl;
+        return EXIT_FAILURE;
+        }
       if(numGradients != nUsableVolumes)
         {
         std::cerr << "number of Gradients doesn't match number of volumes" << std::endl;
@@ -1882,7 +2945,7 @@ int main(int argc, char *argv[])
           {
           scaleFactor = sqrt( bValues[k]/maxBvalue );
           }
-        std::cout << "For Multiple BValues: " << k << " -- " << bValues[k] << " / " << maxBvalue << " = " << scaleFactor << std::endl;
+        DWIConvertLogDebug() << "For Multiple BValues: " << k << " -- " << bValues[k] << " / " << maxBvalue << " = " << scaleFactor << std::endl;
         std::vector<double> vec(3);
         if (print_gradient == true)
           {
@@ -1915,21 +2978,47 @@ int main(int argc, char *argv[])
           }
         else
           {
-          std::cout << "Gradient " << k << " was removed and will not be printed in the NRRD header file." << std::endl;
+          DWIConvertLogWarning() << "Gradient " << k << " was removed and will not be printed in the NRRD header file." << std::endl;
           }
         }
       }
 
+    if(result != 0)
+      {
+      // the b-values of the volumes that were kept
+      std::vector<double> usableBValues;
+      for(unsigned int k = 0; k < bValues.size(); ++k)
+        {
+        if(std::find(bad_gradient_indices.begin(),bad_gradient_indices.end(),
+                     k) == bad_gradient_indices.end())
+          {
+          usableBValues.push_back(bValues[k]);
+          }
+        }
+      itk::Matrix<double,3,3> measurementFrame = MeasurementFrame;
+      if(useIdentityMeaseurementFrame)
+        {
+        measurementFrame.SetIdentity();
+        }
+      FillResult(dmImage,nSliceInVolume,nUsableVolumes,NRRDSpaceDirection,
+                 ImageOrigin,measurementFrame,maxBvalue,gradientVectors,
+                 usableBValues,*result);
+      FreeHeaders(allHeaders);
+      return EXIT_SUCCESS;
+      }
+
     //////////////////////////////////////////////
     // write header file
     // This part follows a DWI NRRD file in NRRD format 5.
+    // Streamed series are decoded as they're written, so their pixel
+    // decode is part of this phase.
+    profile.Phase("outputWrite");
     // There should be a better way using itkNRRDImageIO.
     if(conversionMode != "DicomToFSL")
       {
-      std::ofstream header;
-      //std::string headerFileName = outputDir + "/" + outputFileName;
-
-      header.open (outputVolumeHeaderName.c_str(), std::ios::out | std::ios::binary);
+      // the header is built in memory, so that it can be copied into a
+      // mapped output file
+      std::ostringstream header;
       header << "NRRD0005" << std::endl;
 
       if (!nrrdFormat)
@@ -2053,16 +3142,92 @@ int main(int argc, char *argv[])
           }
         }
       // write data in the same file is .nrrd was chosen
-      header << std::endl;;
-      if (nrrdFormat)
+      // padding only matters when the data is attached
+      const std::string headerText =
+        FinishNrrdHeader(header.str(), nrrdFormat ? nrrdDataAlignment : 0);
+      const bool mapVolumes = streamVolumes && memoryMapOutput;
+      DWIConvertVolumeDigests digests;
+      digests.SetVolumeSize(nCols,nRows,nSliceInVolume);
+      DWIConvertVolumeDigests *volumeDigests =
+        writeVolumeDigests ? &digests : 0;
+      std::ofstream headerFile;
+      if(!mapVolumes || !nrrdFormat)
+        {
+        headerFile.open(outputVolumeHeaderName.c_str(),
+                        std::ios::out | std::ios::binary);
+        headerFile << headerText;
+        }
+      if(mapVolumes)
+        {
+        // with .nrrd output the header goes at the start of the
+        // mapped file, otherwise only the .raw file is mapped
+        const std::string mappedFileName =
+          nrrdFormat ? outputVolumeHeaderName : outputVolumeDataName;
+        const std::string mappedHeader = nrrdFormat ? headerText : "";
+        const size_t dataSize = static_cast<size_t>(nRows) * nCols *
+          nSliceInVolume * nUsableVolumes * sizeof(PixelValueType);
+        DWIMappedOutputFile mappedFile;
+        if(mappedFile.Open(mappedFileName,mappedHeader,dataSize) != EXIT_SUCCESS ||
+           AssembleMappedVolumes(reinterpret_cast<PixelValueType *>(mappedFile.GetData()),
+                                 inputFileNames,nUsableVolumes,nVolume,
+                                 nSliceInVolume,nRows,nCols,
+                                 sliceInterleaved,SliceMosaic,mMosaic,
+                                 bad_gradient_indices,volumeDigests) != EXIT_SUCCESS ||
+           mappedFile.Close() != EXIT_SUCCESS)
+          {
+          std::cerr << "Failed to write the volume data" << std::endl;
+          FreeHeaders(allHeaders);
+          return EXIT_FAILURE;
+          }
+        }
+      else if(streamVolumes)
+        {
+        std::ofstream rawData;
+        std::ostream *dataStream = &headerFile;
+        if(!nrrdFormat)
+          {
+          rawData.open(outputVolumeDataName.c_str(),
+                       std::ios::out | std::ios::binary);
+          dataStream = &rawData;
+          }
+        if(WriteStreamedVolumes(*dataStream,
+                                nrrdFormat ? outputVolumeHeaderName :
+                                outputVolumeDataName,
+                                inputFileNames,
+                                nUsableVolumes,nVolume,nSliceInVolume,
+                                sliceInterleaved,SliceMosaic,mMosaic,
+                                bad_gradient_indices,volumeDigests) != EXIT_SUCCESS)
+          {
+          std::cerr << "Failed to write the volume data" << std::endl;
+          FreeHeaders(allHeaders);
+          return EXIT_FAILURE;
+          }
+        }
+      else if (nrrdFormat)
+        {
+        const size_t nVoxels = dmImage->GetBufferedRegion().GetNumberOfPixels();
+        DWIConvertTraceSpan span("write chunk",outputVolumeHeaderName,
+                                 nVoxels*sizeof(short));
+        headerFile.write( reinterpret_cast<char *>(dmImage->GetBufferPointer()),
+                          nVoxels*sizeof(short) );
+        }
+      headerFile.close();
+      if(writeVolumeDigests)
         {
-        unsigned long nVoxels = dmImage->GetBufferedRegion().GetNumberOfPixels();
-        header.write( reinterpret_cast<char *>(dmImage->GetBufferPointer()),
-                      nVoxels*sizeof(short) );
+        if(!streamVolumes)
+          {
+          digests.AddVolumes(dmImage->GetBufferPointer(),
+                             static_cast<size_t>(nCols) * nRows * nSliceInVolume,
+                             nUsableVolumes);
+          }
+        if(digests.Write(outputVolumeHeaderName) != EXIT_SUCCESS)
+          {
+          FreeHeaders(allHeaders);
+          return EXIT_FAILURE;
+          }
         }
-      header.close();
       }
-    else
+    if(writeFSLFiles)
       {
       // write out in FSL format
       if(WriteBValues<float>(bValues,outputFSLBValFilename) != EXIT_SUCCESS)
@@ -2138,6 +3303,5 @@ int main(int argc, char *argv[])
     }
 
   FreeHeaders(allHeaders);
-  return EXIT_SUCCESS;
+  return RecordFingerprint(outputVolumeHeaderName,fingerprint);
 }
-
@@ -0,0 +1,396 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <ctype.h>
+#include "itkMultiThreader.h"
+#include "itkSimpleFastMutexLock.h"
+#include "itksys/SystemTools.hxx"
+#include "DWIConvertShard.h"
+#include "DWIConvertLog.h"
+
+extern int DWIConvertMain(int argc, char *argv[]);
+extern int ReadDicomFileList(const std::string &listName,
+                             std::vector<std::string> &fileNames);
+
+namespace
+{
+/** one line of the batch manifest */
+struct BatchEntry
+{
+  std::string              Line;
+  std::vector<std::string> Args;
+  int                      Result;
+  double                   Seconds;
+};
+
+struct BatchState
+{
+  std::vector<BatchEntry>  *Entries;
+  DWIConvertJournal        *Journal;
+  unsigned int              NextEntry;
+  unsigned int              NumberOfThreads;
+  itk::SimpleFastMutexLock  Lock;
+};
+
+/** split a manifest line into arguments; double quotes group
+ *  arguments containing spaces */
+std::vector<std::string>
+SplitArguments(const std::string &line)
+{
+  std::vector<std::string> args;
+  std::string arg;
+  bool inArg(false), quoted(false);
+  for(std::string::const_iterator it = line.begin(); it != line.end(); ++it)
+    {
+    const char c = *it;
+    if(c == '"')
+      {
+      quoted = !quoted;
+      inArg = true;
+      }
+    else if(!quoted && isspace(c))
+      {
+      if(inArg)
+        {
+        args.push_back(arg);
+        arg = "";
+        inArg = false;
+        }
+      }
+    else
+      {
+      arg += c;
+      inArg = true;
+      }
+    }
+  if(inArg)
+    {
+    args.push_back(arg);
+    }
+  return args;
+}
+
+int
+ReadManifest(const std::string &manifestName,
+             std::vector<BatchEntry> &entries)
+{
+  std::ifstream manifest(manifestName.c_str());
+  if(!manifest.good())
+    {
+    std::cerr << "Can't open batch manifest " << manifestName << std::endl;
+    return EXIT_FAILURE;
+    }
+  std::string line;
+  while(std::getline(manifest,line))
+    {
+    BatchEntry entry;
+    entry.Line = line;
+    entry.Args = SplitArguments(line);
+    if(entry.Args.empty() || entry.Args[0][0] == '#')
+      {
+      continue;
+      }
+    if(std::find(entry.Args.begin(),entry.Args.end(),
+                 "--batchManifest") != entry.Args.end())
+      {
+      std::cerr << "Batch manifest entries can't be batches: "
+                << line << std::endl;
+      return EXIT_FAILURE;
+      }
+    entry.Result = EXIT_FAILURE;
+    entry.Seconds = 0.0;
+    entries.push_back(entry);
+    }
+  return EXIT_SUCCESS;
+}
+
+/** run one entry as if DWIConvert had been started with its arguments */
+void
+ConvertEntry(BatchEntry &entry, unsigned int threadsForEntry)
+{
+  std::vector<std::string> args;
+  args.push_back("DWIConvert");
+  args.insert(args.end(),entry.Args.begin(),entry.Args.end());
+  if(std::find(args.begin(),args.end(),"--numberOfThreads") == args.end())
+    {
+    std::ostringstream threads;
+    threads << threadsForEntry;
+    args.push_back("--numberOfThreads");
+    args.push_back(threads.str());
+    }
+  std::vector<char *> argv;
+  for(unsigned int i = 0; i < args.size(); ++i)
+    {
+    argv.push_back(const_cast<char *>(args[i].c_str()));
+    }
+  argv.push_back(0);
+
+  const double start = itksys::SystemTools::GetTime();
+  try
+    {
+    entry.Result = DWIConvertMain(static_cast<int>(args.size()),&argv[0]);
+    }
+  catch(...)
+    {
+    std::cerr << "Exception thrown converting " << entry.Line << std::endl;
+    entry.Result = EXIT_FAILURE;
+    }
+  entry.Seconds = itksys::SystemTools::GetTime() - start;
+}
+
+ITK_THREAD_RETURN_TYPE
+BatchWorker(void *arg)
+{
+  itk::MultiThreader::ThreadInfoStruct *threadInfo =
+    static_cast<itk::MultiThreader::ThreadInfoStruct *>(arg);
+  BatchState *state = static_cast<BatchState *>(threadInfo->UserData);
+  const unsigned int nEntries = state->Entries->size();
+  for(;;)
+    {
+    state->Lock.Lock();
+    const unsigned int current = state->NextEntry++;
+    state->Lock.Unlock();
+    if(current >= nEntries)
+      {
+      break;
+      }
+    // once fewer entries than workers are left, give the idle
+    // threads to the remaining conversions
+    const unsigned int remaining = nEntries - current;
+    const unsigned int threadsForEntry =
+      std::max(1u,state->NumberOfThreads /
+               std::min(state->NumberOfThreads,remaining));
+
+    BatchEntry &entry = (*state->Entries)[current];
+    ConvertEntry(entry,threadsForEntry);
+    if(entry.Result == EXIT_SUCCESS)
+      {
+      state->Journal->MarkDone(entry.Line);
+      }
+
+    state->Lock.Lock();
+    DWIConvertLogInfo() << "Batch entry " << current + 1 << "/" << nEntries
+      << (entry.Result == EXIT_SUCCESS ? " succeeded" : " FAILED")
+      << ": " << entry.Line << std::endl;
+    state->Lock.Unlock();
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+/** the argument following option in entry, or "" */
+std::string
+EntryOption(const BatchEntry &entry, const char *option)
+{
+  std::vector<std::string>::const_iterator it =
+    std::find(entry.Args.begin(),entry.Args.end(),option);
+  if(it == entry.Args.end() || ++it == entry.Args.end())
+    {
+    return "";
+    }
+  return *it;
+}
+
+/** estimated cost of an entry, from its input directory or file, or
+ *  from the sizes of the files in its file list */
+double
+EntryCost(const BatchEntry &entry)
+{
+  const std::string inputDirectory =
+    EntryOption(entry,"--inputDicomDirectory");
+  if(inputDirectory != "")
+    {
+    return DWIConvertEstimateInputCost(inputDirectory);
+    }
+  const std::string fileList = EntryOption(entry,"--inputDicomFileList");
+  std::vector<std::string> fileNames;
+  // a list on standard input can't be read ahead of the conversion
+  if(fileList == "" || fileList == "-" ||
+     ReadDicomFileList(fileList,fileNames) != EXIT_SUCCESS)
+    {
+    return 0.0;
+    }
+  return DWIConvertEstimateFilesCost(fileNames);
+}
+
+/** whether any entry is given option, as "--option value" or
+ *  "--option=value" */
+bool
+AnyEntryHasOption(const std::vector<BatchEntry> &entries,
+                  const std::string &option)
+{
+  for(unsigned int i = 0; i < entries.size(); ++i)
+    {
+    for(unsigned int j = 0; j < entries[i].Args.size(); ++j)
+      {
+      if(entries[i].Args[j].compare(0,option.size(),option) == 0)
+        {
+        return true;
+        }
+      }
+    }
+  return false;
+}
+
+/** keep only the entries that belong to this shard and that the
+ *  journal doesn't list as done */
+void
+SelectEntries(std::vector<BatchEntry> &entries,
+              unsigned int shardIndex,
+              unsigned int shardCount,
+              const DWIConvertJournal &journal,
+              unsigned int &alreadyDone)
+{
+  // the partition is over the whole manifest, so that it doesn't
+  // change when a shard is resumed
+  std::vector<DWIConvertWorkItem> items(entries.size());
+  for(unsigned int i = 0; i < entries.size(); ++i)
+    {
+    items[i].Key = entries[i].Line;
+    items[i].Cost = shardCount > 1 ? EntryCost(entries[i]) : 0.0;
+    }
+  std::vector<unsigned int> shard;
+  if(shardCount > 1)
+    {
+    shard = DWIConvertAssignShard(items,shardIndex,shardCount);
+    }
+  else
+    {
+    for(unsigned int i = 0; i < entries.size(); ++i)
+      {
+      shard.push_back(i);
+      }
+    }
+  std::vector<BatchEntry> selected;
+  alreadyDone = 0;
+  for(unsigned int i = 0; i < shard.size(); ++i)
+    {
+    if(journal.IsDone(entries[shard[i]].Line))
+      {
+      ++alreadyDone;
+      continue;
+      }
+    selected.push_back(entries[shard[i]]);
+    }
+  entries.swap(selected);
+}
+
+} // end anonymous namespace
+
+/** Convert every entry of a batch manifest in one process, using a
+ *  pool of numberOfThreads workers that each take the next
+ *  unconverted entry.  With shardCount > 1 only this shard's share
+ *  of the manifest is converted; entries recorded in the journal as
+ *  done are skipped.
+ */
+int
+DWIConvertBatch(const std::string &batchManifest,
+                const std::string &batchReport,
+                unsigned int numberOfThreads,
+                unsigned int shardIndex,
+                unsigned int shardCount,
+                const std::string &batchJournal)
+{
+  std::vector<BatchEntry> entries;
+  if(ReadManifest(batchManifest,entries) != EXIT_SUCCESS)
+    {
+    return EXIT_FAILURE;
+    }
+  if(entries.empty())
+    {
+    std::cerr << "No entries in batch manifest "
+              << batchManifest << std::endl;
+    return EXIT_FAILURE;
+    }
+  DWIConvertJournal journal;
+  if(journal.Open(batchJournal) != EXIT_SUCCESS)
+    {
+    return EXIT_FAILURE;
+    }
+  unsigned int alreadyDone;
+  SelectEntries(entries,shardIndex,shardCount,journal,alreadyDone);
+  if(shardCount > 1)
+    {
+    DWIConvertLogInfo() << "Shard " << shardIndex << " of " << shardCount << ": "
+      << entries.size() + alreadyDone << " entries" << std::endl;
+    }
+  if(entries.empty())
+    {
+    DWIConvertLogInfo() << "Nothing left to convert" << std::endl;
+    return EXIT_SUCCESS;
+    }
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  if(numberOfThreads > 0)
+    {
+    threader->SetNumberOfThreads(numberOfThreads);
+    }
+  if(threader->GetNumberOfThreads() > entries.size())
+    {
+    threader->SetNumberOfThreads(entries.size());
+    }
+  // a profile counts the CPU time, peak memory and I/O of the whole
+  // process, so it would count every entry converted alongside its own
+  if(threader->GetNumberOfThreads() > 1 &&
+     AnyEntryHasOption(entries,"--profileReport"))
+    {
+    DWIConvertLogWarning() << "Warning: profile reports cover the whole process, "
+      << "so the batch is converted one entry at a time" << std::endl;
+    threader->SetNumberOfThreads(1);
+    }
+  // the trace is process-wide too: an entry opening or closing it
+  // would race with the spans the other entries record
+  if(threader->GetNumberOfThreads() > 1 &&
+     AnyEntryHasOption(entries,"--traceFile"))
+    {
+    DWIConvertLogWarning() << "Warning: traces cover the whole process, "
+      << "so the batch is converted one entry at a time" << std::endl;
+    threader->SetNumberOfThreads(1);
+    }
+  // and so are the I/O counts, with the same race
+  if(threader->GetNumberOfThreads() > 1 &&
+     AnyEntryHasOption(entries,"--ioReport"))
+    {
+    DWIConvertLogWarning() << "Warning: I/O reports cover the whole process, "
+      << "so the batch is converted one entry at a time" << std::endl;
+    threader->SetNumberOfThreads(1);
+    }
+
+  BatchState state;
+  state.Entries = &entries;
+  state.Journal = &journal;
+  state.NextEntry = 0;
+  state.NumberOfThreads = threader->GetNumberOfThreads();
+  threader->SetSingleMethod(BatchWorker,&state);
+  threader->SingleMethodExecute();
+
+  unsigned int failures = 0;
+  std::ofstream report;
+  if(batchReport != "")
+    {
+    report.open(batchReport.c_str());
+    if(!report.good())
+      {
+      std::cerr << "Can't write batch report " << batchReport << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+  for(unsigned int i = 0; i < entries.size(); ++i)
+    {
+    if(entries[i].Result != EXIT_SUCCESS)
+      {
+      ++failures;
+      }
+    if(report.is_open())
+      {
+      report << (entries[i].Result == EXIT_SUCCESS ? "SUCCESS" : "FAILURE")
+             << "\t" << entries[i].Seconds
+             << "\t" << entries[i].Line << std::endl;
+      }
+    }
+  DWIConvertLogInfo() << entries.size() - failures << " of " << entries.size()
+    << " batch entries converted" << std::endl;
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,6 @@
+#include "DWIConvertLib.h"
+
+int main(int argc, char *argv[])
+{
+  return DWIConvertMain(argc,argv);
+}
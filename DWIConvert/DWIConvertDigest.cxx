@@ -0,0 +1,246 @@
+#include "DWIConvertDigest.h"
+#include <fstream>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include "itkByteSwapper.h"
+
+namespace
+{
+const itk::uint64_t Prime1 = 11400714785074694791ULL;
+const itk::uint64_t Prime2 = 14029467366897019727ULL;
+const itk::uint64_t Prime3 = 1609587929392839161ULL;
+const itk::uint64_t Prime4 = 9650029242287828579ULL;
+const itk::uint64_t Prime5 = 2870177450012600261ULL;
+
+inline itk::uint64_t
+RotateLeft(itk::uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+/** little endian 64 and 32 bit words at p, which needn't be aligned */
+inline itk::uint64_t
+Read64(const unsigned char *p)
+{
+  itk::uint64_t v;
+  memcpy(&v,p,sizeof(v));
+  itk::ByteSwapper<itk::uint64_t>::SwapFromSystemToLittleEndian(&v);
+  return v;
+}
+
+inline itk::uint64_t
+Read32(const unsigned char *p)
+{
+  itk::uint32_t v;
+  memcpy(&v,p,sizeof(v));
+  itk::ByteSwapper<itk::uint32_t>::SwapFromSystemToLittleEndian(&v);
+  return v;
+}
+
+inline itk::uint64_t
+Round(itk::uint64_t acc, itk::uint64_t input)
+{
+  acc += input * Prime2;
+  acc = RotateLeft(acc,31);
+  return acc * Prime1;
+}
+
+inline itk::uint64_t
+MergeRound(itk::uint64_t acc, itk::uint64_t value)
+{
+  acc ^= Round(0,value);
+  return acc * Prime1 + Prime4;
+}
+
+std::string
+Hex(itk::uint64_t digest)
+{
+  std::ostringstream s;
+  s << std::hex << std::setw(16) << std::setfill('0') << digest;
+  return s.str();
+}
+}
+
+itk::uint64_t
+DWIConvertXXH64(const void *data, size_t size)
+{
+  const unsigned char *p = static_cast<const unsigned char *>(data);
+  const unsigned char * const end = p + size;
+  itk::uint64_t h;
+
+  if(size >= 32)
+    {
+    const unsigned char * const limit = end - 32;
+    itk::uint64_t v1 = Prime1 + Prime2;
+    itk::uint64_t v2 = Prime2;
+    itk::uint64_t v3 = 0;
+    itk::uint64_t v4 = 0 - Prime1;
+    do
+      {
+      v1 = Round(v1,Read64(p)); p += 8;
+      v2 = Round(v2,Read64(p)); p += 8;
+      v3 = Round(v3,Read64(p)); p += 8;
+      v4 = Round(v4,Read64(p)); p += 8;
+      } while(p <= limit);
+    h = RotateLeft(v1,1) + RotateLeft(v2,7) +
+      RotateLeft(v3,12) + RotateLeft(v4,18);
+    h = MergeRound(h,v1);
+    h = MergeRound(h,v2);
+    h = MergeRound(h,v3);
+    h = MergeRound(h,v4);
+    }
+  else
+    {
+    h = Prime5;
+    }
+  h += static_cast<itk::uint64_t>(size);
+
+  for(; p + 8 <= end; p += 8)
+    {
+    h ^= Round(0,Read64(p));
+    h = RotateLeft(h,27) * Prime1 + Prime4;
+    }
+  if(p + 4 <= end)
+    {
+    h ^= Read32(p) * Prime1;
+    h = RotateLeft(h,23) * Prime2 + Prime3;
+    p += 4;
+    }
+  for(; p < end; ++p)
+    {
+    h ^= (*p) * Prime5;
+    h = RotateLeft(h,11) * Prime1;
+    }
+
+  h ^= h >> 33;
+  h *= Prime2;
+  h ^= h >> 29;
+  h *= Prime3;
+  h ^= h >> 32;
+  return h;
+}
+
+void
+DWIConvertVolumeDigests
+::AddVolume(const short *voxels, size_t nVoxels)
+{
+  this->m_Digests.push_back(DWIConvertXXH64(voxels,nVoxels * sizeof(short)));
+}
+
+void
+DWIConvertVolumeDigests
+::AddVolumes(const short *voxels, size_t nVoxels, unsigned int nVolumes)
+{
+  if(!itk::ByteSwapper<short>::SystemIsBigEndian())
+    {
+    for(unsigned int i = 0; i < nVolumes; ++i)
+      {
+      this->AddVolume(voxels + i * nVoxels,nVoxels);
+      }
+    return;
+    }
+  // the file holds them little endian
+  std::vector<short> volume(nVoxels);
+  for(unsigned int i = 0; i < nVolumes; ++i)
+    {
+    std::copy(voxels + i * nVoxels,voxels + (i + 1) * nVoxels,volume.begin());
+    itk::ByteSwapper<short>::
+      SwapRangeFromSystemToLittleEndian(&volume[0],nVoxels);
+    this->AddVolume(&volume[0],nVoxels);
+    }
+}
+
+std::string
+DWIConvertDigestFileName(const std::string &outputName)
+{
+  return outputName + ".digest";
+}
+
+/** The sidecar is a line naming the hash, the volume size, and the
+ *  digest of each volume in hex, one per line:
+ *    xxh64
+ *    sizes: <columns> <rows> <slices>
+ *    <digest of volume 0>
+ *    ...
+ */
+int
+DWIConvertVolumeDigests
+::Write(const std::string &outputName) const
+{
+  const std::string sidecarName = DWIConvertDigestFileName(outputName);
+  std::ofstream sidecar(sidecarName.c_str());
+  sidecar << "xxh64" << std::endl
+          << "sizes: " << this->m_VolumeSize[0] << " "
+          << this->m_VolumeSize[1] << " " << this->m_VolumeSize[2] << std::endl;
+  for(unsigned int i = 0; i < this->m_Digests.size(); ++i)
+    {
+    sidecar << Hex(this->m_Digests[i]) << std::endl;
+    }
+  if(!sidecar.good())
+    {
+    std::cerr << "Can't write " << sidecarName << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+
+int
+DWIConvertVolumeDigests
+::Read(const std::string &outputName)
+{
+  const std::string sidecarName = DWIConvertDigestFileName(outputName);
+  std::ifstream sidecar(sidecarName.c_str());
+  std::string hash, sizes;
+  if(!(sidecar >> hash >> sizes >> this->m_VolumeSize[0]
+       >> this->m_VolumeSize[1] >> this->m_VolumeSize[2]) ||
+     hash != "xxh64" || sizes != "sizes:")
+    {
+    std::cerr << "Can't read volume digests from " << sidecarName << std::endl;
+    return EXIT_FAILURE;
+    }
+  this->m_Digests.clear();
+  itk::uint64_t digest;
+  while(sidecar >> std::hex >> digest)
+    {
+    this->m_Digests.push_back(digest);
+    }
+  return EXIT_SUCCESS;
+}
+
+int
+DWIConvertCompareDigests(const std::string &outputName1,
+                         const std::string &outputName2,
+                         std::ostream &report)
+{
+  DWIConvertVolumeDigests first, second;
+  if(first.Read(outputName1) != EXIT_SUCCESS ||
+     second.Read(outputName2) != EXIT_SUCCESS)
+    {
+    return EXIT_FAILURE;
+    }
+  const unsigned int *firstSize = first.GetVolumeSize();
+  const unsigned int *secondSize = second.GetVolumeSize();
+  if(!std::equal(firstSize,firstSize + 3,secondSize) ||
+     first.GetDigests().size() != second.GetDigests().size())
+    {
+    report << "Volume sizes differ: " << firstSize[0] << "x" << firstSize[1]
+           << "x" << firstSize[2] << "x" << first.GetDigests().size()
+           << " and " << secondSize[0] << "x" << secondSize[1]
+           << "x" << secondSize[2] << "x" << second.GetDigests().size()
+           << std::endl;
+    return EXIT_FAILURE;
+    }
+  int rval = EXIT_SUCCESS;
+  for(unsigned int i = 0; i < first.GetDigests().size(); ++i)
+    {
+    if(first.GetDigests()[i] != second.GetDigests()[i])
+      {
+      report << "Volume " << i << " differs" << std::endl;
+      rval = EXIT_FAILURE;
+      }
+    }
+  return rval;
+}
@@ -0,0 +1,59 @@
+#ifndef __DWIConvertDigest_h
+#define __DWIConvertDigest_h
+#include <string>
+#include <vector>
+#include <iostream>
+#include "itkIntTypes.h"
+
+/** 64 bit xxHash (XXH64, seed 0) of size bytes of data */
+itk::uint64_t DWIConvertXXH64(const void *data, size_t size);
+
+/** The digests of the gradient volumes of a converted DWI volume:
+ *  the xxHash of each volume's voxel data as stored in the output,
+ *  i.e. as little endian shorts.  Two outputs with the same digests
+ *  hold the same voxels, without reading either of them.
+ */
+class DWIConvertVolumeDigests
+{
+public:
+  DWIConvertVolumeDigests() { this->SetVolumeSize(0,0,0); }
+
+  /** columns, rows and slices of one volume */
+  void SetVolumeSize(unsigned int columns, unsigned int rows,
+                     unsigned int slices)
+    {
+      this->m_VolumeSize[0] = columns;
+      this->m_VolumeSize[1] = rows;
+      this->m_VolumeSize[2] = slices;
+    }
+  const unsigned int *GetVolumeSize() const { return this->m_VolumeSize; }
+
+  /** digest the next volume; nVoxels little endian voxels */
+  void AddVolume(const short *voxels, size_t nVoxels);
+  /** digest nVolumes volumes of nVoxels voxels each, in host byte
+   *  order, as held in memory before they are written */
+  void AddVolumes(const short *voxels, size_t nVoxels, unsigned int nVolumes);
+
+  const std::vector<itk::uint64_t> &GetDigests() const { return this->m_Digests; }
+
+  /** write the sidecar of outputName; call once all volumes are added */
+  int Write(const std::string &outputName) const;
+  /** read the sidecar of outputName */
+  int Read(const std::string &outputName);
+
+private:
+  unsigned int               m_VolumeSize[3];
+  std::vector<itk::uint64_t> m_Digests;
+};
+
+/** name of the sidecar file holding the volume digests of outputName */
+std::string DWIConvertDigestFileName(const std::string &outputName);
+
+/** Compare the digest sidecars of two outputs, reporting the volumes
+ *  that differ to report; EXIT_SUCCESS if the voxels are the same.
+ */
+int DWIConvertCompareDigests(const std::string &outputName1,
+                             const std::string &outputName2,
+                             std::ostream &report);
+
+#endif // __DWIConvertDigest_h
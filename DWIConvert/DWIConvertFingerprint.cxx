@@ -0,0 +1,238 @@
+#include "DWIConvertFingerprint.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <algorithm>
+#include "itksys/Directory.hxx"
+#include "itksys/SystemTools.hxx"
+#include "itkIntTypes.h"
+
+#ifndef DWIConvert_VERSION
+#define DWIConvert_VERSION "unknown"
+#endif
+
+namespace
+{
+/** 64 bit FNV-1a; not cryptographic, but enough to tell whether
+ *  anything went into the conversion differently */
+class FingerprintHash
+{
+public:
+  FingerprintHash() : m_Hash(14695981039346656037ULL) {}
+
+  void Add(const std::string &s)
+    {
+      // the terminating 0 keeps "ab","c" apart from "a","bc"
+      for(size_t i = 0; i <= s.size(); ++i)
+        {
+        this->m_Hash ^= static_cast<unsigned char>(s.c_str()[i]);
+        this->m_Hash *= 1099511628211ULL;
+        }
+    }
+
+  template <typename T>
+  void Add(const T &value)
+    {
+      std::ostringstream s;
+      s << value;
+      this->Add(s.str());
+    }
+
+  std::string Hex() const
+    {
+      std::ostringstream s;
+      s << std::hex << std::setw(16) << std::setfill('0') << this->m_Hash;
+      return s.str();
+    }
+
+private:
+  itk::uint64_t m_Hash;
+};
+
+/** options that change how a conversion runs or what it reports,
+ *  but not its outputs */
+const char *NeutralOptions[] =
+  {
+    "--numberOfThreads",
+    "--logLevel",
+    "--logFormat",
+    "--traceFile",
+    "--profileReport",
+    "--ioReport",
+    "--batchJournal",
+    "--shardIndex",
+    "--shardCount",
+    "--watchSettleTime",
+    "--watchIdleExit",
+    "--storageSCPTimeout",
+    0
+  };
+
+/** options naming a file the conversion reads, whose contents can
+ *  change without its name changing */
+const char *InputFileOptions[] =
+  {
+    "--gradientVectorFile",
+    "--inputDicomFileList",
+    0
+  };
+
+/** the file named by an input file option, given as "--option value"
+ *  or "--option=value", or "" if arg isn't one; sets hasValue for the
+ *  first spelling */
+std::string
+InputFileOption(const std::string &arg, const char *next, bool &hasValue)
+{
+  for(unsigned int i = 0; InputFileOptions[i] != 0; ++i)
+    {
+    const std::string option(InputFileOptions[i]);
+    if(arg == option && next != 0)
+      {
+      hasValue = true;
+      return next;
+      }
+    if(arg.compare(0,option.size() + 1,option + "=") == 0)
+      {
+      hasValue = false;
+      return arg.substr(option.size() + 1);
+      }
+    }
+  return "";
+}
+
+/** whether arg is a neutral option, given as "--option value" or
+ *  "--option=value"; sets hasValue for the first spelling */
+bool
+IsNeutralOption(const std::string &arg, bool &hasValue)
+{
+  if(arg == "--skipUnchanged")
+    {
+    hasValue = false;
+    return true;
+    }
+  for(unsigned int i = 0; NeutralOptions[i] != 0; ++i)
+    {
+    const std::string option(NeutralOptions[i]);
+    if(arg == option)
+      {
+      hasValue = true;
+      return true;
+      }
+    if(arg.compare(0,option.size() + 1,option + "=") == 0)
+      {
+      hasValue = false;
+      return true;
+      }
+    }
+  return false;
+}
+}
+
+std::string
+DWIConvertFingerprint(int argc, char *argv[],
+                      const std::vector<std::string> &inputFileNames)
+{
+  FingerprintHash hash;
+  hash.Add(std::string(DWIConvert_VERSION));
+  // only the options that can change the outputs, not argv[0]
+  for(int i = 1; i < argc; ++i)
+    {
+    const std::string arg(argv[i]);
+    bool hasValue(false);
+    if(IsNeutralOption(arg,hasValue))
+      {
+      if(hasValue)
+        {
+        ++i;
+        }
+      continue;
+      }
+    hash.Add(arg);
+    // and what the file named by an input file option holds, unless
+    // it is standard input
+    const std::string inputFile =
+      InputFileOption(arg,i + 1 < argc ? argv[i + 1] : 0,hasValue);
+    if(inputFile != "")
+      {
+      if(hasValue)
+        {
+        hash.Add(inputFile);
+        ++i;
+        }
+      if(inputFile != "-")
+        {
+        hash.Add(itksys::SystemTools::FileLength(inputFile.c_str()));
+        hash.Add(itksys::SystemTools::ModifiedTime(inputFile.c_str()));
+        }
+      }
+    }
+  hash.Add(inputFileNames.size());
+  for(unsigned int i = 0; i < inputFileNames.size(); ++i)
+    {
+    const char *fileName = inputFileNames[i].c_str();
+    hash.Add(inputFileNames[i]);
+    hash.Add(itksys::SystemTools::FileLength(fileName));
+    hash.Add(itksys::SystemTools::ModifiedTime(fileName));
+    }
+  return hash.Hex();
+}
+
+void
+DWIConvertListDirectory(const std::string &directoryName,
+                        std::vector<std::string> &fileNames)
+{
+  fileNames.clear();
+  itksys::Directory directory;
+  directory.Load(directoryName.c_str());
+  for(unsigned long i = 0; i < directory.GetNumberOfFiles(); ++i)
+    {
+    const std::string name = directory.GetFile(i);
+    if(name == "." || name == "..")
+      {
+      continue;
+      }
+    const std::string path = directoryName + "/" + name;
+    if(!itksys::SystemTools::FileIsDirectory(path.c_str()))
+      {
+      fileNames.push_back(path);
+      }
+    }
+  // the listing order isn't the same from one run to the next
+  std::sort(fileNames.begin(),fileNames.end());
+}
+
+std::string
+DWIConvertFingerprintFileName(const std::string &outputName)
+{
+  return outputName + ".fingerprint";
+}
+
+bool
+DWIConvertFingerprintMatches(const std::string &outputName,
+                             const std::string &fingerprint)
+{
+  if(!itksys::SystemTools::FileExists(outputName.c_str()))
+    {
+    return false;
+    }
+  std::ifstream sidecar(DWIConvertFingerprintFileName(outputName).c_str());
+  std::string line;
+  return std::getline(sidecar,line) && line == fingerprint;
+}
+
+int
+DWIConvertWriteFingerprint(const std::string &outputName,
+                           const std::string &fingerprint)
+{
+  const std::string sidecarName = DWIConvertFingerprintFileName(outputName);
+  std::ofstream sidecar(sidecarName.c_str());
+  sidecar << fingerprint << std::endl;
+  if(!sidecar.good())
+    {
+    std::cerr << "Can't write " << sidecarName << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
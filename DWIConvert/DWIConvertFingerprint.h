@@ -0,0 +1,38 @@
+#ifndef __DWIConvertFingerprint_h
+#define __DWIConvertFingerprint_h
+#include <string>
+#include <vector>
+
+/** Fingerprint of a conversion: the converter version, the command
+ *  line arguments that can change the outputs, and the path, size and
+ *  modification time of each input file, and of the files named by
+ *  gradientVectorFile and inputDicomFileList.  If it hasn't changed since
+ *  the outputs were written, converting again would write the same
+ *  outputs.  Options such as numberOfThreads, logLevel or
+ *  profileReport, in either the "--option value" or the
+ *  "--option=value" spelling, are left out.
+ */
+std::string DWIConvertFingerprint(int argc, char *argv[],
+                                  const std::vector<std::string> &inputFileNames);
+
+/** The files directly in a directory, sorted, without opening any:
+ *  the input files to fingerprint for a directory that hasn't been
+ *  scanned yet.  Any file added, removed or changed changes the
+ *  fingerprint, DICOM or not.
+ */
+void DWIConvertListDirectory(const std::string &directoryName,
+                             std::vector<std::string> &fileNames);
+
+/** name of the sidecar file holding the fingerprint of outputName */
+std::string DWIConvertFingerprintFileName(const std::string &outputName);
+
+/** does the sidecar of outputName hold this fingerprint */
+bool DWIConvertFingerprintMatches(const std::string &outputName,
+                                  const std::string &fingerprint);
+
+/** write the sidecar of outputName; call only once all outputs are
+ *  written, so that an interrupted conversion is never skipped */
+int DWIConvertWriteFingerprint(const std::string &outputName,
+                               const std::string &fingerprint);
+
+#endif // __DWIConvertFingerprint_h
@@ -0,0 +1,181 @@
+#include "DWIConvertIOAccounting.h"
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include "itksys/SystemTools.hxx"
+#include "itkSimpleFastMutexLock.h"
+
+namespace
+{
+itk::SimpleFastMutexLock           AccountingLock;
+// only changed by Start and Stop, while no conversion runs
+bool                               AccountingStarted(false);
+DWIConvertIOAccounting::CountsMap  AccountingCounts;
+
+/** bytes read by the calling thread so far; false if the platform
+ *  doesn't count them */
+bool
+ThreadBytesRead(itk::uint64_t &bytesRead)
+{
+#if defined(__linux__)
+  std::ifstream io("/proc/thread-self/io");
+  std::string key;
+  itk::uint64_t value;
+  while(io >> key >> value)
+    {
+    if(key == "rchar:")
+      {
+      bytesRead = value;
+      return true;
+      }
+    }
+#endif
+  (void)bytesRead;
+  return false;
+}
+}
+
+bool
+DWIConvertIOAccounting
+::Start()
+{
+  if(AccountingStarted)
+    {
+    return false;
+    }
+  AccountingCounts.clear();
+  AccountingStarted = true;
+  return true;
+}
+
+void
+DWIConvertIOAccounting
+::Stop()
+{
+  AccountingStarted = false;
+}
+
+bool
+DWIConvertIOAccounting
+::IsStarted()
+{
+  return AccountingStarted;
+}
+
+void
+DWIConvertIOAccounting
+::Record(const std::string &fileName, AccessType type,
+         itk::uint64_t bytesRead)
+{
+  if(!AccountingStarted)
+    {
+    return;
+    }
+  AccountingLock.Lock();
+  Counts &counts = AccountingCounts[fileName];
+  ++counts.Opens;
+  counts.BytesRead += bytesRead;
+  if(type == HeaderParse)
+    {
+    ++counts.HeaderParses;
+    }
+  else
+    {
+    ++counts.PixelDecodes;
+    }
+  AccountingLock.Unlock();
+}
+
+DWIConvertIOAccounting::CountsMap
+DWIConvertIOAccounting
+::GetCounts()
+{
+  AccountingLock.Lock();
+  const CountsMap counts(AccountingCounts);
+  AccountingLock.Unlock();
+  return counts;
+}
+
+DWIConvertIOAccounting::Counts
+DWIConvertIOAccounting
+::GetTotals()
+{
+  const CountsMap counts = GetCounts();
+  Counts totals;
+  for(CountsMap::const_iterator it = counts.begin(); it != counts.end(); ++it)
+    {
+    totals.Opens += it->second.Opens;
+    totals.BytesRead += it->second.BytesRead;
+    totals.HeaderParses += it->second.HeaderParses;
+    totals.PixelDecodes += it->second.PixelDecodes;
+    }
+  return totals;
+}
+
+int
+DWIConvertIOAccounting
+::WriteReport(const std::string &reportName)
+{
+  std::ofstream reportFile;
+  if(reportName != "-")
+    {
+    reportFile.open(reportName.c_str());
+    }
+  std::ostream &report = reportName == "-" ? std::cout : reportFile;
+
+  const CountsMap counts = GetCounts();
+  const Counts totals = GetTotals();
+  report << "file\topens\tbytesRead\theaderParses\tpixelDecodes" << std::endl;
+  for(CountsMap::const_iterator it = counts.begin(); it != counts.end(); ++it)
+    {
+    report << it->first << "\t" << it->second.Opens
+           << "\t" << it->second.BytesRead
+           << "\t" << it->second.HeaderParses
+           << "\t" << it->second.PixelDecodes << std::endl;
+    }
+  report << "total(" << counts.size() << " files)\t" << totals.Opens
+         << "\t" << totals.BytesRead
+         << "\t" << totals.HeaderParses
+         << "\t" << totals.PixelDecodes << std::endl;
+  if(!report.good())
+    {
+    std::cerr << "Can't write I/O report " << reportName << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+
+DWIConvertIOAccess
+::DWIConvertIOAccess(const std::string &fileName,
+                     DWIConvertIOAccounting::AccessType type) :
+  m_Type(type),
+  m_StartBytes(0),
+  m_Enabled(DWIConvertIOAccounting::IsStarted())
+{
+  if(this->m_Enabled)
+    {
+    this->m_FileName = fileName;
+    // last, so that only reading the counter itself, a few hundred
+    // bytes, is counted along with the file
+    ThreadBytesRead(this->m_StartBytes);
+    }
+}
+
+DWIConvertIOAccess
+::~DWIConvertIOAccess()
+{
+  if(!this->m_Enabled)
+    {
+    return;
+    }
+  itk::uint64_t bytesRead;
+  if(ThreadBytesRead(bytesRead) && bytesRead >= this->m_StartBytes)
+    {
+    bytesRead -= this->m_StartBytes;
+    }
+  else
+    {
+    bytesRead = itksys::SystemTools::FileLength(this->m_FileName.c_str());
+    }
+  DWIConvertIOAccounting::Record(this->m_FileName,this->m_Type,bytesRead);
+}
@@ -0,0 +1,98 @@
+#ifndef __DWIConvertIOAccounting_h
+#define __DWIConvertIOAccounting_h
+#include <string>
+#include <map>
+#include "itkIntTypes.h"
+
+/** \class DWIConvertIOAccounting
+ *  Counts, for each input file, how many times it is opened, how many
+ *  bytes are read from it, and how many of those opens parse its
+ *  header or decode its pixel data, so that redundant reads of the
+ *  same slice show up and stay fixed.  Nothing is counted until
+ *  Start is called.
+ */
+class DWIConvertIOAccounting
+{
+public:
+  enum AccessType { HeaderParse, PixelDecode };
+
+  struct Counts
+  {
+    Counts() : Opens(0), BytesRead(0), HeaderParses(0), PixelDecodes(0) {}
+    unsigned int  Opens;
+    itk::uint64_t BytesRead;
+    unsigned int  HeaderParses;
+    unsigned int  PixelDecodes;
+  };
+  /** map from file name to its counts */
+  typedef std::map<std::string,Counts> CountsMap;
+
+  /** clear the counts and start counting; returns false if counting
+   *  has already started.  Start and Stop must not be called while
+   *  conversions run. */
+  static bool Start();
+  static void Stop();
+  static bool IsStarted();
+
+  static void Record(const std::string &fileName, AccessType type,
+                     itk::uint64_t bytesRead);
+
+  static CountsMap GetCounts();
+  /** the counts of all files added up */
+  static Counts GetTotals();
+
+  /** write the counts of each file and the totals as tab-separated
+   *  text; "-" writes to standard output */
+  static int WriteReport(const std::string &reportName);
+};
+
+/** \class DWIConvertIOAccess
+ *  Counts one open of a file.  The bytes read are those the calling
+ *  thread reads while the access is in scope, on Linux; elsewhere,
+ *  and where the per-thread counters aren't available, they're taken
+ *  to be the size of the file.
+ */
+class DWIConvertIOAccess
+{
+public:
+  DWIConvertIOAccess(const std::string &fileName,
+                     DWIConvertIOAccounting::AccessType type);
+  ~DWIConvertIOAccess();
+
+private:
+  DWIConvertIOAccess(const DWIConvertIOAccess &); // not implemented
+  void operator=(const DWIConvertIOAccess &); // not implemented
+
+  std::string                        m_FileName;
+  DWIConvertIOAccounting::AccessType m_Type;
+  itk::uint64_t                      m_StartBytes;
+  bool                               m_Enabled;
+};
+
+/** \class DWIConvertIOReportFile
+ *  Counts for the duration of a scope and then writes the report,
+ *  unless the name is empty or counting has already started.
+ */
+class DWIConvertIOReportFile
+{
+public:
+  explicit DWIConvertIOReportFile(const std::string &reportName) :
+    m_ReportName(reportName),
+    m_Started(reportName != "" && DWIConvertIOAccounting::Start()) {}
+  ~DWIConvertIOReportFile()
+    {
+      if(this->m_Started)
+        {
+        DWIConvertIOAccounting::WriteReport(this->m_ReportName);
+        DWIConvertIOAccounting::Stop();
+        }
+    }
+private:
+  DWIConvertIOReportFile(const DWIConvertIOReportFile &); // not implemented
+  void operator=(const DWIConvertIOReportFile &); // not implemented
+
+  const std::string m_ReportName;
+  const bool        m_Started;
+};
+
+#endif // __DWIConvertIOAccounting_h
@@ -0,0 +1,59 @@
+#ifndef __DWIConvertLib_h
+#define __DWIConvertLib_h
+#include <string>
+#include <vector>
+#include "itkVectorImage.h"
+#include "itkMatrix.h"
+#include "itkDCMTKSeriesFileNames.h"
+
+/** A DWI series converted in memory. */
+struct DWIConvertResult
+{
+  typedef itk::VectorImage<short,3> ImageType;
+
+  /** one component per diffusion volume; the metadata dictionary
+   *  holds the same keys as a DWI NRRD file read with ITK */
+  ImageType::Pointer                 Image;
+  /** the gradient of each component, scaled by sqrt(b/BValue) as in
+   *  the NRRD header */
+  std::vector< std::vector<double> > Gradients;
+  /** the b-value of each component */
+  std::vector<double>                BValues;
+  /** the nominal, i.e. largest, b-value */
+  double                             BValue;
+  /** the frame the gradients are given in */
+  itk::Matrix<double,3,3>            MeasurementFrame;
+};
+
+/** Convert the files of one DICOM DWI series into result, without
+ *  writing any file.  options are DWIConvert command line options,
+ *  e.g. "--useIdentityMeaseurementFrame"; the output options are
+ *  ignored, and so are logLevel and logFormat, as the log is shared
+ *  by every thread: open it with DWIConvertLog::Open beforehand.
+ */
+int DWIConvertToImage(const std::vector<std::string> &fileNames,
+                      const std::vector<std::string> &options,
+                      DWIConvertResult &result);
+
+/** Convert a series found by itk::DCMTKSeriesFileNames::GetSeriesCatalog */
+int DWIConvertToImage(const itk::DCMTKSeriesFileNames::SeriesInfo &series,
+                      const std::vector<std::string> &options,
+                      DWIConvertResult &result);
+
+/** Run DWIConvert as if from the command line. */
+int DWIConvertMain(int argc, char *argv[]);
+
+/** Register the DICOM codecs and dictionary entries DWIConvert needs.
+ *  The conversion functions do this themselves; a program only needs
+ *  it to read DICOM files with DCMTKSeriesFileNames beforehand.
+ *  Calls are counted, and each needs a matching DWIConvertCleanup.
+ *
+ *  All of these functions are thread-safe: a program may run several
+ *  conversions at once, one per thread.
+ */
+void DWIConvertInitialize();
+
+/** Release a DWIConvertInitialize. */
+void DWIConvertCleanup();
+
+#endif // __DWIConvertLib_h
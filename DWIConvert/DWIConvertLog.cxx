@@ -0,0 +1,169 @@
+#include "DWIConvertLog.h"
+#include "DWIConvertProfile.h"
+#include <iostream>
+#include <iomanip>
+#include "itksys/SystemTools.hxx"
+#include "itkSimpleFastMutexLock.h"
+
+namespace
+{
+// write the buffer out once it holds this much
+const std::string::size_type LogBlockSize = 64 * 1024;
+
+itk::SimpleFastMutexLock LogLock;
+// only changed by Open and Close, with LogLock held, while no
+// conversion runs
+bool                     LogOpen(false);
+DWIConvertLog::Level     LogLevel(DWIConvertLog::Info);
+bool                     LogJSON(false);
+double                   LogOrigin(itksys::SystemTools::GetTime());
+std::string              LogBuffer;
+
+const char *
+LevelName(DWIConvertLog::Level level)
+{
+  switch(level)
+    {
+    case DWIConvertLog::Error:
+      return "error";
+    case DWIConvertLog::Warning:
+      return "warning";
+    case DWIConvertLog::Info:
+      return "info";
+    default:
+      return "debug";
+    }
+}
+
+/** call with LogLock held */
+void
+FlushBuffer()
+{
+  if(!LogBuffer.empty())
+    {
+    std::cout.write(LogBuffer.data(),LogBuffer.size());
+    std::cout.flush();
+    LogBuffer.clear();
+    }
+}
+
+/** writes what is left when the program ends, for programs that never
+ *  open the log */
+class LogFlusher
+{
+public:
+  ~LogFlusher() { DWIConvertLog::Flush(); }
+};
+LogFlusher Flusher;
+}
+
+bool
+DWIConvertLog
+::IsValid(const std::string &levelName, const std::string &format)
+{
+  return (levelName == "quiet" || levelName == "info" ||
+          levelName == "debug") &&
+    (format == "text" || format == "json");
+}
+
+bool
+DWIConvertLog
+::Open(const std::string &levelName, const std::string &format)
+{
+  if(!IsValid(levelName,format))
+    {
+    return false;
+    }
+  LogLock.Lock();
+  const bool opened = !LogOpen;
+  if(opened)
+    {
+    FlushBuffer();
+    LogLevel = levelName == "quiet" ? Warning :
+      (levelName == "debug" ? Debug : Info);
+    LogJSON = format == "json";
+    LogOrigin = itksys::SystemTools::GetTime();
+    LogOpen = true;
+    }
+  LogLock.Unlock();
+  return opened;
+}
+
+void
+DWIConvertLog
+::Close()
+{
+  LogLock.Lock();
+  FlushBuffer();
+  LogOpen = false;
+  LogLevel = Info;
+  LogJSON = false;
+  LogLock.Unlock();
+}
+
+bool
+DWIConvertLog
+::IsOpen()
+{
+  return LogOpen;
+}
+
+bool
+DWIConvertLog
+::IsEnabled(Level level)
+{
+  return level <= LogLevel;
+}
+
+void
+DWIConvertLog
+::Write(Level level, const std::string &text)
+{
+  if(!IsEnabled(level) || text.empty())
+    {
+    return;
+    }
+  std::string record;
+  if(LogJSON)
+    {
+    // one object per message, without the newline that ends it
+    std::string message(text);
+    if(message[message.size() - 1] == '\n')
+      {
+      message.erase(message.size() - 1);
+      }
+    std::ostringstream line;
+    line << "{\"time\":" << std::fixed << std::setprecision(6)
+         << itksys::SystemTools::GetTime() - LogOrigin
+         << ",\"level\":\"" << LevelName(level) << "\""
+         << ",\"message\":" << DWIConvertJSONString(message) << "}\n";
+    record = line.str();
+    }
+  const std::string &output = LogJSON ? record : text;
+  LogLock.Lock();
+  if(level == Error)
+    {
+    // after what came before it
+    FlushBuffer();
+    std::cerr.write(output.data(),output.size());
+    std::cerr.flush();
+    }
+  else
+    {
+    LogBuffer += output;
+    if(level == Warning || LogBuffer.size() >= LogBlockSize)
+      {
+      FlushBuffer();
+      }
+    }
+  LogLock.Unlock();
+}
+
+void
+DWIConvertLog
+::Flush()
+{
+  LogLock.Lock();
+  FlushBuffer();
+  LogLock.Unlock();
+}
@@ -0,0 +1,130 @@
+#ifndef __DWIConvertLog_h
+#define __DWIConvertLog_h
+#include <string>
+#include <sstream>
+#include <ostream>
+
+/** \class DWIConvertLog
+ *  Process-wide sink for the messages a conversion prints: what it
+ *  found in the headers, the gradients of each volume, warnings and
+ *  errors.  Messages are collected in a buffer and written to standard
+ *  output in large blocks, rather than flushed line by line; warnings
+ *  flush the buffer, so they appear when they happen, and errors go
+ *  to standard error.
+ *
+ *  The level chosen with Open decides which messages are kept: quiet
+ *  keeps only warnings and errors, info adds a summary of each series,
+ *  debug adds the per-slice and per-gradient detail.  In json format
+ *  each message is written as one JSON object on a line of its own.
+ *  Until Open is called, messages up to info are written as text.
+ */
+class DWIConvertLog
+{
+public:
+  /** message levels, most important first */
+  enum Level { Error, Warning, Info, Debug };
+
+  /** whether levelName is quiet, info or debug and format is text
+   *  or json */
+  static bool IsValid(const std::string &levelName, const std::string &format);
+  /** set the level and format; returns false, leaving things as they
+   *  are, if the log is already open or the names aren't valid.  Open
+   *  and Close are serialized, but must not be called while
+   *  conversions run, as those read the level without a lock; only
+   *  DWIConvertMain opens the log. */
+  static bool Open(const std::string &levelName, const std::string &format);
+  /** flush, and go back to the defaults */
+  static void Close();
+  static bool IsOpen();
+
+  /** whether messages of level are kept */
+  static bool IsEnabled(Level level);
+  /** add a message; text is written as is, so it ends in a newline
+   *  unless the next message continues the line */
+  static void Write(Level level, const std::string &text);
+  /** write out what is buffered */
+  static void Flush();
+};
+
+/** \class DWIConvertLogMessage
+ *  Collects one message, written to the log when it is destroyed:
+ *    DWIConvertLogDebug() << "B-value: " << b << std::endl;
+ *  Nothing is formatted if the log doesn't keep messages of its level.
+ */
+class DWIConvertLogMessage
+{
+public:
+  explicit DWIConvertLogMessage(DWIConvertLog::Level level) :
+    m_Level(level),
+    m_Enabled(DWIConvertLog::IsEnabled(level)) {}
+  ~DWIConvertLogMessage()
+    {
+      if(this->m_Enabled)
+        {
+        DWIConvertLog::Write(this->m_Level,this->m_Stream.str());
+        }
+    }
+
+  template <class T>
+  DWIConvertLogMessage &operator<<(const T &value)
+    {
+      if(this->m_Enabled)
+        {
+        this->m_Stream << value;
+        }
+      return *this;
+    }
+  /** std::endl and the other manipulators */
+  DWIConvertLogMessage &operator<<(std::ostream &(*manipulator)(std::ostream &))
+    {
+      if(this->m_Enabled)
+        {
+        this->m_Stream << manipulator;
+        }
+      return *this;
+    }
+
+private:
+  DWIConvertLogMessage(const DWIConvertLogMessage &); // not implemented
+  void operator=(const DWIConvertLogMessage &); // not implemented
+
+  const DWIConvertLog::Level m_Level;
+  const bool                 m_Enabled;
+  std::ostringstream         m_Stream;
+};
+
+/** a message of each level */
+#define DWIConvertLogError()   DWIConvertLogMessage(DWIConvertLog::Error)
+#define DWIConvertLogWarning() DWIConvertLogMessage(DWIConvertLog::Warning)
+#define DWIConvertLogInfo()    DWIConvertLogMessage(DWIConvertLog::Info)
+#define DWIConvertLogDebug()   DWIConvertLogMessage(DWIConvertLog::Debug)
+
+/** \class DWIConvertLogScope
+ *  Opens the log for the duration of a scope, if open is true and it
+ *  isn't already open, and flushes it at the end.
+ */
+class DWIConvertLogScope
+{
+public:
+  DWIConvertLogScope(const std::string &levelName, const std::string &format,
+                     bool open) :
+    m_Opened(open && DWIConvertLog::Open(levelName,format)) {}
+  ~DWIConvertLogScope()
+    {
+      if(this->m_Opened)
+        {
+        DWIConvertLog::Close();
+        }
+      else
+        {
+        DWIConvertLog::Flush();
+        }
+    }
+private:
+  DWIConvertLogScope(const DWIConvertLogScope &); // not implemented
+  void operator=(const DWIConvertLogScope &); // not implemented
+
+  const bool m_Opened;
+};
+
+#endif // __DWIConvertLog_h
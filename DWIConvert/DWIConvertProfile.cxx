@@ -0,0 +1,258 @@
+#include "DWIConvertProfile.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include "itksys/SystemTools.hxx"
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+#ifndef DWIConvert_VERSION
+#define DWIConvert_VERSION "unknown"
+#endif
+
+std::string
+DWIConvertJSONString(const std::string &s)
+{
+  std::string rval("\"");
+  for(unsigned int i = 0; i < s.size(); ++i)
+    {
+    const unsigned char c = s[i];
+    if(c == '"' || c == '\\')
+      {
+      rval += '\\';
+      rval += c;
+      }
+    else if(c < 0x20)
+      {
+      char escape[8];
+      sprintf(escape,"\\u%04x",c);
+      rval += escape;
+      }
+    else
+      {
+      rval += c;
+      }
+    }
+  rval += '"';
+  return rval;
+}
+
+namespace
+{
+#if defined(_WIN32)
+double
+FileTimeSeconds(const FILETIME &t)
+{
+  ULARGE_INTEGER ticks;
+  ticks.LowPart = t.dwLowDateTime;
+  ticks.HighPart = t.dwHighDateTime;
+  // 100ns ticks
+  return static_cast<double>(ticks.QuadPart) * 1.0e-7;
+}
+#endif
+}
+
+DWIConvertProfile
+::DWIConvertProfile(const std::string &reportName) :
+  m_ReportName(reportName),
+  m_Current(-1)
+{
+  if(this->m_ReportName != "")
+    {
+    this->m_Start = Now();
+    }
+}
+
+DWIConvertProfile
+::~DWIConvertProfile()
+{
+  if(this->m_ReportName == "")
+    {
+    return;
+    }
+  this->End();
+  this->Write();
+}
+
+DWIConvertProfile::Sample
+DWIConvertProfile
+::Now()
+{
+  Sample sample;
+  sample.WallTime = itksys::SystemTools::GetTime();
+#if defined(_WIN32)
+  FILETIME creation, exit, kernel, user;
+  if(GetProcessTimes(GetCurrentProcess(),&creation,&exit,&kernel,&user))
+    {
+    sample.CPUTime = FileTimeSeconds(kernel) + FileTimeSeconds(user);
+    }
+  PROCESS_MEMORY_COUNTERS memory;
+  if(GetProcessMemoryInfo(GetCurrentProcess(),&memory,sizeof(memory)))
+    {
+    sample.PeakRSS = memory.PeakWorkingSetSize;
+    }
+  IO_COUNTERS io;
+  if(GetProcessIoCounters(GetCurrentProcess(),&io))
+    {
+    sample.BytesRead = io.ReadTransferCount;
+    sample.BytesWritten = io.WriteTransferCount;
+    }
+#else
+  // all threads of the process
+  struct rusage usage;
+  if(getrusage(RUSAGE_SELF,&usage) == 0)
+    {
+    sample.CPUTime =
+      usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1.0e-6 +
+      usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1.0e-6;
+#if defined(__APPLE__)
+    sample.PeakRSS = usage.ru_maxrss;
+#else
+    // kilobytes
+    sample.PeakRSS = static_cast<itk::uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+    }
+#if defined(__linux__)
+  // bytes passed through read and write calls, whether or not they
+  // reached the disk
+  std::ifstream io("/proc/self/io");
+  std::string key;
+  itk::uint64_t value;
+  while(io >> key >> value)
+    {
+    if(key == "rchar:")
+      {
+      sample.BytesRead = value;
+      }
+    else if(key == "wchar:")
+      {
+      sample.BytesWritten = value;
+      }
+    }
+#endif
+#endif
+  return sample;
+}
+
+void
+DWIConvertProfile
+::Phase(const char *name)
+{
+  if(this->m_ReportName == "")
+    {
+    return;
+    }
+  this->End();
+  int index = -1;
+  for(unsigned int i = 0; i < this->m_Phases.size(); ++i)
+    {
+    if(this->m_Phases[i].Name == name)
+      {
+      index = i;
+      break;
+      }
+    }
+  if(index < 0)
+    {
+    PhaseTotals totals;
+    totals.Name = name;
+    this->m_Phases.push_back(totals);
+    index = this->m_Phases.size() - 1;
+    }
+  this->m_Current = index;
+  this->m_PhaseStart = Now();
+}
+
+void
+DWIConvertProfile
+::End()
+{
+  if(this->m_Current < 0)
+    {
+    return;
+    }
+  const Sample now = Now();
+  PhaseTotals &totals = this->m_Phases[this->m_Current];
+  ++totals.Calls;
+  totals.WallTime += now.WallTime - this->m_PhaseStart.WallTime;
+  totals.CPUTime += now.CPUTime - this->m_PhaseStart.CPUTime;
+  if(now.PeakRSS > this->m_PhaseStart.PeakRSS)
+    {
+    totals.PeakRSSGrowth += now.PeakRSS - this->m_PhaseStart.PeakRSS;
+    }
+  totals.BytesRead += now.BytesRead - this->m_PhaseStart.BytesRead;
+  totals.BytesWritten += now.BytesWritten - this->m_PhaseStart.BytesWritten;
+  this->m_Current = -1;
+}
+
+void
+DWIConvertProfile
+::SetInfo(const std::string &key, const std::string &value)
+{
+  this->m_Info.push_back(std::make_pair(key,DWIConvertJSONString(value)));
+}
+
+void
+DWIConvertProfile
+::SetFlag(const std::string &key, bool value)
+{
+  this->m_Info.push_back(std::make_pair(key,std::string(value ? "true" : "false")));
+}
+
+void
+DWIConvertProfile
+::SetCount(const std::string &key, long value)
+{
+  std::ostringstream s;
+  s << value;
+  this->m_Info.push_back(std::make_pair(key,s.str()));
+}
+
+void
+DWIConvertProfile
+::Write() const
+{
+  const Sample now = Now();
+  std::ofstream report(this->m_ReportName.c_str());
+  report << "{" << std::endl
+         << "  \"version\": " << DWIConvertJSONString(DWIConvert_VERSION) << "," << std::endl
+         << "  \"wallTime\": " << now.WallTime - this->m_Start.WallTime << "," << std::endl
+         << "  \"cpuTime\": " << now.CPUTime - this->m_Start.CPUTime << "," << std::endl
+         << "  \"peakRSS\": " << now.PeakRSS << "," << std::endl
+         << "  \"bytesRead\": " << now.BytesRead - this->m_Start.BytesRead << "," << std::endl
+         << "  \"bytesWritten\": " << now.BytesWritten - this->m_Start.BytesWritten
+         << "," << std::endl;
+  report << "  \"path\": {";
+  for(unsigned int i = 0; i < this->m_Info.size(); ++i)
+    {
+    report << (i == 0 ? "" : ",") << std::endl
+           << "    " << DWIConvertJSONString(this->m_Info[i].first)
+           << ": " << this->m_Info[i].second;
+    }
+  report << std::endl << "  }," << std::endl;
+  report << "  \"phases\": [";
+  for(unsigned int i = 0; i < this->m_Phases.size(); ++i)
+    {
+    const PhaseTotals &totals = this->m_Phases[i];
+    report << (i == 0 ? "" : ",") << std::endl
+           << "    { \"name\": " << DWIConvertJSONString(totals.Name)
+           << ", \"calls\": " << totals.Calls
+           << ", \"wallTime\": " << totals.WallTime
+           << ", \"cpuTime\": " << totals.CPUTime
+           << ", \"peakRSSGrowth\": " << totals.PeakRSSGrowth
+           << ", \"bytesRead\": " << totals.BytesRead
+           << ", \"bytesWritten\": " << totals.BytesWritten << " }";
+    }
+  report << std::endl << "  ]" << std::endl << "}" << std::endl;
+  if(!report.good())
+    {
+    std::cerr << "Can't write profile report " << this->m_ReportName << std::endl;
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef __DWIConvertProfile_h
+#define __DWIConvertProfile_h
+#include <string>
+#include <vector>
+#include "itkIntTypes.h"
+
+/** \class DWIConvertProfile
+ *  Measures the phases of one conversion -- wall time, CPU time,
+ *  growth of the peak resident size, and bytes read and written --
+ *  and writes them, with a description of the path the conversion
+ *  took, as a JSON report.  Entering a phase ends the current one;
+ *  the time spent in a phase entered more than once is summed.
+ *  Constructed with an empty report name, it does nothing.
+ *
+ *  CPU time, peak resident size and bytes read and written are the
+ *  counters of the whole process, so that they include the threads a
+ *  conversion starts; they are only meaningful while no other
+ *  conversion runs in the process, which is why a batch with profiled
+ *  entries runs one entry at a time.  The peak resident size never
+ *  decreases, so a phase reports how much it raised the peak, which is
+ *  0 for a phase that stays below an earlier one's.
+ */
+class DWIConvertProfile
+{
+public:
+  explicit DWIConvertProfile(const std::string &reportName);
+  /** ends the current phase and writes the report */
+  ~DWIConvertProfile();
+
+  /** end the current phase, if any, and start phase name */
+  void Phase(const char *name);
+  /** end the current phase */
+  void End();
+
+  /** describe the conversion path, e.g. the vendor, or whether the
+   *  series is a mosaic */
+  void SetInfo(const std::string &key, const std::string &value);
+  void SetFlag(const std::string &key, bool value);
+  void SetCount(const std::string &key, long value);
+
+private:
+  DWIConvertProfile(const DWIConvertProfile &); // not implemented
+  void operator=(const DWIConvertProfile &); // not implemented
+
+  /** the process counters at one moment; counters the platform
+   *  doesn't provide stay 0 */
+  struct Sample
+  {
+    Sample() : WallTime(0.0), CPUTime(0.0), PeakRSS(0),
+               BytesRead(0), BytesWritten(0) {}
+    double        WallTime;
+    double        CPUTime;
+    itk::uint64_t PeakRSS;
+    itk::uint64_t BytesRead;
+    itk::uint64_t BytesWritten;
+  };
+  static Sample Now();
+
+  struct PhaseTotals
+  {
+    PhaseTotals() : Calls(0), WallTime(0.0), CPUTime(0.0), PeakRSSGrowth(0),
+                    BytesRead(0), BytesWritten(0) {}
+    std::string   Name;
+    unsigned int  Calls;
+    double        WallTime;
+    double        CPUTime;
+    // how much the phase raised the process's peak resident size
+    itk::uint64_t PeakRSSGrowth;
+    itk::uint64_t BytesRead;
+    itk::uint64_t BytesWritten;
+  };
+
+  void Write() const;
+
+  std::string m_ReportName;
+  Sample      m_Start;
+  // index into m_Phases of the current phase, or -1
+  int         m_Current;
+  Sample      m_PhaseStart;
+  std::vector<PhaseTotals> m_Phases;
+  // (key, JSON value)
+  std::vector<std::pair<std::string,std::string> > m_Info;
+};
+
+/** s quoted and escaped as a JSON string */
+std::string DWIConvertJSONString(const std::string &s);
+
+#endif // __DWIConvertProfile_h
@@ -0,0 +1,284 @@
+#include "DWIConvertSeriesQueue.h"
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include "DWIConvertLog.h"
+#include "itkDCMTKFileReader.h"
+
+namespace
+{
+// seconds a converted series is remembered after its last file, for
+// the files that arrive late
+const double RetainTime = 3600.0;
+}
+
+extern int ConvertOneSeries(int argc, char *argv[],
+                            const std::string &seriesUID,
+                            const std::vector<std::string> &fileNames);
+
+DWIConvertSeriesQueue
+::DWIConvertSeriesQueue(int argc, char *argv[], bool reconvertLateFiles) :
+  m_Argc(argc),
+  m_Argv(argv),
+  m_ReconvertLateFiles(reconvertLateFiles),
+  m_Converted(0),
+  m_Failed(0)
+{
+}
+
+int
+DWIConvertSeriesQueue
+::Open(const std::string &journalName)
+{
+  return this->m_Journal.Open(journalName);
+}
+
+void
+DWIConvertSeriesQueue
+::Add(const std::string &seriesUID,
+      const std::string &fileName,
+      long fileNumber,
+      bool isDiffusionWeighted,
+      double now,
+      DcmDataset *dataset)
+{
+  this->m_Lock.Lock();
+  SeriesMap::iterator it = this->m_Series.find(seriesUID);
+  if(it == this->m_Series.end())
+    {
+    it = this->m_Series.insert(std::make_pair(seriesUID,Series())).first;
+    it->second.DoneBefore = this->m_Journal.IsDone(seriesUID);
+    if(it->second.DoneBefore)
+      {
+      DWIConvertLogInfo() << "Series " << seriesUID << " already converted" << std::endl;
+      }
+    }
+  Series &series = it->second;
+  bool keep = true;
+  if(series.DoneBefore)
+    {
+    series.LastArrival = now;
+    keep = false;
+    }
+  else
+    {
+    const bool late = series.Converted && !series.Pending;
+    series.HasDiffusionTags = series.HasDiffusionTags || isDiffusionWeighted;
+    if(late && series.HasDiffusionTags && !this->m_ReconvertLateFiles)
+      {
+      std::cerr << "Warning: " << fileName << " arrived after series "
+                << seriesUID << " was converted; ignoring it" << std::endl;
+      keep = false;
+      }
+    else if(series.Converting && dataset != 0 &&
+            series.FileNames.find(fileName) != series.FileNames.end())
+      {
+      // the conversion is reading the dataset under that name
+      std::cerr << "Warning: " << fileName << " arrived again while series "
+                << seriesUID << " was being converted; ignoring it"
+                << std::endl;
+      keep = false;
+      }
+    else
+      {
+      if(late && series.HasDiffusionTags)
+        {
+        std::cerr << "Warning: " << fileName << " arrived after series "
+                  << seriesUID << " was converted; converting it again"
+                  << " once it settles" << std::endl;
+        }
+      if(series.FileNames.insert(fileName).second)
+        {
+        series.Files.push_back(std::make_pair(fileNumber,fileName));
+        }
+      else
+        {
+        // sent or written again: new content, under the same name
+        for(unsigned int i = 0; i < series.Files.size(); ++i)
+          {
+          if(series.Files[i].second == fileName)
+            {
+            series.Files[i].first = fileNumber;
+            }
+          }
+        }
+      series.LastArrival = now;
+      series.Pending = true;
+      }
+    }
+  if(dataset != 0)
+    {
+    if(keep)
+      {
+      itk::DCMTKFileReader::AddMemoryDataset(fileName,dataset);
+      }
+    else
+      {
+      delete dataset;
+      }
+    }
+  else if(!keep)
+    {
+    itk::DCMTKFileReader::RemoveMemoryDataset(fileName);
+    }
+  this->m_Lock.Unlock();
+}
+
+unsigned int
+DWIConvertSeriesQueue
+::ConvertReady(double now, double settleTime)
+{
+  unsigned int attempted = 0;
+  std::string seriesUID;
+  std::vector<std::string> fileNames;
+  for(;;)
+    {
+    this->m_Lock.Lock();
+    const bool ready = this->NextReady(now,settleTime,seriesUID,fileNames);
+    this->m_Lock.Unlock();
+    if(!ready)
+      {
+      break;
+      }
+    // files of other series, and late files of this one, keep
+    // arriving meanwhile
+    const bool converted = this->Convert(seriesUID,fileNames);
+
+    this->m_Lock.Lock();
+    SeriesMap::iterator it = this->m_Series.find(seriesUID);
+    if(it != this->m_Series.end())
+      {
+      it->second.Converting = false;
+      }
+    if(converted)
+      {
+      this->m_Journal.MarkDone(seriesUID);
+      ++this->m_Converted;
+      }
+    else
+      {
+      ++this->m_Failed;
+      }
+    Release(fileNames);
+    this->m_Lock.Unlock();
+    ++attempted;
+    }
+  return attempted;
+}
+
+bool
+DWIConvertSeriesQueue
+::NextReady(double now, double settleTime,
+            std::string &seriesUID,
+            std::vector<std::string> &fileNames)
+{
+  for(SeriesMap::iterator it = this->m_Series.begin();
+      it != this->m_Series.end(); )
+    {
+    Series &series = it->second;
+    if(!series.Pending && !series.Converting &&
+       now - series.LastArrival >= RetainTime)
+      {
+      // done with: forget it, or a daemon would grow without bound;
+      // files of it that still arrive start it anew
+      this->m_Series.erase(it++);
+      continue;
+      }
+    if(!series.Pending || series.Converting ||
+       now - series.LastArrival < settleTime)
+      {
+      ++it;
+      continue;
+      }
+    series.Pending = false;
+    series.Converted = true;
+    std::stable_sort(series.Files.begin(),series.Files.end());
+    fileNames.clear();
+    for(unsigned int i = 0; i < series.Files.size(); ++i)
+      {
+      fileNames.push_back(series.Files[i].second);
+      }
+    if(!series.HasDiffusionTags)
+      {
+      DWIConvertLogInfo() << "Skipping series " << it->first
+        << ": no diffusion information" << std::endl;
+      Release(fileNames);
+      ++it;
+      continue;
+      }
+    series.Converting = true;
+    seriesUID = it->first;
+    return true;
+    }
+  return false;
+}
+
+bool
+DWIConvertSeriesQueue
+::HasPending() const
+{
+  this->m_Lock.Lock();
+  bool pending = false;
+  for(SeriesMap::const_iterator it = this->m_Series.begin();
+      it != this->m_Series.end() && !pending; ++it)
+    {
+    pending = it->second.Pending || it->second.Converting;
+    }
+  this->m_Lock.Unlock();
+  return pending;
+}
+
+unsigned int
+DWIConvertSeriesQueue
+::GetNumberOfConverted() const
+{
+  this->m_Lock.Lock();
+  const unsigned int converted = this->m_Converted;
+  this->m_Lock.Unlock();
+  return converted;
+}
+
+unsigned int
+DWIConvertSeriesQueue
+::GetNumberOfFailed() const
+{
+  this->m_Lock.Lock();
+  const unsigned int failed = this->m_Failed;
+  this->m_Lock.Unlock();
+  return failed;
+}
+
+bool
+DWIConvertSeriesQueue
+::Convert(const std::string &seriesUID,
+          const std::vector<std::string> &fileNames)
+{
+  DWIConvertLogInfo() << "Converting series " << seriesUID << " ("
+    << fileNames.size() << " files)" << std::endl;
+  int result = EXIT_FAILURE;
+  try
+    {
+    result = ConvertOneSeries(this->m_Argc,this->m_Argv,seriesUID,fileNames);
+    }
+  catch(...)
+    {
+    std::cerr << "Exception thrown converting series " << seriesUID
+              << std::endl;
+    }
+  if(result != EXIT_SUCCESS)
+    {
+    std::cerr << "Failed to convert series " << seriesUID << std::endl;
+    return false;
+    }
+  return true;
+}
+
+void
+DWIConvertSeriesQueue
+::Release(const std::vector<std::string> &fileNames)
+{
+  for(unsigned int i = 0; i < fileNames.size(); ++i)
+    {
+    itk::DCMTKFileReader::RemoveMemoryDataset(fileNames[i]);
+    }
+}
@@ -0,0 +1,120 @@
+#ifndef __DWIConvertSeriesQueue_h
+#define __DWIConvertSeriesQueue_h
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include "itkSimpleFastMutexLock.h"
+#include "DWIConvertShard.h"
+
+class DcmDataset;
+
+/** \class DWIConvertSeriesQueue
+ *  Collects the files of series that arrive one file at a time, from
+ *  a watched directory or a storage SCP, and converts each series
+ *  once it is complete, i.e. once no file of it has arrived for a
+ *  settle time.  No header tells how many images a whole DWI series
+ *  has -- ImagesInAcquisition counts those of one acquisition, which
+ *  for Siemens is one volume -- so the settle time is the only test.
+ *  Files that arrive after their series was converted cause it to be
+ *  converted again, once they too have settled, if the files of the
+ *  series can be read again.
+ *
+ *  The files may be datasets kept in memory with
+ *  itk::DCMTKFileReader::AddMemoryDataset; the queue removes them
+ *  once their series is converted or skipped.
+ *
+ *  Add, HasPending and ConvertReady may be called from different
+ *  threads, e.g. a receiving thread and a converting one: a series is
+ *  converted outside the queue's lock, so files keep arriving while
+ *  it converts.
+ */
+class DWIConvertSeriesQueue
+{
+public:
+  /** argc/argv are those of this run; each series is converted with
+   *  them, as by convertAllSeries.  Without reconvertLateFiles, files
+   *  that arrive after their series was converted are dropped, e.g.
+   *  when the series was only kept in memory. */
+  DWIConvertSeriesQueue(int argc, char *argv[], bool reconvertLateFiles);
+
+  /** read the series converted by earlier runs, and record those
+   *  converted from now on; an empty journalName disables this */
+  int Open(const std::string &journalName);
+
+  /** add a file; isDiffusionWeighted as
+   *  itk::DCMTKFileReader::IsDiffusionWeighted says.  A file added
+   *  again is new content under the same name, e.g. a file rewritten
+   *  in a watched directory, and counts as a file that arrived.
+   *  dataset, if not null, is the file's content: the queue owns it,
+   *  and keeps it with AddMemoryDataset unless the file is dropped. */
+  void Add(const std::string &seriesUID,
+           const std::string &fileName,
+           long fileNumber,
+           bool isDiffusionWeighted,
+           double now,
+           DcmDataset *dataset);
+
+  /** convert the series no file of which has arrived for settleTime
+   *  seconds, and return how many were converted or failed.  A series
+   *  converted, skipped or already in the journal is forgotten once
+   *  no file of it has arrived for an hour; files of it that arrive
+   *  later start it anew. */
+  unsigned int ConvertReady(double now, double settleTime);
+
+  /** are there files that haven't been converted yet, or a series
+   *  being converted */
+  bool HasPending() const;
+
+  unsigned int GetNumberOfConverted() const;
+  unsigned int GetNumberOfFailed() const;
+
+private:
+  DWIConvertSeriesQueue(const DWIConvertSeriesQueue &); // not implemented
+  void operator=(const DWIConvertSeriesQueue &); // not implemented
+
+  /** what has arrived so far of one series */
+  struct Series
+  {
+    Series() : LastArrival(0.0),
+               HasDiffusionTags(false), Pending(false),
+               Converted(false), Converting(false), DoneBefore(false) {}
+    // (file number, file name)
+    std::vector<std::pair<long,std::string> > Files;
+    // a file sent or written twice is only counted once
+    std::set<std::string>                     FileNames;
+    double LastArrival;
+    bool   HasDiffusionTags;
+    // files arrived since the last conversion
+    bool   Pending;
+    bool   Converted;
+    // its files are being read by ConvertReady, outside the lock
+    bool   Converting;
+    // the journal lists it as converted by an earlier run
+    bool   DoneBefore;
+  };
+  typedef std::map<std::string,Series> SeriesMap;
+
+  /** with the lock held: forget the series done with, skip those
+   *  without diffusion information, and pick a settled DWI series to
+   *  convert, in file number order; false if there is none */
+  bool NextReady(double now, double settleTime,
+                 std::string &seriesUID,
+                 std::vector<std::string> &fileNames);
+  bool Convert(const std::string &seriesUID,
+               const std::vector<std::string> &fileNames);
+  /** remove the datasets of fileNames kept in memory */
+  static void Release(const std::vector<std::string> &fileNames);
+
+  int               m_Argc;
+  char            **m_Argv;
+  bool              m_ReconvertLateFiles;
+  DWIConvertJournal m_Journal;
+  SeriesMap         m_Series;
+  unsigned int      m_Converted;
+  unsigned int      m_Failed;
+  // guards all of the above once the queue is in use
+  mutable itk::SimpleFastMutexLock m_Lock;
+};
+
+#endif // __DWIConvertSeriesQueue_h
@@ -0,0 +1,184 @@
+#include "DWIConvertShard.h"
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+#include "itksys/Directory.hxx"
+#include "itksys/SystemTools.hxx"
+#include "DWIConvertLog.h"
+
+namespace
+{
+// per-file charge for opening and parsing a header, in bytes
+const double PerFileCost = 65536.0;
+
+// a journal record is JournalPrefix, the key, then JournalSuffix, so
+// that one cut short can be told from a complete one
+const std::string JournalPrefix("DONE\t");
+const std::string JournalSuffix("\tEND");
+
+struct ShardOrder
+{
+  const std::vector<DWIConvertWorkItem> *Items;
+  // most expensive first; the key breaks ties deterministically
+  bool operator()(unsigned int a, unsigned int b) const
+    {
+      const DWIConvertWorkItem &itemA = (*Items)[a];
+      const DWIConvertWorkItem &itemB = (*Items)[b];
+      if(itemA.Cost != itemB.Cost)
+        {
+        return itemA.Cost > itemB.Cost;
+        }
+      if(itemA.Key != itemB.Key)
+        {
+        return itemA.Key < itemB.Key;
+        }
+      return a < b;
+    }
+};
+}
+
+double
+DWIConvertEstimateCost(unsigned long numberOfFiles, double numberOfBytes)
+{
+  return numberOfBytes + PerFileCost * numberOfFiles;
+}
+
+double
+DWIConvertEstimateInputCost(const std::string &input)
+{
+  if(!itksys::SystemTools::FileIsDirectory(input.c_str()))
+    {
+    if(!itksys::SystemTools::FileExists(input.c_str()))
+      {
+      return 0.0;
+      }
+    return DWIConvertEstimateCost(1,itksys::SystemTools::FileLength(input.c_str()));
+    }
+  itksys::Directory directory;
+  directory.Load(input.c_str());
+  unsigned long numberOfFiles = 0;
+  double numberOfBytes = 0.0;
+  for(unsigned long i = 0; i < directory.GetNumberOfFiles(); ++i)
+    {
+    const std::string path = input + "/" + directory.GetFile(i);
+    if(itksys::SystemTools::FileIsDirectory(path.c_str()))
+      {
+      continue;
+      }
+    ++numberOfFiles;
+    numberOfBytes += itksys::SystemTools::FileLength(path.c_str());
+    }
+  return DWIConvertEstimateCost(numberOfFiles,numberOfBytes);
+}
+
+double
+DWIConvertEstimateFilesCost(const std::vector<std::string> &fileNames)
+{
+  double numberOfBytes = 0.0;
+  for(unsigned long i = 0; i < fileNames.size(); ++i)
+    {
+    numberOfBytes += itksys::SystemTools::FileLength(fileNames[i].c_str());
+    }
+  return DWIConvertEstimateCost(fileNames.size(),numberOfBytes);
+}
+
+std::vector<unsigned int>
+DWIConvertAssignShard(const std::vector<DWIConvertWorkItem> &items,
+                      unsigned int shardIndex,
+                      unsigned int shardCount)
+{
+  std::vector<unsigned int> order(items.size());
+  for(unsigned int i = 0; i < items.size(); ++i)
+    {
+    order[i] = i;
+    }
+  ShardOrder compare;
+  compare.Items = &items;
+  std::sort(order.begin(),order.end(),compare);
+
+  std::vector<double> load(shardCount > 0 ? shardCount : 1,0.0);
+  std::vector<unsigned int> assigned;
+  for(unsigned int i = 0; i < order.size(); ++i)
+    {
+    // least loaded shard, lowest index on ties
+    const unsigned int shard =
+      std::min_element(load.begin(),load.end()) - load.begin();
+    load[shard] += items[order[i]].Cost;
+    if(shard == shardIndex)
+      {
+      assigned.push_back(order[i]);
+      }
+    }
+  // convert in manifest/catalog order within the shard
+  std::sort(assigned.begin(),assigned.end());
+  return assigned;
+}
+
+int
+DWIConvertJournal
+::Open(const std::string &fileName)
+{
+  if(fileName == "")
+    {
+    return EXIT_SUCCESS;
+    }
+  // whether the last record was cut short, without its newline
+  bool cutShort = false;
+  {
+  std::ifstream journal(fileName.c_str(),std::ios::in | std::ios::binary);
+  std::string line;
+  while(std::getline(journal,line))
+    {
+    cutShort = journal.eof();
+    // only a complete record counts: one cut short by a crash may
+    // still look like a record of a shorter key, and its item is
+    // simply redone
+    if(line.size() >= JournalPrefix.size() + JournalSuffix.size() &&
+       line.compare(0,JournalPrefix.size(),JournalPrefix) == 0 &&
+       line.compare(line.size() - JournalSuffix.size(),
+                    JournalSuffix.size(),JournalSuffix) == 0 &&
+       !cutShort)
+      {
+      this->m_Done.insert(line.substr(JournalPrefix.size(),
+                                      line.size() - JournalPrefix.size() -
+                                      JournalSuffix.size()));
+      }
+    }
+  }
+  this->m_Journal.open(fileName.c_str(),std::ios::out | std::ios::app);
+  if(!this->m_Journal.good())
+    {
+    std::cerr << "Can't open journal " << fileName << std::endl;
+    return EXIT_FAILURE;
+    }
+  if(cutShort)
+    {
+    // end it, so that the next record starts a line of its own
+    this->m_Journal << std::endl;
+    }
+  if(!this->m_Done.empty())
+    {
+    DWIConvertLogInfo() << "Journal " << fileName << ": skipping "
+      << this->m_Done.size() << " completed entries" << std::endl;
+    }
+  return EXIT_SUCCESS;
+}
+
+bool
+DWIConvertJournal
+::IsDone(const std::string &key) const
+{
+  return this->m_Done.find(key) != this->m_Done.end();
+}
+
+void
+DWIConvertJournal
+::MarkDone(const std::string &key)
+{
+  this->m_Lock.Lock();
+  if(this->m_Journal.is_open())
+    {
+    this->m_Journal << JournalPrefix << key << JournalSuffix << std::endl;
+    }
+  this->m_Lock.Unlock();
+}
@@ -0,0 +1,67 @@
+#ifndef __DWIConvertShard_h
+#define __DWIConvertShard_h
+#include <string>
+#include <vector>
+#include <set>
+#include <fstream>
+#include "itkSimpleFastMutexLock.h"
+
+/** A unit of batch work: Key identifies it in the journal, Cost is
+ *  the estimated conversion cost used to balance shards.
+ */
+struct DWIConvertWorkItem
+{
+  std::string Key;
+  double      Cost;
+};
+
+/** Estimated cost of converting numberOfFiles files totalling
+ *  numberOfBytes: the bytes to decode, plus a fixed per-file charge
+ *  for opening and parsing each header.
+ */
+double DWIConvertEstimateCost(unsigned long numberOfFiles,
+                              double numberOfBytes);
+
+/** Estimated cost of converting a DICOM directory, or a single file,
+ *  from a directory listing; no DICOM parsing is done.
+ */
+double DWIConvertEstimateInputCost(const std::string &input);
+
+/** Estimated cost of converting the listed files, from their sizes. */
+double DWIConvertEstimateFilesCost(const std::vector<std::string> &fileNames);
+
+/** Indices of the items that belong to shardIndex out of shardCount.
+ *  Items are dealt, most expensive first, to the shard with the least
+ *  work so far; the result only depends on the items, so every node
+ *  of a job array computes the same partition without coordination.
+ */
+std::vector<unsigned int>
+DWIConvertAssignShard(const std::vector<DWIConvertWorkItem> &items,
+                      unsigned int shardIndex,
+                      unsigned int shardCount);
+
+/** \class DWIConvertJournal
+ *  Append-only record of completed work items, so that a failed or
+ *  interrupted run can be resumed without redoing them.  Each item is
+ *  a line "DONE\t<key>\tEND"; a line without the end marker, cut
+ *  short by a crash, doesn't count.
+ */
+class DWIConvertJournal
+{
+public:
+  /** read the items already completed, and open the journal for
+   *  appending; an empty fileName disables journaling */
+  int Open(const std::string &fileName);
+
+  bool IsDone(const std::string &key) const;
+
+  /** record key as completed; safe to call from several threads */
+  void MarkDone(const std::string &key);
+
+private:
+  std::set<std::string>    m_Done;
+  std::ofstream            m_Journal;
+  itk::SimpleFastMutexLock m_Lock;
+};
+
+#endif // __DWIConvertShard_h
@@ -0,0 +1,387 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include "itksys/SystemTools.hxx"
+#include "itkMultiThreader.h"
+#include "itkSimpleFastMutexLock.h"
+#include "DWIConvertSeriesQueue.h"
+#include "DWIConvertLog.h"
+
+#include "dcmtk/config/osconfig.h" // make sure OS specific configuration is included first
+#include "dcmtk/dcmnet/assoc.h"
+#include "dcmtk/dcmnet/dimse.h"
+#include "dcmtk/dcmdata/dcdatset.h"
+#include "dcmtk/dcmdata/dcdeftag.h"
+#include "dcmtk/dcmdata/dcuid.h"
+#include "itkDCMTKFileReader.h"
+
+namespace
+{
+// seconds to wait for an association, or between checks for settled
+// series
+const int ReceiveInterval = 1;
+
+/** what the C-STORE callback needs */
+struct StoreContext
+{
+  DWIConvertSeriesQueue *Queue;
+  // seconds to wait for a message, or the rest of one
+  int                    Timeout;
+};
+
+/** whether uid is a DICOM UID: at most 64 characters, in components
+ *  of digits separated by single dots.  A received dataset is named
+ *  after its SOP instance UID, which comes from the peer, so nothing
+ *  else -- no slash, no "..", no letters -- gets through.
+ */
+bool
+IsValidUID(const char *uid)
+{
+  const size_t length = strlen(uid);
+  if(length == 0 || length > 64 || uid[0] == '.' || uid[length - 1] == '.')
+    {
+    return false;
+    }
+  for(size_t i = 0; i < length; ++i)
+    {
+    if(uid[i] == '.' ? uid[i + 1] == '.' : (uid[i] < '0' || uid[i] > '9'))
+      {
+      return false;
+      }
+    }
+  return true;
+}
+
+/** Keep a received dataset in memory, under a name made from its SOP
+ *  instance UID, and queue it for conversion; the dataset is decoded
+ *  from memory when its series is converted, and never written to
+ *  disk.
+ */
+void
+StoreCallback(void *callbackData,
+              T_DIMSE_StoreProgress *progress,
+              T_DIMSE_C_StoreRQ *req,
+              char * /* imageFileName */,
+              DcmDataset **imageDataSet,
+              T_DIMSE_C_StoreRSP *rsp,
+              DcmDataset **statusDetail)
+{
+  if(progress->state != DIMSE_StoreEnd)
+    {
+    return;
+    }
+  *statusDetail = 0;
+  if(imageDataSet == 0 || *imageDataSet == 0)
+    {
+    rsp->DimseStatus = STATUS_STORE_Refused_OutOfResources;
+    return;
+    }
+  StoreContext *context = static_cast<StoreContext *>(callbackData);
+  DcmDataset *dataset = *imageDataSet;
+
+  if(!IsValidUID(req->AffectedSOPInstanceUID))
+    {
+    std::cerr << "Storage SCP: rejected a dataset with SOP instance UID \""
+              << req->AffectedSOPInstanceUID << "\"" << std::endl;
+    rsp->DimseStatus = STATUS_STORE_Error_CannotUnderstand;
+    return;
+    }
+  OFString uid;
+  if(dataset->findAndGetOFString(DCM_SeriesInstanceUID,uid).bad())
+    {
+    std::cerr << "Received " << req->AffectedSOPInstanceUID
+              << " without a series UID" << std::endl;
+    rsp->DimseStatus = STATUS_STORE_Error_CannotUnderstand;
+    return;
+    }
+  const std::string datasetName =
+    std::string("scp:") + req->AffectedSOPInstanceUID;
+
+  Sint32 fileNumber(0);
+  dataset->findAndGetSint32(DCM_InstanceNumber,fileNumber);
+  itk::DCMTKFileReader reader;
+  reader.SetFileName(datasetName);
+  reader.SetDataset(dataset);
+  const bool isDiffusionWeighted = reader.IsDiffusionWeighted();
+
+  // the queue owns it from now on, and deletes it once its series is
+  // converted; DIMSE_storeProvider doesn't touch it after this call
+  *imageDataSet = 0;
+  context->Queue->Add(uid.c_str(),datasetName,fileNumber,
+                      isDiffusionWeighted,itksys::SystemTools::GetTime(),
+                      dataset);
+}
+
+/** what the converting thread shares with the receiving one */
+struct ConversionWorker
+{
+  DWIConvertSeriesQueue   *Queue;
+  double                   SettleTime;
+  itk::SimpleFastMutexLock Lock;
+  // set to make the thread return; guarded by Lock
+  bool                     Stop;
+  // when the last conversion ended; guarded by Lock
+  double                   LastConversion;
+};
+
+/** convert the settled series until told to stop, so that
+ *  associations are accepted while a series converts */
+ITK_THREAD_RETURN_TYPE
+ConversionThread(void *arg)
+{
+  ConversionWorker *worker = static_cast<ConversionWorker *>(
+    static_cast<itk::MultiThreader::ThreadInfoStruct *>(arg)->UserData);
+  for(;;)
+    {
+    worker->Lock.Lock();
+    const bool stop = worker->Stop;
+    worker->Lock.Unlock();
+    if(stop)
+      {
+      break;
+      }
+    if(worker->Queue->ConvertReady(itksys::SystemTools::GetTime(),
+                                   worker->SettleTime) > 0)
+      {
+      worker->Lock.Lock();
+      worker->LastConversion = itksys::SystemTools::GetTime();
+      worker->Lock.Unlock();
+      }
+    else
+      {
+      itksys::SystemTools::Delay(ReceiveInterval * 1000);
+      }
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+/** negotiate the presentation contexts of a new association: the
+ *  verification SOP class and every storage SOP class, in the usual
+ *  uncompressed transfer syntaxes, or else in the lossless ones the
+ *  codecs registered by RegisterCodecs decode.  Lossy syntaxes aren't
+ *  accepted: a diffusion series converted from them would silently
+ *  carry compression artifacts. */
+OFCondition
+AcceptAssociation(T_ASC_Association *assoc, const std::string &aeTitle)
+{
+  // in order of preference
+  const char *transferSyntaxes[] =
+    {
+      UID_LittleEndianExplicitTransferSyntax,
+      UID_BigEndianExplicitTransferSyntax,
+      UID_LittleEndianImplicitTransferSyntax,
+      UID_JPEGProcess14SV1TransferSyntax,
+      UID_JPEGProcess14TransferSyntax,
+      UID_RLELosslessTransferSyntax
+    };
+  const int nTransferSyntaxes =
+    sizeof(transferSyntaxes) / sizeof(transferSyntaxes[0]);
+  const char *verification[] = { UID_VerificationSOPClass };
+
+  ASC_setAPTitles(assoc->params,NULL,NULL,aeTitle.c_str());
+  OFCondition cond =
+    ASC_acceptContextsWithPreferredTransferSyntaxes(assoc->params,
+                                                    verification,1,
+                                                    transferSyntaxes,
+                                                    nTransferSyntaxes);
+  if(cond.good())
+    {
+    cond = ASC_acceptContextsWithPreferredTransferSyntaxes(
+      assoc->params,dcmAllStorageSOPClassUIDs,
+      numberOfAllDcmStorageSOPClassUIDs,
+      transferSyntaxes,nTransferSyntaxes);
+    }
+  if(cond.good())
+    {
+    cond = ASC_acknowledgeAssociation(assoc);
+    }
+  return cond;
+}
+
+/** answer C-ECHO and C-STORE requests until the peer releases or
+ *  aborts the association */
+void
+ServeAssociation(T_ASC_Association *assoc, StoreContext &context)
+{
+  for(;;)
+    {
+    T_DIMSE_Message msg;
+    T_ASC_PresentationContextID presID;
+    OFCondition cond =
+      DIMSE_receiveCommand(assoc,DIMSE_NONBLOCKING,context.Timeout,
+                           &presID,&msg,NULL);
+    if(cond == DUL_PEERREQUESTEDRELEASE)
+      {
+      ASC_acknowledgeRelease(assoc);
+      return;
+      }
+    if(cond.bad())
+      {
+      if(cond == DIMSE_NODATAAVAILABLE)
+        {
+        std::cerr << "Storage SCP: nothing received for " << context.Timeout
+                  << " seconds; aborting the association" << std::endl;
+        ASC_abortAssociation(assoc);
+        }
+      else if(cond != DUL_PEERABORTEDASSOCIATION)
+        {
+        std::cerr << "Storage SCP: " << cond.text() << std::endl;
+        ASC_abortAssociation(assoc);
+        }
+      return;
+      }
+    switch(msg.CommandField)
+      {
+      case DIMSE_C_ECHO_RQ:
+        cond = DIMSE_sendEchoResponse(assoc,presID,&msg.msg.CEchoRQ,
+                                      STATUS_Success,NULL);
+        break;
+      case DIMSE_C_STORE_RQ:
+        {
+        DcmDataset *dataset = 0;
+        cond = DIMSE_storeProvider(assoc,presID,&msg.msg.CStoreRQ,
+                                   NULL,OFTrue,&dataset,
+                                   StoreCallback,&context,
+                                   DIMSE_NONBLOCKING,context.Timeout);
+        delete dataset;
+        }
+        break;
+      default:
+        std::cerr << "Storage SCP: unsupported command "
+                  << msg.CommandField << std::endl;
+        cond = DIMSE_BADCOMMANDTYPE;
+        break;
+      }
+    if(cond.bad())
+      {
+      ASC_abortAssociation(assoc);
+      return;
+      }
+    }
+}
+
+} // end anonymous namespace
+
+/** Receive DICOM images on a port with a storage SCP, and convert
+ *  each DWI series settleTime seconds after its last image, on a
+ *  thread of its own so that images keep arriving meanwhile.  Received
+ *  datasets are kept in memory until their series is converted.  An
+ *  association on which nothing arrives for timeout seconds is
+ *  aborted.  Runs until idleExit seconds pass without an association
+ *  and with nothing left to convert, or forever if idleExit is 0.
+ */
+int
+DWIConvertStorageSCP(int argc, char *argv[],
+                     int port,
+                     const std::string &aeTitle,
+                     int timeout,
+                     double settleTime, double idleExit,
+                     const std::string &journalName)
+{
+  if(port <= 0 || port > 65535)
+    {
+    std::cerr << "storageSCPPort must be in [1,65535]" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if(timeout <= 0)
+    {
+    std::cerr << "storageSCPTimeout must be positive" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if(settleTime < 0.0 || idleExit < 0.0)
+    {
+    std::cerr << "watchSettleTime and watchIdleExit must not be negative"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+  // a series is released from memory once converted, so images that
+  // arrive after that can't be added to it
+  DWIConvertSeriesQueue queue(argc,argv,false);
+  if(queue.Open(journalName) != EXIT_SUCCESS)
+    {
+    return EXIT_FAILURE;
+    }
+  T_ASC_Network *network = 0;
+  // the timeout also bounds the association negotiation
+  OFCondition cond = ASC_initializeNetwork(NET_ACCEPTOR,port,timeout,&network);
+  if(cond.bad())
+    {
+    std::cerr << "Can't listen on port " << port << ": "
+              << cond.text() << std::endl;
+    return EXIT_FAILURE;
+    }
+  DWIConvertLogInfo() << "Storage SCP " << aeTitle << " listening on port "
+    << port << std::endl;
+  // it may idle for a long time now
+  DWIConvertLog::Flush();
+
+  StoreContext context;
+  context.Queue = &queue;
+  context.Timeout = timeout;
+  double lastActivity = itksys::SystemTools::GetTime();
+
+  ConversionWorker worker;
+  worker.Queue = &queue;
+  worker.SettleTime = settleTime;
+  worker.Stop = false;
+  worker.LastConversion = lastActivity;
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  const int threadID = threader->SpawnThread(ConversionThread,&worker);
+  if(threadID < 0)
+    {
+    std::cerr << "Storage SCP: can't start the conversion thread" << std::endl;
+    ASC_dropNetwork(&network);
+    return EXIT_FAILURE;
+    }
+  for(;;)
+    {
+    T_ASC_Association *assoc = 0;
+    cond = ASC_receiveAssociation(network,&assoc,ASC_DEFAULTMAXPDU,
+                                  NULL,NULL,OFFalse,
+                                  DUL_NOBLOCK,ReceiveInterval);
+    if(cond.good())
+      {
+      if(AcceptAssociation(assoc,aeTitle).good())
+        {
+        ServeAssociation(assoc,context);
+        }
+      else
+        {
+        ASC_abortAssociation(assoc);
+        }
+      lastActivity = itksys::SystemTools::GetTime();
+      }
+    else if(cond != DUL_NOASSOCIATIONREQUEST)
+      {
+      std::cerr << "Storage SCP: " << cond.text() << std::endl;
+      }
+    if(assoc != 0)
+      {
+      ASC_dropSCPAssociation(assoc);
+      ASC_destroyAssociation(&assoc);
+      }
+
+    if(idleExit > 0.0 && !queue.HasPending())
+      {
+      worker.Lock.Lock();
+      const double lastConversion = worker.LastConversion;
+      worker.Lock.Unlock();
+      const double now = itksys::SystemTools::GetTime();
+      if(now - std::max(lastActivity,lastConversion) >= idleExit)
+        {
+        break;
+        }
+      }
+    }
+  worker.Lock.Lock();
+  worker.Stop = true;
+  worker.Lock.Unlock();
+  // waits for the conversion under way, if any
+  threader->TerminateThread(threadID);
+  ASC_dropNetwork(&network);
+  DWIConvertLogInfo() << queue.GetNumberOfConverted() << " series converted, "
+    << queue.GetNumberOfFailed() << " failed" << std::endl;
+  return queue.GetNumberOfFailed() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,188 @@
+#include "DWIConvertTrace.h"
+#include "DWIConvertProfile.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstdlib>
+#include "itksys/SystemTools.hxx"
+#include "itkSimpleFastMutexLock.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+namespace
+{
+struct TraceEvent
+{
+  const char   *Name;
+  std::string   FileName;
+  double        Start;
+  double        End;
+  unsigned int  Thread;
+  itk::uint64_t Bytes;
+};
+
+#if defined(_WIN32)
+typedef DWORD ThreadType;
+ThreadType CurrentThread() { return GetCurrentThreadId(); }
+bool SameThread(ThreadType a, ThreadType b) { return a == b; }
+#else
+typedef pthread_t ThreadType;
+ThreadType CurrentThread() { return pthread_self(); }
+bool SameThread(ThreadType a, ThreadType b) { return pthread_equal(a,b) != 0; }
+#endif
+
+itk::SimpleFastMutexLock TraceLock;
+// only changed by Open and Close, while no conversion runs
+bool                     TraceOpen(false);
+std::string              TraceFileName;
+double                   TraceOrigin(0.0);
+std::vector<TraceEvent>  TraceEvents;
+// the index of a thread is its tid in the trace
+std::vector<ThreadType>  TraceThreads;
+
+/** call with TraceLock held */
+unsigned int
+TraceThreadIndex()
+{
+  const ThreadType self = CurrentThread();
+  for(unsigned int i = 0; i < TraceThreads.size(); ++i)
+    {
+    if(SameThread(TraceThreads[i],self))
+      {
+      return i;
+      }
+    }
+  TraceThreads.push_back(self);
+  return TraceThreads.size() - 1;
+}
+}
+
+bool
+DWIConvertTrace
+::Open(const std::string &fileName)
+{
+  if(TraceOpen)
+    {
+    return false;
+    }
+  TraceFileName = fileName;
+  TraceOrigin = Now();
+  TraceEvents.clear();
+  TraceThreads.clear();
+  TraceOpen = true;
+  return true;
+}
+
+int
+DWIConvertTrace
+::Close()
+{
+  if(!TraceOpen)
+    {
+    return EXIT_SUCCESS;
+    }
+  TraceOpen = false;
+  std::ofstream trace(TraceFileName.c_str());
+  trace << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  for(unsigned int i = 0; i < TraceEvents.size(); ++i)
+    {
+    const TraceEvent &event = TraceEvents[i];
+    // complete events, timed in microseconds
+    trace << (i == 0 ? "" : ",") << std::endl
+          << "{\"name\":" << DWIConvertJSONString(event.Name)
+          << ",\"cat\":\"DWIConvert\",\"ph\":\"X\",\"pid\":1"
+          << ",\"tid\":" << event.Thread
+          << ",\"ts\":" << static_cast<itk::uint64_t>((event.Start - TraceOrigin) * 1.0e6)
+          << ",\"dur\":" << static_cast<itk::uint64_t>((event.End - event.Start) * 1.0e6)
+          << ",\"args\":{\"file\":" << DWIConvertJSONString(event.FileName)
+          << ",\"bytes\":" << event.Bytes << "}}";
+    }
+  trace << std::endl << "]}" << std::endl;
+  TraceEvents.clear();
+  TraceThreads.clear();
+  if(!trace.good())
+    {
+    std::cerr << "Can't write trace " << TraceFileName << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+
+bool
+DWIConvertTrace
+::IsOpen()
+{
+  return TraceOpen;
+}
+
+void
+DWIConvertTrace
+::Record(const char *name, const std::string &fileName,
+         double start, double end, itk::uint64_t bytes)
+{
+  if(!TraceOpen)
+    {
+    return;
+    }
+  TraceEvent event;
+  event.Name = name;
+  event.FileName = fileName;
+  event.Start = start;
+  event.End = end;
+  event.Bytes = bytes;
+  TraceLock.Lock();
+  event.Thread = TraceThreadIndex();
+  TraceEvents.push_back(event);
+  TraceLock.Unlock();
+}
+
+double
+DWIConvertTrace
+::Now()
+{
+  return itksys::SystemTools::GetTime();
+}
+
+DWIConvertTraceSpan
+::DWIConvertTraceSpan(const char *name, const std::string &fileName) :
+  m_Name(name),
+  m_Start(0.0),
+  m_Bytes(0),
+  m_Enabled(DWIConvertTrace::IsOpen())
+{
+  if(this->m_Enabled)
+    {
+    this->m_FileName = fileName;
+    this->m_Bytes = itksys::SystemTools::FileLength(fileName.c_str());
+    this->m_Start = DWIConvertTrace::Now();
+    }
+}
+
+DWIConvertTraceSpan
+::DWIConvertTraceSpan(const char *name, const std::string &fileName,
+                      itk::uint64_t bytes) :
+  m_Name(name),
+  m_Start(0.0),
+  m_Bytes(bytes),
+  m_Enabled(DWIConvertTrace::IsOpen())
+{
+  if(this->m_Enabled)
+    {
+    this->m_FileName = fileName;
+    this->m_Start = DWIConvertTrace::Now();
+    }
+}
+
+DWIConvertTraceSpan
+::~DWIConvertTraceSpan()
+{
+  if(this->m_Enabled)
+    {
+    DWIConvertTrace::Record(this->m_Name,this->m_FileName,this->m_Start,
+                            DWIConvertTrace::Now(),this->m_Bytes);
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef __DWIConvertTrace_h
+#define __DWIConvertTrace_h
+#include <string>
+#include "itkIntTypes.h"
+
+/** \class DWIConvertTrace
+ *  Process-wide record of spans -- a file probed, a header loaded, a
+ *  slice decoded, a chunk written -- saved as a Chrome trace-event
+ *  JSON file that chrome://tracing or Perfetto can load.  Each span
+ *  carries the thread it ran in, and the file and number of bytes it
+ *  worked on.  Spans are recorded only while a trace is open.
+ */
+class DWIConvertTrace
+{
+public:
+  /** start recording; returns false if a trace is already open.
+   *  Open and Close must not be called while conversions run. */
+  static bool Open(const std::string &fileName);
+  /** write the trace file and stop recording */
+  static int Close();
+  static bool IsOpen();
+
+  static void Record(const char *name, const std::string &fileName,
+                     double start, double end, itk::uint64_t bytes);
+  /** seconds, on the clock Record expects */
+  static double Now();
+};
+
+/** \class DWIConvertTraceSpan
+ *  Records the span from its construction to its destruction.
+ *  Without a byte count, the span counts the size of the file.
+ */
+class DWIConvertTraceSpan
+{
+public:
+  DWIConvertTraceSpan(const char *name, const std::string &fileName);
+  DWIConvertTraceSpan(const char *name, const std::string &fileName,
+                      itk::uint64_t bytes);
+  ~DWIConvertTraceSpan();
+
+  void SetBytes(itk::uint64_t bytes) { this->m_Bytes = bytes; }
+
+private:
+  DWIConvertTraceSpan(const DWIConvertTraceSpan &); // not implemented
+  void operator=(const DWIConvertTraceSpan &); // not implemented
+
+  const char   *m_Name;
+  std::string   m_FileName;
+  double        m_Start;
+  itk::uint64_t m_Bytes;
+  bool          m_Enabled;
+};
+
+/** \class DWIConvertTraceFile
+ *  Opens a trace for the duration of a scope, unless the name is
+ *  empty or a trace is already open.
+ */
+class DWIConvertTraceFile
+{
+public:
+  explicit DWIConvertTraceFile(const std::string &fileName) :
+    m_Opened(fileName != "" && DWIConvertTrace::Open(fileName)) {}
+  ~DWIConvertTraceFile()
+    {
+      if(this->m_Opened)
+        {
+        DWIConvertTrace::Close();
+        }
+    }
+private:
+  DWIConvertTraceFile(const DWIConvertTraceFile &); // not implemented
+  void operator=(const DWIConvertTraceFile &); // not implemented
+
+  const bool m_Opened;
+};
+
+#endif // __DWIConvertTrace_h
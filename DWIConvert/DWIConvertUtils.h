@@ -343,4 +343,46 @@ void PrintVec(const std::vector<TVal> &vec)
   std::cerr << "]" << std::endl;
 }
 
+/** Finish a hand-written NRRD header: append the blank line that ends
+ *  it and, if alignment is non-zero, pad it so that attached data
+ *  starts on a multiple of alignment bytes.  The padding is made of
+ *  comment lines, and the resulting offset is recorded in the
+ *  data_offset key so readers can map the data without parsing.
+ */
+inline std::string
+FinishNrrdHeader(const std::string &fields, unsigned long alignment)
+{
+  if(alignment == 0)
+    {
+    return fields + "\n";
+    }
+  // fixed width, so the header length doesn't depend on the offset
+  const size_t offsetKeySize = std::string("data_offset:=").size() + 12 + 1;
+  const size_t unpadded = fields.size() + offsetKeySize + 1;
+  size_t pad = (alignment - (unpadded % alignment)) % alignment;
+  if(pad == 1)
+    {
+    // a comment line needs at least two bytes
+    pad += alignment;
+    }
+  const size_t offset = unpadded + pad;
+
+  std::ostringstream header;
+  header << fields;
+  header << "data_offset:=" << std::setw(12) << std::setfill('0')
+         << offset << "\n";
+  while(pad > 0)
+    {
+    size_t lineSize = pad < 80 ? pad : 80;
+    if(pad - lineSize == 1)
+      {
+      --lineSize;
+      }
+    header << "#" << std::string(lineSize - 2,' ') << "\n";
+    pad -= lineSize;
+    }
+  header << "\n";
+  return header.str();
+}
+
 #endif // DWIConvertUtils_h
@@ -0,0 +1,307 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdlib>
+#include "itksys/Directory.hxx"
+#include "itksys/SystemTools.hxx"
+#include "itkDCMTKFileReader.h"
+#include "DWIConvertSeriesQueue.h"
+#include "DWIConvertLog.h"
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#define DWICONVERT_USE_INOTIFY
+#endif
+
+namespace
+{
+// how often pending series are checked, in seconds
+const double WatchInterval = 1.0;
+
+/** Reports the files that have been completely written to a
+ *  directory, and again each time they are rewritten.  On Linux
+ *  inotify reports files as they are closed after writing or moved
+ *  in; elsewhere the directory is listed every interval, and a file
+ *  is reported once its size stops changing, if its size or
+ *  modification time differ from when it was last reported.
+ */
+class DirectoryWatcher
+{
+public:
+  DirectoryWatcher() : m_FirstWait(true), m_Inotify(-1) {}
+  ~DirectoryWatcher()
+    {
+#if defined(DWICONVERT_USE_INOTIFY)
+      if(this->m_Inotify >= 0)
+        {
+        close(this->m_Inotify);
+        }
+#endif
+    }
+
+  int Start(const std::string &directory)
+    {
+      this->m_Directory = directory;
+#if defined(DWICONVERT_USE_INOTIFY)
+      // watch before the first listing, so no file falls between them
+      this->m_Inotify = inotify_init();
+      if(this->m_Inotify < 0 ||
+         inotify_add_watch(this->m_Inotify,directory.c_str(),
+                           IN_CLOSE_WRITE | IN_MOVED_TO |
+                           IN_DELETE | IN_MOVED_FROM) < 0)
+        {
+        std::cerr << "Can't watch " << directory << std::endl;
+        return EXIT_FAILURE;
+        }
+#endif
+      return EXIT_SUCCESS;
+    }
+
+  /** wait up to timeout seconds, and append the newly written files
+   *  to newFiles */
+  void Wait(double timeout, std::vector<std::string> &newFiles)
+    {
+#if defined(DWICONVERT_USE_INOTIFY)
+      if(this->m_FirstWait)
+        {
+        // the files already there when the watch started
+        this->m_FirstWait = false;
+        this->List(newFiles,false);
+        if(!newFiles.empty())
+          {
+          return;
+          }
+        }
+      struct pollfd fd;
+      fd.fd = this->m_Inotify;
+      fd.events = POLLIN;
+      if(poll(&fd,1,static_cast<int>(timeout * 1000.0)) <= 0)
+        {
+        return;
+        }
+      char buffer[16384]
+        __attribute__ ((aligned(__alignof__(struct inotify_event))));
+      const ssize_t length = read(this->m_Inotify,buffer,sizeof(buffer));
+      bool overflow = false;
+      for(ssize_t i = 0; i < length; )
+        {
+        const struct inotify_event *event =
+          reinterpret_cast<const struct inotify_event *>(buffer + i);
+        if(event->mask & IN_Q_OVERFLOW)
+          {
+          overflow = true;
+          }
+        else if(event->len > 0 && (event->mask & (IN_DELETE | IN_MOVED_FROM)))
+          {
+          this->m_Reported.erase(this->m_Directory + "/" + event->name);
+          }
+        else if(event->len > 0)
+          {
+          // closed after writing, or moved in: new content
+          this->Report(this->m_Directory + "/" + event->name,newFiles,true,
+                       this->m_Reported);
+          }
+        i += sizeof(struct inotify_event) + event->len;
+        }
+      if(overflow)
+        {
+        // events were lost while a conversion ran; the listing finds
+        // the files they were about
+        std::cerr << "Warning: too many files arrived in "
+                  << this->m_Directory << " at once; listing it again"
+                  << std::endl;
+        this->List(newFiles,false);
+        }
+#else
+      if(!this->m_FirstWait)
+        {
+        itksys::SystemTools::Delay(static_cast<unsigned int>(timeout * 1000.0));
+        }
+      this->m_FirstWait = false;
+      this->List(newFiles,true);
+#endif
+    }
+
+private:
+  /** what a file looked like when it was reported */
+  struct FileStamp
+  {
+    unsigned long Size;
+    long int      ModifiedTime;
+  };
+
+  typedef std::map<std::string,FileStamp> StampMap;
+
+  /** append path to newFiles if it is new content: newContent says
+   *  so, or it differs from when it was last reported, as recorded
+   *  in reported */
+  void Report(const std::string &path, std::vector<std::string> &newFiles,
+              bool newContent, StampMap &reported)
+    {
+      if(itksys::SystemTools::FileIsDirectory(path.c_str()))
+        {
+        return;
+        }
+      FileStamp stamp;
+      stamp.Size = itksys::SystemTools::FileLength(path.c_str());
+      stamp.ModifiedTime = itksys::SystemTools::ModifiedTime(path.c_str());
+      StampMap::iterator it = reported.find(path);
+      if(it != reported.end() && !newContent &&
+         it->second.Size == stamp.Size &&
+         it->second.ModifiedTime == stamp.ModifiedTime)
+        {
+        return;
+        }
+      reported[path] = stamp;
+      newFiles.push_back(path);
+    }
+
+  /** report the new and changed files of the directory, and forget
+   *  the files that are gone, so that what is kept about the files
+   *  is no more than the directory holds */
+  void List(std::vector<std::string> &newFiles, bool waitForSize)
+    {
+      itksys::Directory directory;
+      directory.Load(this->m_Directory.c_str());
+      StampMap reported;
+      std::map<std::string,unsigned long> sizes;
+      for(unsigned long i = 0; i < directory.GetNumberOfFiles(); ++i)
+        {
+        const std::string name = directory.GetFile(i);
+        if(name == "." || name == "..")
+          {
+          continue;
+          }
+        const std::string path = this->m_Directory + "/" + name;
+        StampMap::const_iterator stamp = this->m_Reported.find(path);
+        if(stamp != this->m_Reported.end())
+          {
+          reported.insert(*stamp);
+          }
+        if(waitForSize)
+          {
+          // report a file once its size is the same on two listings
+          const unsigned long size =
+            itksys::SystemTools::FileLength(path.c_str());
+          std::map<std::string,unsigned long>::iterator it =
+            this->m_Sizes.find(path);
+          sizes[path] = size;
+          if(it == this->m_Sizes.end() || it->second != size)
+            {
+            continue;
+            }
+          }
+        this->Report(path,newFiles,false,reported);
+        }
+      this->m_Reported.swap(reported);
+      if(waitForSize)
+        {
+        this->m_Sizes.swap(sizes);
+        }
+    }
+
+  std::string                         m_Directory;
+  StampMap                            m_Reported;
+  std::map<std::string,unsigned long> m_Sizes;
+  bool                                m_FirstWait;
+  int                                 m_Inotify;
+};
+
+/** parse the header of a newly arrived file, and queue it with the
+ *  parsed header kept in memory, so its conversion doesn't parse the
+ *  header again */
+void
+AddFile(const std::string &fileName, double now,
+        DWIConvertSeriesQueue &queue)
+{
+  itk::DCMTKFileReader reader;
+  try
+    {
+    reader.SetFileName(fileName);
+    reader.LoadFile();
+    }
+  catch(...)
+    {
+    // not DICOM, or not readable
+    return;
+    }
+  std::string uid;
+  if(reader.GetElementUI(0x0020,0x000e,uid,false) != EXIT_SUCCESS)
+    {
+    return;
+    }
+  const long fileNumber = reader.GetFileNumber();
+  const bool isDiffusionWeighted = reader.IsDiffusionWeighted();
+  queue.Add(uid,fileName,fileNumber,isDiffusionWeighted,now,
+            reader.TakeDataset());
+}
+
+} // end anonymous namespace
+
+/** Watch a directory, and convert each DWI series written to it
+ *  once no file of it has arrived for settleTime seconds.  Headers
+ *  are parsed once, as the files arrive, and kept in memory until
+ *  their series is converted; the conversion finds them there, and
+ *  reads only the pixel data from the files.  The slice order and
+ *  gradient table are still worked out from the headers when the
+ *  series is converted.  Runs until idleExit seconds pass with no
+ *  new file and nothing left to convert, or forever if idleExit is 0.
+ */
+int
+DWIConvertWatch(int argc, char *argv[],
+                const std::string &directory,
+                double settleTime, double idleExit,
+                const std::string &journalName)
+{
+  if(settleTime < 0.0 || idleExit < 0.0)
+    {
+    std::cerr << "watchSettleTime and watchIdleExit must not be negative"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+  // the files stay in the directory, so a series can be read again
+  DWIConvertSeriesQueue queue(argc,argv,true);
+  if(queue.Open(journalName) != EXIT_SUCCESS)
+    {
+    return EXIT_FAILURE;
+    }
+  DirectoryWatcher watcher;
+  if(watcher.Start(directory) != EXIT_SUCCESS)
+    {
+    return EXIT_FAILURE;
+    }
+  DWIConvertLogInfo() << "Watching " << directory << std::endl;
+  // it may idle for a long time now
+  DWIConvertLog::Flush();
+
+  double lastActivity = itksys::SystemTools::GetTime();
+  for(;;)
+    {
+    std::vector<std::string> newFiles;
+    watcher.Wait(WatchInterval,newFiles);
+    double now = itksys::SystemTools::GetTime();
+    for(unsigned int i = 0; i < newFiles.size(); ++i)
+      {
+      AddFile(newFiles[i],now,queue);
+      }
+    if(!newFiles.empty())
+      {
+      lastActivity = now;
+      }
+    if(queue.ConvertReady(now,settleTime) > 0)
+      {
+      now = itksys::SystemTools::GetTime();
+      lastActivity = now;
+      }
+    if(idleExit > 0.0 && !queue.HasPending() && now - lastActivity >= idleExit)
+      {
+      break;
+      }
+    }
+  DWIConvertLogInfo() << queue.GetNumberOfConverted() << " series converted, "
+    << queue.GetNumberOfFailed() << " failed" << std::endl;
+  return queue.GetNumberOfFailed() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
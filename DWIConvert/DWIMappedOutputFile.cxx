@@ -0,0 +1,223 @@
+#include "DWIMappedOutputFile.h"
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#if !defined(_WIN32)
+namespace
+{
+/** Allocate the first size bytes of the file, so that writes through
+ *  a mapping of it can't fail for lack of space; returns 0, or the
+ *  error number. */
+int
+ReserveSpace(int fileDescriptor, size_t size)
+{
+#if defined(__APPLE__)
+  int rval = EOPNOTSUPP;
+#else
+  int rval = posix_fallocate(fileDescriptor, 0, static_cast<off_t>(size));
+#endif
+  if(rval != EINVAL && rval != EOPNOTSUPP)
+    {
+    return rval;
+    }
+  // the file system can't allocate without writing: write zeros
+  const size_t blockSize = 1024 * 1024;
+  char *zeros = static_cast<char *>(calloc(blockSize, 1));
+  if(zeros == 0)
+    {
+    return ENOMEM;
+    }
+  rval = 0;
+  for(size_t offset = 0; offset < size && rval == 0; )
+    {
+    const size_t count = size - offset < blockSize ? size - offset : blockSize;
+    const ssize_t written = pwrite(fileDescriptor, zeros, count,
+                                   static_cast<off_t>(offset));
+    if(written > 0)
+      {
+      offset += written;
+      }
+    else if(written < 0 && errno != EINTR)
+      {
+      rval = errno;
+      }
+    }
+  free(zeros);
+  return rval;
+}
+}
+#endif
+
+DWIMappedOutputFile
+::DWIMappedOutputFile() : m_Map(0),
+                          m_MapSize(0),
+                          m_Data(0),
+                          m_DataSize(0),
+#if defined(_WIN32)
+                          m_FileHandle(INVALID_HANDLE_VALUE),
+                          m_MappingHandle(0)
+#else
+                          m_FileDescriptor(-1)
+#endif
+{
+}
+
+DWIMappedOutputFile
+::~DWIMappedOutputFile()
+{
+  this->Close();
+}
+
+int
+DWIMappedOutputFile
+::Open(const std::string &fileName,
+       const std::string &header,
+       size_t dataSize)
+{
+  this->Close();
+  this->m_FileName = fileName;
+  this->m_MapSize = header.size() + dataSize;
+  if(this->m_MapSize == 0)
+    {
+    std::cerr << "Nothing to map for " << fileName << std::endl;
+    return EXIT_FAILURE;
+    }
+#if defined(_WIN32)
+  HANDLE file = CreateFileA(fileName.c_str(),
+                            GENERIC_READ | GENERIC_WRITE,
+                            0, 0, CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL, 0);
+  if(file == INVALID_HANDLE_VALUE)
+    {
+    std::cerr << "Can't create " << fileName << std::endl;
+    return EXIT_FAILURE;
+    }
+  this->m_FileHandle = file;
+  const unsigned long long mapSize = this->m_MapSize;
+  // sizing the file by mapping it allocates its clusters, and fails
+  // if the disk is full
+  HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READWRITE,
+                                      static_cast<DWORD>(mapSize >> 32),
+                                      static_cast<DWORD>(mapSize & 0xffffffff),
+                                      0);
+  if(mapping == 0)
+    {
+    std::cerr << "Can't map " << fileName << std::endl;
+    this->Close();
+    return EXIT_FAILURE;
+    }
+  this->m_MappingHandle = mapping;
+  this->m_Map = static_cast<char *>(MapViewOfFile(mapping, FILE_MAP_WRITE,
+                                                  0, 0, this->m_MapSize));
+  if(this->m_Map == 0)
+    {
+    std::cerr << "Can't map " << fileName << std::endl;
+    this->Close();
+    return EXIT_FAILURE;
+    }
+#else
+  this->m_FileDescriptor = open(fileName.c_str(),
+                                O_RDWR | O_CREAT | O_TRUNC, 0666);
+  if(this->m_FileDescriptor < 0)
+    {
+    std::cerr << "Can't create " << fileName << ": "
+              << strerror(errno) << std::endl;
+    return EXIT_FAILURE;
+    }
+  // size the file, with its blocks allocated rather than sparse, so
+  // that the whole data region can be mapped and written
+  const int reserveError = ReserveSpace(this->m_FileDescriptor,
+                                        this->m_MapSize);
+  if(reserveError != 0)
+    {
+    std::cerr << "Can't allocate " << this->m_MapSize << " bytes for "
+              << fileName << ": " << strerror(reserveError) << std::endl;
+    this->Close();
+    return EXIT_FAILURE;
+    }
+  void *map = mmap(0, this->m_MapSize, PROT_READ | PROT_WRITE,
+                   MAP_SHARED, this->m_FileDescriptor, 0);
+  if(map == MAP_FAILED)
+    {
+    std::cerr << "Can't map " << fileName << ": "
+              << strerror(errno) << std::endl;
+    this->Close();
+    return EXIT_FAILURE;
+    }
+  this->m_Map = static_cast<char *>(map);
+#endif
+  if(!header.empty())
+    {
+    memcpy(this->m_Map, header.data(), header.size());
+    }
+  this->m_Data = this->m_Map + header.size();
+  this->m_DataSize = dataSize;
+  return EXIT_SUCCESS;
+}
+
+int
+DWIMappedOutputFile
+::Close()
+{
+  int rval = EXIT_SUCCESS;
+#if defined(_WIN32)
+  if(this->m_Map != 0 &&
+     (!FlushViewOfFile(this->m_Map, 0) ||
+      !FlushFileBuffers(static_cast<HANDLE>(this->m_FileHandle))))
+    {
+    rval = EXIT_FAILURE;
+    }
+  if(this->m_Map != 0 && !UnmapViewOfFile(this->m_Map))
+    {
+    rval = EXIT_FAILURE;
+    }
+  if(this->m_MappingHandle != 0)
+    {
+    CloseHandle(static_cast<HANDLE>(this->m_MappingHandle));
+    this->m_MappingHandle = 0;
+    }
+  if(this->m_FileHandle != INVALID_HANDLE_VALUE)
+    {
+    CloseHandle(static_cast<HANDLE>(this->m_FileHandle));
+    this->m_FileHandle = INVALID_HANDLE_VALUE;
+    }
+#else
+  // write-back errors are only seen here
+  if(this->m_Map != 0 && msync(this->m_Map, this->m_MapSize, MS_SYNC) != 0)
+    {
+    std::cerr << "Can't write " << this->m_FileName << ": "
+              << strerror(errno) << std::endl;
+    rval = EXIT_FAILURE;
+    }
+  if(this->m_Map != 0 && munmap(this->m_Map, this->m_MapSize) != 0)
+    {
+    rval = EXIT_FAILURE;
+    }
+  if(this->m_FileDescriptor >= 0 && close(this->m_FileDescriptor) != 0)
+    {
+    rval = EXIT_FAILURE;
+    }
+  this->m_FileDescriptor = -1;
+#endif
+  if(rval != EXIT_SUCCESS)
+    {
+    std::cerr << "Error closing " << this->m_FileName << std::endl;
+    }
+  this->m_Map = 0;
+  this->m_MapSize = 0;
+  this->m_Data = 0;
+  this->m_DataSize = 0;
+  return rval;
+}
@@ -0,0 +1,53 @@
+#ifndef __DWIMappedOutputFile_h
+#define __DWIMappedOutputFile_h
+#include <string>
+#include <cstddef>
+
+/** \class DWIMappedOutputFile
+ *  Create an output file of a known size and map it into memory, so
+ *  that the voxel data can be assembled in place instead of in an
+ *  image buffer that is written afterwards.  An optional header is
+ *  copied to the beginning of the file, and GetData() points just
+ *  past it.  The file's space is reserved when it is opened, so that
+ *  a full disk or quota fails Open rather than killing the process
+ *  with SIGBUS when the mapping is written; Close waits for the data
+ *  to reach the disk and reports any write-back error.
+ */
+class DWIMappedOutputFile
+{
+public:
+  DWIMappedOutputFile();
+  ~DWIMappedOutputFile();
+
+  /** create fileName, write header into it, and map
+   *  header.size() + dataSize bytes */
+  int Open(const std::string &fileName,
+           const std::string &header,
+           size_t dataSize);
+
+  /** start of the data region, just past the header */
+  char *GetData() { return this->m_Data; }
+
+  size_t GetDataSize() const { return this->m_DataSize; }
+
+  /** flush the data to the disk, unmap and close the file */
+  int Close();
+
+private:
+  DWIMappedOutputFile(const DWIMappedOutputFile &); // not implemented
+  void operator=(const DWIMappedOutputFile &); // not implemented
+
+  std::string m_FileName;
+  char       *m_Map;
+  size_t      m_MapSize;
+  char       *m_Data;
+  size_t      m_DataSize;
+#if defined(_WIN32)
+  void       *m_FileHandle;
+  void       *m_MappingHandle;
+#else
+  int         m_FileDescriptor;
+#endif
+};
+
+#endif // __DWIMappedOutputFile_h
@@ -16,6 +16,7 @@
 
 #include <vcl_algorithm.h>
 
+#include "DWIConvertDigest.h"
 #include "DWICompareCLP.h"
 
 namespace
@@ -40,9 +41,19 @@ int DoIt( int argc, char * argv[], PixelType )
   typename FileReaderType::Pointer firstReader = FileReaderType::New();
   typename FileReaderType::Pointer secondReader = FileReaderType::New();
   firstReader->SetFileName( inputVolume1.c_str() );
-  firstReader->Update();
   secondReader->SetFileName( inputVolume2.c_str() );
-  secondReader->Update();
+  if(digestOnly)
+    {
+    // the header is all that is compared here; the voxels are
+    // compared by their digests
+    firstReader->UpdateOutputInformation();
+    secondReader->UpdateOutputInformation();
+    }
+  else
+    {
+    firstReader->Update();
+    secondReader->Update();
+    }
 
   typedef itk::MetaDataDictionary DictionaryType;
   const DictionaryType & firstDictionary = firstReader->GetMetaDataDictionary();
@@ -183,10 +194,11 @@ int DoIt( int argc, char * argv[], PixelType )
     {
     return EXIT_FAILURE;
     }
-  else
+  if(digestOnly)
     {
-    return EXIT_SUCCESS;
+    return DWIConvertCompareDigests(inputVolume1,inputVolume2,std::cout);
     }
+  return EXIT_SUCCESS;
 }
 
 void GetImageType(std::string fileName,
@@ -0,0 +1,360 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdlib>
+#include "itksys/SystemTools.hxx"
+#include "DWIConvertLib.h"
+#include "DWIConvertSyntheticSeries.h"
+#include "DWIConvertBenchmarksCLP.h"
+
+namespace
+{
+/** seconds spent in each phase of a conversion, by phase name;
+ *  "total" is the whole conversion */
+typedef std::map<std::string,double>     PhaseTimes;
+/** phase times by benchmark name */
+typedef std::map<std::string,PhaseTimes> BenchmarkTimes;
+
+bool
+BenchmarkSeries(const std::string &benchmark,
+                DWISyntheticSeriesParameters &parameters)
+{
+  parameters.Mosaic = parameters.MultiFrame = false;
+  if(benchmark == "GE")
+    {
+    parameters.Vendor = "GE";
+    }
+  else if(benchmark == "Siemens" || benchmark == "SiemensMosaic")
+    {
+    parameters.Vendor = "SIEMENS";
+    parameters.Mosaic = benchmark == "SiemensMosaic";
+    }
+  else if(benchmark == "Philips" || benchmark == "PhilipsMultiFrame")
+    {
+    parameters.Vendor = "PHILIPS";
+    parameters.MultiFrame = benchmark == "PhilipsMultiFrame";
+    }
+  else
+    {
+    return false;
+    }
+  return true;
+}
+
+DWISyntheticSeriesParameters::TransferSyntaxType
+TransferSyntax(const std::string &name)
+{
+  if(name == "implicitLittleEndian")
+    {
+    return DWISyntheticSeriesParameters::ImplicitLittleEndian;
+    }
+  if(name == "explicitBigEndian")
+    {
+    return DWISyntheticSeriesParameters::ExplicitBigEndian;
+    }
+  if(name == "rleLossless")
+    {
+    return DWISyntheticSeriesParameters::RLELossless;
+    }
+  if(name == "jpegLossless")
+    {
+    return DWISyntheticSeriesParameters::JPEGLossless;
+    }
+  return DWISyntheticSeriesParameters::ExplicitLittleEndian;
+}
+
+/** the value following "key": on a line of a profile report */
+bool
+ReportValue(const std::string &line, const std::string &key,
+            std::string &value)
+{
+  const std::string quotedKey = "\"" + key + "\": ";
+  std::string::size_type pos = line.find(quotedKey);
+  if(pos == std::string::npos)
+    {
+    return false;
+    }
+  pos += quotedKey.size();
+  if(line[pos] == '"')
+    {
+    ++pos;
+    value = line.substr(pos,line.find('"',pos) - pos);
+    }
+  else
+    {
+    value = line.substr(pos,line.find_first_of(",}",pos) - pos);
+    }
+  return true;
+}
+
+/** the wall time of each phase in a --profileReport report */
+int
+ReadProfileReport(const std::string &reportName, PhaseTimes &times)
+{
+  std::ifstream report(reportName.c_str());
+  if(!report.is_open())
+    {
+    std::cerr << "Can't read profile report " << reportName << std::endl;
+    return EXIT_FAILURE;
+    }
+  times.clear();
+  std::string line;
+  while(std::getline(report,line))
+    {
+    std::string name, wallTime;
+    if(!ReportValue(line,"wallTime",wallTime))
+      {
+      continue;
+      }
+    // the phases are one to a line; the total is on a line of its own
+    if(!ReportValue(line,"name",name))
+      {
+      name = "total";
+      }
+    times[name] = atof(wallTime.c_str());
+    }
+  if(times.find("total") == times.end())
+    {
+    std::cerr << "No timings in profile report " << reportName << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+
+/** Write the benchmark's series and convert it repetitions times;
+ *  fastest gets the fastest time of each phase. */
+int
+RunBenchmark(const std::string &benchmark,
+             const DWISyntheticSeriesParameters &parameters,
+             const std::string &scratchDirectory,
+             int repetitions,
+             PhaseTimes &fastest)
+{
+  const std::string directory = scratchDirectory + "/" + benchmark;
+  const std::string dicomDirectory = directory + "/dicom";
+  const std::string outputVolume = directory + "/" + benchmark + ".nrrd";
+  const std::string reportName = directory + "/" + benchmark + ".json";
+  itksys::SystemTools::RemoveADirectory(directory.c_str());
+  std::vector<std::string> fileNames;
+  if(WriteDWISyntheticSeries(dicomDirectory,parameters,fileNames) != EXIT_SUCCESS)
+    {
+    return EXIT_FAILURE;
+    }
+
+  fastest.clear();
+  for(int i = 0; i < repetitions; ++i)
+    {
+    const char *args[] = { "DWIConvert",
+                           "--inputDicomDirectory", dicomDirectory.c_str(),
+                           "--outputVolume", outputVolume.c_str(),
+                           "--profileReport", reportName.c_str() };
+    if(DWIConvertMain(7,const_cast<char **>(args)) != EXIT_SUCCESS)
+      {
+      std::cerr << "Conversion of the " << benchmark << " series failed"
+                << std::endl;
+      return EXIT_FAILURE;
+      }
+    PhaseTimes times;
+    if(ReadProfileReport(reportName,times) != EXIT_SUCCESS)
+      {
+      return EXIT_FAILURE;
+      }
+    for(PhaseTimes::const_iterator it = times.begin(); it != times.end(); ++it)
+      {
+      PhaseTimes::iterator best = fastest.find(it->first);
+      if(best == fastest.end() || it->second < best->second)
+        {
+        fastest[it->first] = it->second;
+        }
+      }
+    }
+  return EXIT_SUCCESS;
+}
+
+/** A baseline is a line describing the series it was measured with,
+ *  then a line per benchmark and phase:
+ *    configuration <matrix size> <slices> <gradients> <transfer syntax>
+ *    <benchmark> <phase> <seconds>
+ *  Lines starting with # are comments. */
+int
+ReadBaseline(const std::string &baselineName,
+             std::string &configuration,
+             BenchmarkTimes &baseline)
+{
+  std::ifstream baselineFile(baselineName.c_str());
+  if(!baselineFile.is_open())
+    {
+    std::cerr << "Can't read baseline " << baselineName << std::endl;
+    return EXIT_FAILURE;
+    }
+  std::string line;
+  while(std::getline(baselineFile,line))
+    {
+    if(line.empty() || line[0] == '#')
+      {
+      continue;
+      }
+    if(line.compare(0,14,"configuration ") == 0)
+      {
+      configuration = line.substr(14);
+      continue;
+      }
+    std::istringstream fields(line);
+    std::string benchmark, phase;
+    double seconds;
+    if(!(fields >> benchmark >> phase >> seconds))
+      {
+      std::cerr << "Bad line in baseline " << baselineName << ": "
+                << line << std::endl;
+      return EXIT_FAILURE;
+      }
+    baseline[benchmark][phase] = seconds;
+    }
+  return EXIT_SUCCESS;
+}
+
+int
+WriteBaseline(const std::string &baselineName,
+              const std::string &configuration,
+              const BenchmarkTimes &times)
+{
+  std::ofstream baselineFile(baselineName.c_str());
+  baselineFile << "# DWIConvertBenchmarks baseline: wall time of each phase, in seconds"
+               << std::endl
+               << "configuration " << configuration << std::endl;
+  for(BenchmarkTimes::const_iterator benchmark = times.begin();
+      benchmark != times.end(); ++benchmark)
+    {
+    for(PhaseTimes::const_iterator phase = benchmark->second.begin();
+        phase != benchmark->second.end(); ++phase)
+      {
+      baselineFile << benchmark->first << " " << phase->first << " "
+                   << phase->second << std::endl;
+      }
+    }
+  if(!baselineFile.good())
+    {
+    std::cerr << "Can't write baseline " << baselineName << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+}
+
+int main(int argc, char *argv[])
+{
+  PARSE_ARGS;
+
+  if(scratchDirectory == "")
+    {
+    std::cerr << "A scratch directory is required" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if(matrixSize < 1 || slicesPerVolume < 2 || gradients < 1 ||
+     repetitions < 1)
+    {
+    std::cerr << "The matrix size and gradients must be at least 1, "
+              << "and the slices per volume at least 2" << std::endl;
+    return EXIT_FAILURE;
+    }
+  std::ostringstream configurationStream;
+  configurationStream << matrixSize << " " << slicesPerVolume << " "
+                      << gradients << " " << transferSyntax;
+  const std::string configuration = configurationStream.str();
+
+  std::string baselineConfiguration;
+  BenchmarkTimes baselineTimes;
+  if(baseline != "")
+    {
+    if(ReadBaseline(baseline,baselineConfiguration,baselineTimes) != EXIT_SUCCESS)
+      {
+      return EXIT_FAILURE;
+      }
+    // times of a different series size mean nothing
+    if(baselineConfiguration != configuration)
+      {
+      std::cerr << "The baseline was measured with " << baselineConfiguration
+                << " (matrix size, slices, gradients, transfer syntax), "
+                << "not " << configuration << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+
+  DWISyntheticSeriesParameters parameters;
+  parameters.Rows = parameters.Columns = matrixSize;
+  parameters.SlicesPerVolume = slicesPerVolume;
+  parameters.Baselines = 1;
+  parameters.Gradients = gradients;
+  parameters.TransferSyntax = TransferSyntax(transferSyntax);
+
+  BenchmarkTimes times;
+  int result = EXIT_SUCCESS;
+  for(unsigned int i = 0; i < benchmarks.size(); ++i)
+    {
+    if(!BenchmarkSeries(benchmarks[i],parameters))
+      {
+      std::cerr << "Unknown benchmark " << benchmarks[i] << std::endl;
+      return EXIT_FAILURE;
+      }
+    if(parameters.MultiFrame &&
+       parameters.TransferSyntax == DWISyntheticSeriesParameters::ImplicitLittleEndian)
+      {
+      std::cout << "Skipping " << benchmarks[i] << " with implicit VR" << std::endl;
+      continue;
+      }
+    if(RunBenchmark(benchmarks[i],parameters,scratchDirectory,repetitions,
+                    times[benchmarks[i]]) != EXIT_SUCCESS)
+      {
+      return EXIT_FAILURE;
+      }
+    }
+
+  std::cout << std::endl << "Fastest of " << repetitions
+            << " conversions, in seconds" << std::endl
+            << std::left << std::setw(20) << "benchmark"
+            << std::setw(24) << "phase"
+            << std::right << std::setw(12) << "time"
+            << std::setw(12) << "baseline"
+            << std::setw(8) << "ratio" << std::endl;
+  for(BenchmarkTimes::const_iterator benchmark = times.begin();
+      benchmark != times.end(); ++benchmark)
+    {
+    const PhaseTimes &baselinePhases = baselineTimes[benchmark->first];
+    for(PhaseTimes::const_iterator phase = benchmark->second.begin();
+        phase != benchmark->second.end(); ++phase)
+      {
+      std::cout << std::left << std::setw(20) << benchmark->first
+                << std::setw(24) << phase->first
+                << std::right << std::fixed << std::setprecision(4)
+                << std::setw(12) << phase->second;
+      PhaseTimes::const_iterator baselinePhase =
+        baselinePhases.find(phase->first);
+      if(baselinePhase == baselinePhases.end())
+        {
+        std::cout << std::endl;
+        continue;
+        }
+      const double ratio = baselinePhase->second > 0.0 ?
+        phase->second / baselinePhase->second : 1.0;
+      std::cout << std::setw(12) << baselinePhase->second
+                << std::setprecision(2) << std::setw(8) << ratio;
+      if(ratio > tolerance && baselinePhase->second >= minimumTime)
+        {
+        std::cout << "  SLOWER";
+        result = EXIT_FAILURE;
+        }
+      std::cout << std::endl;
+      }
+    }
+
+  if(outputBaseline != "" &&
+     WriteBaseline(outputBaseline,configuration,times) != EXIT_SUCCESS)
+    {
+    return EXIT_FAILURE;
+    }
+  return result;
+}
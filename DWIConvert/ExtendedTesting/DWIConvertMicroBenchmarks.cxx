@@ -0,0 +1,359 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include "itkImage.h"
+#include "itkVectorImage.h"
+#include "itksys/SystemTools.hxx"
+#include "DWIConvertSyntheticSeries.h"
+
+typedef itk::Image<short,3>       Volume3DType;
+typedef itk::Image<short,4>       Volume4DType;
+typedef itk::VectorImage<short,3> VectorVolumeType;
+
+// the kernels, from DWIConvert.cxx and NrrdToFSL.cxx
+extern unsigned int
+ExtractSiemensDiffusionInformation(const std::string tagString,
+                                   const std::string nameString,
+                                   std::vector<double>& valueArray);
+extern void DeInterleaveVolume(Volume3DType::Pointer &volume,
+                               size_t SlicesPerVolume,
+                               size_t NSlices);
+extern void DeMosaicSlice(Volume3DType *img,
+                          unsigned int mosaicIndex,
+                          unsigned int sliceIndex,
+                          unsigned int mMosaic,
+                          Volume3DType *dmImage,
+                          unsigned int dmSliceIndex);
+extern Volume4DType::Pointer CreateVolume(VectorVolumeType::Pointer &inputVol);
+extern void VectorImageToVolumes(VectorVolumeType::Pointer &inputVol,
+                                 Volume4DType::Pointer &niftiVolume);
+
+namespace
+{
+/** a DWI series of the given size, the way a kernel sees it */
+struct SeriesSize
+{
+  const char   *Name;
+  unsigned int  Matrix;
+  unsigned int  Slices;
+  unsigned int  Volumes;
+};
+
+const SeriesSize SeriesSizes[] =
+  {
+    { "64x64x30x7",    64, 30,  7 },
+    { "128x128x48x31", 128, 48, 31 },
+    { "256x256x60x33", 256, 60, 33 },
+  };
+const unsigned int NumberOfSeriesSizes =
+  sizeof(SeriesSizes) / sizeof(SeriesSizes[0]);
+
+/** a kernel, set up on one input, run as often as it takes to time it */
+class Kernel
+{
+public:
+  virtual ~Kernel() {}
+  virtual void Run() = 0;
+  /** bytes and items processed by one run */
+  virtual double Bytes() const = 0;
+  virtual double Items() const = 0;
+};
+
+/** Run kernel until at least minimumTime seconds have passed, and
+ *  report the time a run takes and the throughput. */
+void
+Measure(const std::string &kernelName, const std::string &inputName,
+        Kernel &kernel, double minimumTime)
+{
+  // once untimed, to touch the memory
+  kernel.Run();
+  unsigned long runs = 0;
+  const double start = itksys::SystemTools::GetTime();
+  double elapsed = 0.0;
+  do
+    {
+    kernel.Run();
+    ++runs;
+    elapsed = itksys::SystemTools::GetTime() - start;
+    } while(elapsed < minimumTime);
+
+  const double perRun = elapsed / runs;
+  std::cout << std::left << std::setw(14) << kernelName
+            << std::setw(16) << inputName
+            << std::right << std::fixed
+            << std::setw(8) << runs
+            << std::setprecision(3) << std::setw(14) << perRun * 1.0e3
+            << std::setprecision(1) << std::setw(12)
+            << kernel.Bytes() / perRun / (1024.0 * 1024.0)
+            << std::setprecision(0) << std::setw(14)
+            << kernel.Items() / perRun << std::endl;
+}
+
+Volume3DType::Pointer
+NewVolume(unsigned int x, unsigned int y, unsigned int z)
+{
+  Volume3DType::SizeType size;
+  size[0] = x;
+  size[1] = y;
+  size[2] = z;
+  Volume3DType::Pointer volume = Volume3DType::New();
+  volume->SetRegions(size);
+  volume->Allocate();
+  short *pixels = volume->GetBufferPointer();
+  const size_t nPixels = volume->GetBufferedRegion().GetNumberOfPixels();
+  for(size_t i = 0; i < nPixels; ++i)
+    {
+    pixels[i] = static_cast<short>(i % 1000);
+    }
+  return volume;
+}
+
+/** Look up the diffusion elements of a CSA header holding nFiller
+ *  other elements before them, as real headers hold about a hundred */
+class CSAKernel : public Kernel
+{
+public:
+  explicit CSAKernel(unsigned int nFiller)
+    {
+      std::vector<DWISyntheticCSAElement> elements;
+      for(unsigned int i = 0; i < nFiller; ++i)
+        {
+        std::ostringstream name;
+        name << "Filler" << i;
+        elements.push_back(DWISyntheticCSAElement(name.str().c_str(),"DS"));
+        // most elements have 6 items, mostly empty
+        elements.back().Values.resize(6);
+        elements.back().Values[0] = "1.5";
+        }
+      elements.push_back(DWISyntheticCSAElement("NumberOfImagesInMosaic","US"));
+      elements.back().Values.push_back("60");
+      elements.push_back(DWISyntheticCSAElement("SliceNormalVector","FD"));
+      elements.back().Values.push_back("0");
+      elements.back().Values.push_back("0");
+      elements.back().Values.push_back("1");
+      elements.push_back(DWISyntheticCSAElement("B_value","IS"));
+      elements.back().Values.push_back("1000");
+      elements.push_back(DWISyntheticCSAElement("DiffusionGradientDirection","FD"));
+      elements.back().Values.push_back("0.26726124");
+      elements.back().Values.push_back("0.53452248");
+      elements.back().Values.push_back("0.80178373");
+      this->m_Header = DWISyntheticCSAHeader(elements);
+    }
+  /** the lookups DWIConvert makes for each volume of a mosaic */
+  virtual void Run()
+    {
+      std::vector<double> values;
+      ExtractSiemensDiffusionInformation(this->m_Header,"B_value",values);
+      ExtractSiemensDiffusionInformation(this->m_Header,"B_value",values);
+      ExtractSiemensDiffusionInformation(this->m_Header,
+                                         "DiffusionGradientDirection",values);
+      if(values.size() != 5)
+        {
+        std::cerr << "CSA header parsed wrong" << std::endl;
+        exit(EXIT_FAILURE);
+        }
+    }
+  virtual double Bytes() const { return this->m_Header.size(); }
+  /** one header */
+  virtual double Items() const { return 1.0; }
+private:
+  std::string m_Header;
+};
+
+/** Reorder a slice-interleaved series volume by volume */
+class DeInterleaveKernel : public Kernel
+{
+public:
+  explicit DeInterleaveKernel(const SeriesSize &size) :
+    m_Size(size),
+    m_Volume(NewVolume(size.Matrix,size.Matrix,size.Slices * size.Volumes)) {}
+  virtual void Run()
+    {
+      DeInterleaveVolume(this->m_Volume,this->m_Size.Slices,
+                         this->m_Size.Slices * this->m_Size.Volumes);
+    }
+  virtual double Bytes() const
+    {
+      return this->m_Volume->GetBufferedRegion().GetNumberOfPixels() * sizeof(short);
+    }
+  /** slices */
+  virtual double Items() const
+    {
+      return this->m_Size.Slices * this->m_Size.Volumes;
+    }
+private:
+  SeriesSize            m_Size;
+  Volume3DType::Pointer m_Volume;
+};
+
+/** Split each volume's mosaic into its slices, as the Siemens mosaic
+ *  path of DWIConvert does for the whole series */
+class DeMosaicKernel : public Kernel
+{
+public:
+  explicit DeMosaicKernel(const SeriesSize &size) :
+    m_Size(size),
+    m_MMosaic(static_cast<unsigned int>(std::ceil(std::sqrt(static_cast<double>(size.Slices))))),
+    m_Mosaic(NewVolume(m_MMosaic * size.Matrix,m_MMosaic * size.Matrix,size.Volumes)),
+    m_Slices(NewVolume(size.Matrix,size.Matrix,size.Slices * size.Volumes)) {}
+  virtual void Run()
+    {
+      for(unsigned int volume = 0; volume < this->m_Size.Volumes; ++volume)
+        {
+        for(unsigned int slice = 0; slice < this->m_Size.Slices; ++slice)
+          {
+          DeMosaicSlice(this->m_Mosaic,volume,slice,this->m_MMosaic,
+                        this->m_Slices,volume * this->m_Size.Slices + slice);
+          }
+        }
+    }
+  /** the slices copied out */
+  virtual double Bytes() const
+    {
+      return this->m_Slices->GetBufferedRegion().GetNumberOfPixels() * sizeof(short);
+    }
+  /** slices */
+  virtual double Items() const
+    {
+      return this->m_Size.Slices * this->m_Size.Volumes;
+    }
+private:
+  SeriesSize            m_Size;
+  unsigned int          m_MMosaic;
+  Volume3DType::Pointer m_Mosaic;
+  Volume3DType::Pointer m_Slices;
+};
+
+/** Turn a DWI vector image into the 4D volume NrrdToFSL writes */
+class TransposeKernel : public Kernel
+{
+public:
+  explicit TransposeKernel(const SeriesSize &size)
+    {
+      VectorVolumeType::SizeType volumeSize;
+      volumeSize[0] = volumeSize[1] = size.Matrix;
+      volumeSize[2] = size.Slices;
+      this->m_Vector = VectorVolumeType::New();
+      this->m_Vector->SetRegions(volumeSize);
+      this->m_Vector->SetVectorLength(size.Volumes);
+      this->m_Vector->Allocate();
+      short *pixels = this->m_Vector->GetBufferPointer();
+      const size_t nPixels =
+        this->m_Vector->GetBufferedRegion().GetNumberOfPixels() * size.Volumes;
+      for(size_t i = 0; i < nPixels; ++i)
+        {
+        pixels[i] = static_cast<short>(i % 1000);
+        }
+      this->m_Volumes = CreateVolume(this->m_Vector);
+    }
+  virtual void Run()
+    {
+      VectorImageToVolumes(this->m_Vector,this->m_Volumes);
+    }
+  virtual double Bytes() const
+    {
+      return this->m_Volumes->GetBufferedRegion().GetNumberOfPixels() * sizeof(short);
+    }
+  /** voxels */
+  virtual double Items() const
+    {
+      return this->m_Volumes->GetBufferedRegion().GetNumberOfPixels();
+    }
+private:
+  VectorVolumeType::Pointer m_Vector;
+  Volume4DType::Pointer     m_Volumes;
+};
+
+bool
+Selected(const std::vector<std::string> &kernels, const std::string &kernel)
+{
+  if(kernels.empty())
+    {
+    return true;
+    }
+  for(unsigned int i = 0; i < kernels.size(); ++i)
+    {
+    if(kernels[i] == kernel)
+      {
+      return true;
+      }
+    }
+  return false;
+}
+}
+
+/** Time the inner loops of a conversion on in-memory inputs of
+ *  several sizes, without any file I/O, so that work on one of them
+ *  can be measured on its own.
+ */
+int main(int argc, char *argv[])
+{
+  double minimumTime = 0.5;
+  std::vector<std::string> kernels;
+  for(int i = 1; i < argc; ++i)
+    {
+    const std::string arg(argv[i]);
+    if(arg == "--minimumTime" && i + 1 < argc)
+      {
+      minimumTime = atof(argv[++i]);
+      }
+    else if(arg == "csa" || arg == "deinterleave" ||
+            arg == "demosaic" || arg == "transpose")
+      {
+      kernels.push_back(arg);
+      }
+    else
+      {
+      std::cerr << "Usage: " << argv[0]
+                << " [--minimumTime seconds] [csa] [deinterleave] [demosaic] [transpose]"
+                << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+
+  std::cout << std::left << std::setw(14) << "kernel"
+            << std::setw(16) << "input"
+            << std::right << std::setw(8) << "runs"
+            << std::setw(14) << "ms/run"
+            << std::setw(12) << "MB/s"
+            << std::setw(14) << "items/s" << std::endl;
+
+  if(Selected(kernels,"csa"))
+    {
+    // items are headers
+    const unsigned int fillers[] = { 10, 100, 400 };
+    for(unsigned int i = 0; i < 3; ++i)
+      {
+      CSAKernel kernel(fillers[i]);
+      std::ostringstream name;
+      name << fillers[i] + 4 << " elements";
+      Measure("csa",name.str(),kernel,minimumTime);
+      }
+    }
+  for(unsigned int i = 0; i < NumberOfSeriesSizes; ++i)
+    {
+    const SeriesSize &size = SeriesSizes[i];
+    // items are slices
+    if(Selected(kernels,"deinterleave"))
+      {
+      DeInterleaveKernel kernel(size);
+      Measure("deinterleave",size.Name,kernel,minimumTime);
+      }
+    if(Selected(kernels,"demosaic"))
+      {
+      DeMosaicKernel kernel(size);
+      Measure("demosaic",size.Name,kernel,minimumTime);
+      }
+    // items are voxels
+    if(Selected(kernels,"transpose"))
+      {
+      TransposeKernel kernel(size);
+      Measure("transpose",size.Name,kernel,minimumTime);
+      }
+    }
+  return EXIT_SUCCESS;
+}
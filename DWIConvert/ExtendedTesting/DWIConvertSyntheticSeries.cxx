@@ -0,0 +1,586 @@
+#include "DWIConvertSyntheticSeries.h"
+#include <iostream>
+#include <sstream>
+#include <cmath>
+#include <cstdlib>
+#include "itksys/SystemTools.hxx"
+
+#include "dcmtk/config/osconfig.h" // make sure OS specific configuration is included first
+#include "dcmtk/dcmdata/dcfilefo.h"
+#include "dcmtk/dcmdata/dcdeftag.h"
+#include "dcmtk/dcmdata/dcuid.h"
+#include "dcmtk/dcmdata/dcrleerg.h"  /* for DcmRLEEncoderRegistration */
+#include "dcmtk/dcmjpeg/djencode.h"  /* for DJEncoderRegistration */
+
+namespace
+{
+std::string
+DecimalString(double value)
+{
+  std::ostringstream s;
+  s.precision(8);
+  s << value;
+  return s.str();
+}
+
+/** unit vectors spread evenly over the sphere, on a golden spiral */
+void
+GradientDirection(unsigned int k, unsigned int nGradients, double *direction)
+{
+  const double z = 1.0 - (2.0 * k + 1.0) / nGradients;
+  const double r = std::sqrt(1.0 - z * z);
+  const double phi = k * 2.39996322972865332;
+  direction[0] = r * std::cos(phi);
+  direction[1] = r * std::sin(phi);
+  direction[2] = z;
+}
+
+/** the b-value and gradient of a volume; the baselines come first */
+void
+VolumeDiffusion(const DWISyntheticSeriesParameters &parameters,
+                unsigned int volume, double &bValue, double *gradient)
+{
+  gradient[0] = gradient[1] = gradient[2] = 0.0;
+  bValue = 0.0;
+  if(volume >= parameters.Baselines)
+    {
+    GradientDirection(volume - parameters.Baselines,parameters.Gradients,
+                      gradient);
+    bValue = parameters.BValue;
+    }
+}
+
+/** the attributes every file of the series shares; rows and columns
+ *  are those of the stored image, i.e. of the whole mosaic */
+void
+PutCommonAttributes(DcmDataset *dataset,
+                    unsigned int rows, unsigned int columns,
+                    const std::string &studyUID,
+                    const std::string &seriesUID)
+{
+  char uid[100];
+  dataset->putAndInsertString(DCM_SOPClassUID,UID_MRImageStorage);
+  dataset->putAndInsertString(DCM_SOPInstanceUID,
+                              dcmGenerateUniqueIdentifier(uid,SITE_INSTANCE_UID_ROOT));
+  dataset->putAndInsertString(DCM_StudyInstanceUID,studyUID.c_str());
+  dataset->putAndInsertString(DCM_SeriesInstanceUID,seriesUID.c_str());
+  dataset->putAndInsertString(DCM_Modality,"MR");
+  dataset->putAndInsertString(DCM_ImageType,"ORIGINAL\\PRIMARY\\OTHER");
+  dataset->putAndInsertString(DCM_SeriesNumber,"1");
+  dataset->putAndInsertString(DCM_SeriesDescription,"synthetic DWI");
+  dataset->putAndInsertUint16(DCM_SamplesPerPixel,1);
+  dataset->putAndInsertString(DCM_PhotometricInterpretation,"MONOCHROME2");
+  dataset->putAndInsertUint16(DCM_Rows,rows);
+  dataset->putAndInsertUint16(DCM_Columns,columns);
+  dataset->putAndInsertUint16(DCM_BitsAllocated,16);
+  dataset->putAndInsertUint16(DCM_BitsStored,16);
+  dataset->putAndInsertUint16(DCM_HighBit,15);
+  dataset->putAndInsertUint16(DCM_PixelRepresentation,1);
+}
+
+void
+PutInstanceNumber(DcmDataset *dataset, unsigned int instanceNumber)
+{
+  std::ostringstream number;
+  number << instanceNumber;
+  dataset->putAndInsertString(DCM_InstanceNumber,number.str().c_str());
+}
+
+/** axial slices, 2mm apart */
+std::string
+SlicePosition(unsigned int slice)
+{
+  return "0\\0\\" + DecimalString(2.0 * slice);
+}
+
+/** orientation, spacing and position of a file holding one slice, or
+ *  the first slice of a mosaic */
+void
+PutSliceGeometry(DcmItem *item, unsigned int slice)
+{
+  item->putAndInsertString(DCM_ImageOrientationPatient,"1\\0\\0\\0\\1\\0");
+  item->putAndInsertString(DCM_PixelSpacing,"2\\2");
+  item->putAndInsertString(DCM_SliceThickness,"2");
+  item->putAndInsertString(DCM_SpacingBetweenSlices,"2");
+  item->putAndInsertString(DCM_ImagePositionPatient,
+                           SlicePosition(slice).c_str());
+  item->putAndInsertString(DCM_SliceLocation,
+                           DecimalString(2.0 * slice).c_str());
+}
+
+/** pixels of one slice */
+void
+SlicePixels(const DWISyntheticSeriesParameters &parameters,
+            unsigned int slice, unsigned int volume,
+            Sint16 *pixels, unsigned int rowStride)
+{
+  for(unsigned int y = 0; y < parameters.Rows; ++y)
+    {
+    for(unsigned int x = 0; x < parameters.Columns; ++x)
+      {
+      pixels[y * rowStride + x] =
+        static_cast<Sint16>((x + 3 * y + 7 * slice + 11 * volume) % 1000);
+      }
+    }
+}
+
+void
+PutPixelData(DcmDataset *dataset, std::vector<Sint16> &pixels)
+{
+  dataset->putAndInsertUint16Array(DCM_PixelData,
+                                   reinterpret_cast<Uint16 *>(&pixels[0]),
+                                   pixels.size());
+}
+
+/** GE writes one slice per file, volume by volume, with the b-value
+ *  in 0043,1039 and the gradient in 0019,10bb-10bd */
+void
+PutGEDiffusion(DcmDataset *dataset, double bValue, const double *gradient)
+{
+  dataset->putAndInsertString(DCM_Manufacturer,"GE MEDICAL SYSTEMS");
+  dataset->putAndInsertString(DcmTag(0x0019,0x0010,EVR_LO),"GEMS_ACQU_01");
+  dataset->putAndInsertString(DcmTag(0x0019,0x10bb,EVR_DS),
+                              DecimalString(gradient[0]).c_str());
+  dataset->putAndInsertString(DcmTag(0x0019,0x10bc,EVR_DS),
+                              DecimalString(gradient[1]).c_str());
+  dataset->putAndInsertString(DcmTag(0x0019,0x10bd,EVR_DS),
+                              DecimalString(gradient[2]).c_str());
+  dataset->putAndInsertString(DcmTag(0x0043,0x0010,EVR_LO),"GEMS_PARM_01");
+  // GE appends three more values to the b-value
+  std::ostringstream b;
+  b << static_cast<int>(bValue) << "\\8\\0\\0";
+  dataset->putAndInsertString(DcmTag(0x0043,0x1039,EVR_IS),b.str().c_str());
+}
+
+/** CSA headers are little-endian whatever the transfer syntax */
+void
+AppendCSAInteger(std::string &csa, Uint32 value)
+{
+  for(unsigned int i = 0; i < 4; ++i)
+    {
+    csa += static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+}
+
+/** Siemens keeps the diffusion information in the CSA image header,
+ *  0029,1010, and repeats the b-value and gradient in 0019,100c and
+ *  0019,100e; a b = 0 volume has no gradient */
+void
+PutSiemensDiffusion(DcmDataset *dataset,
+                    const DWISyntheticSeriesParameters &parameters,
+                    double bValue, const double *gradient)
+{
+  dataset->putAndInsertString(DCM_Manufacturer,"SIEMENS");
+  dataset->putAndInsertString(DCM_ImageType,
+                              parameters.Mosaic ?
+                              "ORIGINAL\\PRIMARY\\DIFFUSION\\NONE\\ND\\MOSAIC" :
+                              "ORIGINAL\\PRIMARY\\DIFFUSION\\NONE\\ND");
+  std::ostringstream b;
+  b << static_cast<int>(bValue);
+  std::string gradientString;
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    gradientString += (i == 0 ? "" : "\\") + DecimalString(gradient[i]);
+    }
+
+  dataset->putAndInsertString(DcmTag(0x0019,0x0010,EVR_LO),"SIEMENS MR HEADER");
+  if(parameters.Mosaic)
+    {
+    dataset->putAndInsertUint16(DcmTag(0x0019,0x100a,EVR_US),
+                                parameters.SlicesPerVolume);
+    }
+  dataset->putAndInsertString(DcmTag(0x0019,0x100c,EVR_IS),b.str().c_str());
+  if(bValue != 0.0)
+    {
+    dataset->putAndInsertString(DcmTag(0x0019,0x100e,EVR_FD),
+                                gradientString.c_str());
+    }
+
+  std::vector<DWISyntheticCSAElement> elements;
+  if(parameters.Mosaic)
+    {
+    std::ostringstream nImages;
+    nImages << parameters.SlicesPerVolume;
+    elements.push_back(DWISyntheticCSAElement("NumberOfImagesInMosaic","US"));
+    elements.back().Values.push_back(nImages.str());
+    }
+  // the slices ascend, i.e. the order is inferior to superior
+  elements.push_back(DWISyntheticCSAElement("SliceNormalVector","FD"));
+  elements.back().Values.push_back("0");
+  elements.back().Values.push_back("0");
+  elements.back().Values.push_back("1");
+  elements.push_back(DWISyntheticCSAElement("B_value","IS"));
+  elements.back().Values.push_back(b.str());
+  if(bValue != 0.0)
+    {
+    elements.push_back(DWISyntheticCSAElement("DiffusionGradientDirection","FD"));
+    for(unsigned int i = 0; i < 3; ++i)
+      {
+      elements.back().Values.push_back(DecimalString(gradient[i]));
+      }
+    }
+  const std::string csa = DWISyntheticCSAHeader(elements);
+  dataset->putAndInsertString(DcmTag(0x0029,0x0010,EVR_LO),"SIEMENS CSA HEADER");
+  dataset->putAndInsertUint8Array(DcmTag(0x0029,0x1010,EVR_OB),
+                                  reinterpret_cast<const Uint8 *>(csa.data()),
+                                  csa.size());
+}
+
+/** Philips classic files carry the b-value in 2001,1003 and the
+ *  gradient in 2005,10b0-10b2; 2001,1004 is "I" only for the
+ *  isotropic trace image, which isn't written */
+void
+PutPhilipsDiffusion(DcmDataset *dataset, double bValue, const double *gradient)
+{
+  dataset->putAndInsertString(DCM_Manufacturer,"Philips Medical Systems");
+  dataset->putAndInsertString(DcmTag(0x2001,0x0010,EVR_LO),"Philips Imaging DD 001");
+  dataset->putAndInsertFloat32(DcmTag(0x2001,0x1003,EVR_FL),
+                               static_cast<Float32>(bValue));
+  dataset->putAndInsertString(DcmTag(0x2001,0x1004,EVR_CS),"O");
+  dataset->putAndInsertString(DcmTag(0x2005,0x0010,EVR_LO),"Philips MR Imaging DD 001");
+  dataset->putAndInsertFloat32(DcmTag(0x2005,0x10b0,EVR_FL),
+                               static_cast<Float32>(gradient[0]));
+  dataset->putAndInsertFloat32(DcmTag(0x2005,0x10b1,EVR_FL),
+                               static_cast<Float32>(gradient[1]));
+  dataset->putAndInsertFloat32(DcmTag(0x2005,0x10b2,EVR_FL),
+                               static_cast<Float32>(gradient[2]));
+}
+
+/** DWIConvert takes the b-value and gradient of an enhanced file as
+ *  decimal strings or raw doubles, the way the Philips exports it was
+ *  written against carry them; they're written as raw doubles */
+void
+PutRawDoubles(DcmItem *item, const DcmTagKey &key,
+              const double *values, unsigned int count)
+{
+  item->putAndInsertUint8Array(DcmTag(key,EVR_OB),
+                               reinterpret_cast<const Uint8 *>(values),
+                               count * sizeof(double));
+}
+
+/** the per-frame functional groups of one frame of an enhanced file:
+ *  plane position, 0020,9113, and MR diffusion, 0018,9117 */
+void
+PutEnhancedFrame(DcmItem *frame, unsigned int slice,
+                 double bValue, const double *gradient)
+{
+  DcmItem *position = 0;
+  frame->findOrCreateSequenceItem(DcmTag(0x0020,0x9113),position);
+  position->putAndInsertString(DCM_ImagePositionPatient,
+                               SlicePosition(slice).c_str());
+
+  DcmItem *diffusion = 0;
+  frame->findOrCreateSequenceItem(DcmTag(0x0018,0x9117),diffusion);
+  diffusion->putAndInsertString(DcmTag(0x0018,0x9075,EVR_CS),
+                                bValue == 0.0 ? "NONE" : "DIRECTIONAL");
+  PutRawDoubles(diffusion,DcmTagKey(0x0018,0x9087),&bValue,1);
+  if(bValue != 0.0)
+    {
+    DcmItem *direction = 0;
+    diffusion->findOrCreateSequenceItem(DcmTag(0x0018,0x9076),direction);
+    PutRawDoubles(direction,DcmTagKey(0x0018,0x9089),gradient,3);
+    }
+}
+
+/** the DCMTK encoders for the compressed transfer syntaxes, for as
+ *  long as a series is written */
+class EncoderRegistration
+{
+public:
+  EncoderRegistration()
+    {
+      DJEncoderRegistration::registerCodecs();
+      DcmRLEEncoderRegistration::registerCodecs();
+    }
+  ~EncoderRegistration()
+    {
+      DJEncoderRegistration::cleanup();
+      DcmRLEEncoderRegistration::cleanup();
+    }
+};
+
+E_TransferSyntax
+DcmTransferSyntax(DWISyntheticSeriesParameters::TransferSyntaxType syntax)
+{
+  switch(syntax)
+    {
+    case DWISyntheticSeriesParameters::ImplicitLittleEndian:
+      return EXS_LittleEndianImplicit;
+    case DWISyntheticSeriesParameters::ExplicitBigEndian:
+      return EXS_BigEndianExplicit;
+    case DWISyntheticSeriesParameters::RLELossless:
+      return EXS_RLELossless;
+    case DWISyntheticSeriesParameters::JPEGLossless:
+      return EXS_JPEGProcess14SV1;
+    default:
+      return EXS_LittleEndianExplicit;
+    }
+}
+
+int
+SaveFile(DcmFileFormat &fileFormat,
+         const DWISyntheticSeriesParameters &parameters,
+         const std::string &directory, unsigned int instanceNumber,
+         std::vector<std::string> &fileNames)
+{
+  std::ostringstream fileName;
+  fileName << directory << "/IM" << instanceNumber << ".dcm";
+  const E_TransferSyntax xfer = DcmTransferSyntax(parameters.TransferSyntax);
+  // encodes the pixel data for the compressed syntaxes
+  OFCondition cond = fileFormat.getDataset()->chooseRepresentation(xfer,0);
+  if(cond.good())
+    {
+    cond = fileFormat.saveFile(fileName.str().c_str(),xfer);
+    }
+  if(cond.bad())
+    {
+    std::cerr << "Can't write " << fileName.str() << ": "
+              << cond.text() << std::endl;
+    return EXIT_FAILURE;
+    }
+  fileNames.push_back(fileName.str());
+  return EXIT_SUCCESS;
+}
+
+/** GE, Siemens without mosaic and Philips classic: one slice per
+ *  file, ordered volume by volume, or for Philips slice by slice */
+int
+WriteSliceFiles(const std::string &directory,
+                const DWISyntheticSeriesParameters &parameters,
+                const std::string &studyUID, const std::string &seriesUID,
+                std::vector<std::string> &fileNames)
+{
+  const unsigned int nVolumes = parameters.Baselines + parameters.Gradients;
+  const bool sliceInterleaved = parameters.Vendor == "PHILIPS";
+  const unsigned int nOuter =
+    sliceInterleaved ? parameters.SlicesPerVolume : nVolumes;
+  const unsigned int nInner =
+    sliceInterleaved ? nVolumes : parameters.SlicesPerVolume;
+  unsigned int instanceNumber = 0;
+  for(unsigned int outer = 0; outer < nOuter; ++outer)
+    {
+    for(unsigned int inner = 0; inner < nInner; ++inner)
+      {
+      const unsigned int volume = sliceInterleaved ? inner : outer;
+      const unsigned int slice = sliceInterleaved ? outer : inner;
+      double gradient[3];
+      double bValue;
+      VolumeDiffusion(parameters,volume,bValue,gradient);
+
+      ++instanceNumber;
+      DcmFileFormat fileFormat;
+      DcmDataset *dataset = fileFormat.getDataset();
+      PutCommonAttributes(dataset,parameters.Rows,parameters.Columns,
+                          studyUID,seriesUID);
+      PutInstanceNumber(dataset,instanceNumber);
+      PutSliceGeometry(dataset,slice);
+      if(parameters.Vendor == "GE")
+        {
+        PutGEDiffusion(dataset,bValue,gradient);
+        }
+      else if(parameters.Vendor == "SIEMENS")
+        {
+        PutSiemensDiffusion(dataset,parameters,bValue,gradient);
+        }
+      else
+        {
+        PutPhilipsDiffusion(dataset,bValue,gradient);
+        }
+      std::vector<Sint16> pixels(parameters.Rows * parameters.Columns);
+      SlicePixels(parameters,slice,volume,&pixels[0],parameters.Columns);
+      PutPixelData(dataset,pixels);
+      if(SaveFile(fileFormat,parameters,directory,instanceNumber,
+                  fileNames) != EXIT_SUCCESS)
+        {
+        return EXIT_FAILURE;
+        }
+      }
+    }
+  return EXIT_SUCCESS;
+}
+
+/** Siemens mosaic: one file per volume, its slices tiled row by row
+ *  into a square grid big enough to hold them all */
+int
+WriteMosaicFiles(const std::string &directory,
+                 const DWISyntheticSeriesParameters &parameters,
+                 const std::string &studyUID, const std::string &seriesUID,
+                 std::vector<std::string> &fileNames)
+{
+  const unsigned int nVolumes = parameters.Baselines + parameters.Gradients;
+  const unsigned int mMosaic = static_cast<unsigned int>
+    (std::ceil(std::sqrt(static_cast<double>(parameters.SlicesPerVolume))));
+  const unsigned int rows = mMosaic * parameters.Rows;
+  const unsigned int columns = mMosaic * parameters.Columns;
+  for(unsigned int volume = 0; volume < nVolumes; ++volume)
+    {
+    double gradient[3];
+    double bValue;
+    VolumeDiffusion(parameters,volume,bValue,gradient);
+
+    DcmFileFormat fileFormat;
+    DcmDataset *dataset = fileFormat.getDataset();
+    PutCommonAttributes(dataset,rows,columns,studyUID,seriesUID);
+    PutInstanceNumber(dataset,volume + 1);
+    PutSliceGeometry(dataset,0);
+    PutSiemensDiffusion(dataset,parameters,bValue,gradient);
+    // the blocks past the last slice stay empty
+    std::vector<Sint16> pixels(rows * columns,0);
+    for(unsigned int slice = 0; slice < parameters.SlicesPerVolume; ++slice)
+      {
+      const unsigned int x = (slice % mMosaic) * parameters.Columns;
+      const unsigned int y = (slice / mMosaic) * parameters.Rows;
+      SlicePixels(parameters,slice,volume,&pixels[y * columns + x],columns);
+      }
+    PutPixelData(dataset,pixels);
+    if(SaveFile(fileFormat,parameters,directory,volume + 1,
+                fileNames) != EXIT_SUCCESS)
+      {
+      return EXIT_FAILURE;
+      }
+    }
+  return EXIT_SUCCESS;
+}
+
+/** Philips enhanced MR: a single file whose frames go volume by
+ *  volume, with the geometry shared by all frames in 5200,9229 and
+ *  the position and diffusion of each frame in 5200,9230 */
+int
+WriteMultiFrameFile(const std::string &directory,
+                    const DWISyntheticSeriesParameters &parameters,
+                    const std::string &studyUID, const std::string &seriesUID,
+                    std::vector<std::string> &fileNames)
+{
+  const unsigned int nVolumes = parameters.Baselines + parameters.Gradients;
+  const unsigned int nFrames = nVolumes * parameters.SlicesPerVolume;
+  const unsigned int sliceSize = parameters.Rows * parameters.Columns;
+
+  DcmFileFormat fileFormat;
+  DcmDataset *dataset = fileFormat.getDataset();
+  PutCommonAttributes(dataset,parameters.Rows,parameters.Columns,
+                      studyUID,seriesUID);
+  dataset->putAndInsertString(DCM_SOPClassUID,UID_EnhancedMRImageStorage);
+  dataset->putAndInsertString(DCM_Manufacturer,"Philips Medical Systems");
+  PutInstanceNumber(dataset,1);
+  std::ostringstream frames;
+  frames << nFrames;
+  dataset->putAndInsertString(DCM_NumberOfFrames,frames.str().c_str());
+
+  DcmItem *shared = 0;
+  dataset->findOrCreateSequenceItem(DcmTag(0x5200,0x9229),shared);
+  DcmItem *measures = 0;
+  shared->findOrCreateSequenceItem(DcmTag(0x0028,0x9110),measures);
+  measures->putAndInsertString(DCM_PixelSpacing,"2\\2");
+  measures->putAndInsertString(DCM_SliceThickness,"2");
+  measures->putAndInsertString(DCM_SpacingBetweenSlices,"2");
+  DcmItem *orientation = 0;
+  shared->findOrCreateSequenceItem(DcmTag(0x0020,0x9116),orientation);
+  orientation->putAndInsertString(DCM_ImageOrientationPatient,
+                                  "1\\0\\0\\0\\1\\0");
+
+  std::vector<Sint16> pixels(nFrames * sliceSize);
+  for(unsigned int volume = 0; volume < nVolumes; ++volume)
+    {
+    double gradient[3];
+    double bValue;
+    VolumeDiffusion(parameters,volume,bValue,gradient);
+    for(unsigned int slice = 0; slice < parameters.SlicesPerVolume; ++slice)
+      {
+      DcmItem *frame = 0;
+      // -2 appends a new item
+      dataset->findOrCreateSequenceItem(DcmTag(0x5200,0x9230),frame,-2);
+      PutEnhancedFrame(frame,slice,bValue,gradient);
+      const unsigned int frameIndex = volume * parameters.SlicesPerVolume + slice;
+      SlicePixels(parameters,slice,volume,&pixels[frameIndex * sliceSize],
+                  parameters.Columns);
+      }
+    }
+  PutPixelData(dataset,pixels);
+  return SaveFile(fileFormat,parameters,directory,1,fileNames);
+}
+}
+
+int
+WriteDWISyntheticSeries(const std::string &directory,
+                        const DWISyntheticSeriesParameters &parameters,
+                        std::vector<std::string> &fileNames)
+{
+  fileNames.clear();
+  if(parameters.Vendor != "GE" && parameters.Vendor != "SIEMENS" &&
+     parameters.Vendor != "PHILIPS")
+    {
+    std::cerr << "Can't write a synthetic series for vendor "
+              << parameters.Vendor << std::endl;
+    return EXIT_FAILURE;
+    }
+  // the raw doubles of an enhanced file would be read back with the
+  // dictionary's VR
+  if(parameters.Vendor == "PHILIPS" && parameters.MultiFrame &&
+     parameters.TransferSyntax == DWISyntheticSeriesParameters::ImplicitLittleEndian)
+    {
+    std::cerr << "Can't write an enhanced multi-frame series with implicit VR"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+  if(!itksys::SystemTools::MakeDirectory(directory.c_str()))
+    {
+    std::cerr << "Can't create " << directory << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  char uid[100];
+  const std::string studyUID =
+    dcmGenerateUniqueIdentifier(uid,SITE_STUDY_UID_ROOT);
+  const std::string seriesUID =
+    dcmGenerateUniqueIdentifier(uid,SITE_SERIES_UID_ROOT);
+
+  const EncoderRegistration encoders;
+  if(parameters.Vendor == "SIEMENS" && parameters.Mosaic)
+    {
+    return WriteMosaicFiles(directory,parameters,studyUID,seriesUID,fileNames);
+    }
+  if(parameters.Vendor == "PHILIPS" && parameters.MultiFrame)
+    {
+    return WriteMultiFrameFile(directory,parameters,studyUID,seriesUID,
+                               fileNames);
+    }
+  return WriteSliceFiles(directory,parameters,studyUID,seriesUID,fileNames);
+}
+
+/** After the "SV10" header: a 64 byte name, VM, VR, syngo data type
+ *  and item count for each element, then its items, each a 16 byte
+ *  header holding the length, and the value padded to 4 bytes */
+std::string
+DWISyntheticCSAHeader(const std::vector<DWISyntheticCSAElement> &elements)
+{
+  std::string csa("SV10\4\3\2\1",8);
+  AppendCSAInteger(csa,elements.size());
+  AppendCSAInteger(csa,77);
+  for(unsigned int i = 0; i < elements.size(); ++i)
+    {
+    const DWISyntheticCSAElement &element = elements[i];
+    std::string name(element.Name);
+    name.resize(64,'\0');
+    csa += name;
+    AppendCSAInteger(csa,element.Values.size());
+    std::string vr(element.VR);
+    vr.resize(4,'\0');
+    csa += vr;
+    AppendCSAInteger(csa,0); // syngo data type, which nothing reads
+    AppendCSAInteger(csa,element.Values.size());
+    AppendCSAInteger(csa,77);
+    for(unsigned int j = 0; j < element.Values.size(); ++j)
+      {
+      std::string value(element.Values[j]);
+      value += '\0';
+      const Uint32 length = value.size();
+      AppendCSAInteger(csa,length);
+      AppendCSAInteger(csa,length);
+      AppendCSAInteger(csa,77);
+      AppendCSAInteger(csa,length);
+      value.resize((length + 3) / 4 * 4,'\0');
+      csa += value;
+      }
+    }
+  return csa;
+}
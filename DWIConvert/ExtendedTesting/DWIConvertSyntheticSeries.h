@@ -0,0 +1,67 @@
+#ifndef __DWIConvertSyntheticSeries_h
+#define __DWIConvertSyntheticSeries_h
+#include <string>
+#include <vector>
+
+/** What a synthetic DWI series looks like */
+struct DWISyntheticSeriesParameters
+{
+  enum TransferSyntaxType { ExplicitLittleEndian,
+                            ImplicitLittleEndian,
+                            ExplicitBigEndian,
+                            RLELossless,
+                            JPEGLossless };
+
+  DWISyntheticSeriesParameters() : Vendor("GE"),
+                                   Mosaic(false),
+                                   MultiFrame(false),
+                                   Rows(64),
+                                   Columns(64),
+                                   SlicesPerVolume(8),
+                                   Baselines(1),
+                                   Gradients(6),
+                                   BValue(1000.0),
+                                   TransferSyntax(ExplicitLittleEndian) {}
+  /** GE, SIEMENS or PHILIPS */
+  std::string  Vendor;
+  /** SIEMENS: one mosaic file per volume rather than a file per slice */
+  bool         Mosaic;
+  /** PHILIPS: a single enhanced multi-frame file holding every slice;
+   *  needs an explicit VR transfer syntax */
+  bool         MultiFrame;
+  /** the size of one slice, also within a mosaic */
+  unsigned int Rows;
+  unsigned int Columns;
+  unsigned int SlicesPerVolume;
+  /** b = 0 volumes, written first */
+  unsigned int Baselines;
+  /** diffusion weighted volumes */
+  unsigned int Gradients;
+  double       BValue;
+  TransferSyntaxType TransferSyntax;
+};
+
+/** Write a synthetic DWI series into directory, which is created if
+ *  need be, laid out and tagged the way the vendor's scanners do, so
+ *  that it converts without any real data.  The pixel values are a
+ *  pattern that differs from slice to slice and volume to volume.
+ *  fileNames gets the files written, in instance number order.
+ */
+int WriteDWISyntheticSeries(const std::string &directory,
+                            const DWISyntheticSeriesParameters &parameters,
+                            std::vector<std::string> &fileNames);
+
+/** one element of a Siemens CSA header */
+struct DWISyntheticCSAElement
+{
+  DWISyntheticCSAElement(const char *name, const char *vr) : Name(name), VR(vr) {}
+  std::string              Name;
+  std::string              VR;
+  std::vector<std::string> Values;
+};
+
+/** a Siemens CSA2 ("SV10") header, as stored in 0029,1010, holding
+ *  elements in order */
+std::string DWISyntheticCSAHeader(const std::vector<DWISyntheticCSAElement> &elements);
+
+#endif // __DWIConvertSyntheticSeries_h
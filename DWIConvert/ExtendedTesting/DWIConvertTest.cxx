@@ -1,6 +1,7 @@
 
 #include <iostream>
 #include "itkTestMain.h"
+#include "DWIConvertLib.h"
 // #include "DWIConvert.cxx"
 
 /*
@@ -15,8 +16,1358 @@ void RegisterTests()
 void RegisterTests()
 {
   REGISTER_TEST(DWIConvertTest);
+  REGISTER_TEST(DWIConvertToImageTest);
+  REGISTER_TEST(DWIConvertToImageThreadsTest);
+  REGISTER_TEST(DWIConvertIOAccountingTest);
+  REGISTER_TEST(DWIConvertStressTest);
+  REGISTER_TEST(DWIConvertVolumeDigestTest);
+  REGISTER_TEST(DWIConvertDataAlignmentTest);
+  REGISTER_TEST(DWIConvertLogTest);
+  REGISTER_TEST(DWIConvertStorageSCPTest);
+  REGISTER_TEST(DWIConvertFileListTest);
+  REGISTER_TEST(DWIConvertSeriesUIDTest);
 }
 
 #undef main
 #define main DWIConvertTest
-#include "../DWIConvert.cxx"
+#include "../DWIConvertCLI.cxx"
+
+#include "DWIConvertUtils.h"
+#include "DWIConvertIOAccounting.h"
+#include "DWIConvertSyntheticSeries.h"
+#include "DWIConvertDigest.h"
+#include "itksys/SystemTools.hxx"
+#include "itkByteSwapper.h"
+#include "itkMultiThreader.h"
+#include "itkDCMTKFileReader.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+#include "dcmtk/config/osconfig.h" // make sure OS specific configuration is included first
+#include "dcmtk/dcmnet/assoc.h"
+#include "dcmtk/dcmnet/dimse.h"
+#include "dcmtk/dcmdata/dcfilefo.h"
+#include "dcmtk/dcmdata/dcdeftag.h"
+#include "dcmtk/dcmdata/dcuid.h"
+#include "dcmtk/ofstd/ofstd.h"
+
+/** Convert the one series in --inputDicomDirectory with the in-memory
+ *  API, and write the result to --outputVolume so that it can be
+ *  compared with the same baseline as DWIConvert's output.  Other
+ *  arguments are passed on as conversion options.
+ */
+int DWIConvertToImageTest(int argc, char *argv[])
+{
+  std::string inputDirectory;
+  std::string outputVolume;
+  std::vector<std::string> options;
+  for(int i = 1; i < argc; ++i)
+    {
+    const std::string arg(argv[i]);
+    if(arg == "--inputDicomDirectory" && i + 1 < argc)
+      {
+      inputDirectory = argv[++i];
+      }
+    else if(arg == "--outputVolume" && i + 1 < argc)
+      {
+      outputVolume = argv[++i];
+      }
+    else
+      {
+      options.push_back(arg);
+      }
+    }
+  if(CheckArg<std::string>("Input Directory",inputDirectory,"") == EXIT_FAILURE ||
+     CheckArg<std::string>("Output Volume",outputVolume,"") == EXIT_FAILURE)
+    {
+    return EXIT_FAILURE;
+    }
+
+  // the scan needs the codecs to tell images from other files
+  DWIConvertInitialize();
+  itk::DCMTKSeriesFileNames::Pointer inputNames =
+    itk::DCMTKSeriesFileNames::New();
+  inputNames->SetUseSeriesDetails(true);
+  inputNames->SetLoadSequences(true);
+  inputNames->SetLoadPrivateTags(true);
+  inputNames->SetInputDirectory(inputDirectory);
+  const itk::DCMTKSeriesFileNames::SeriesCatalogType &catalog =
+    inputNames->GetSeriesCatalog();
+  DWIConvertCleanup();
+  if(catalog.size() != 1)
+    {
+    std::cerr << "Expected one series in " << inputDirectory
+              << ", found " << catalog.size() << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  DWIConvertResult result;
+  if(DWIConvertToImage(catalog.begin()->second,options,result) != EXIT_SUCCESS)
+    {
+    return EXIT_FAILURE;
+    }
+  const unsigned int nComponents =
+    result.Image->GetNumberOfComponentsPerPixel();
+  if(result.Gradients.size() != nComponents ||
+     result.BValues.size() != nComponents)
+    {
+    std::cerr << nComponents << " volumes, but "
+              << result.Gradients.size() << " gradients and "
+              << result.BValues.size() << " b-values" << std::endl;
+    return EXIT_FAILURE;
+    }
+  return WriteVolume<DWIConvertResult::ImageType>(result.Image,outputVolume);
+}
+
+/** what each thread of DWIConvertToImageThreadsTest converts, and
+ *  what it got */
+struct ToImageThreadsData
+{
+  const std::vector<std::string>  *FileNames;
+  std::vector<DWIConvertResult>    Results;
+  std::vector<int>                 Returns;
+};
+
+ITK_THREAD_RETURN_TYPE
+ToImageThread(void *arg)
+{
+  itk::MultiThreader::ThreadInfoStruct *info =
+    static_cast<itk::MultiThreader::ThreadInfoStruct *>(arg);
+  ToImageThreadsData *data =
+    static_cast<ToImageThreadsData *>(info->UserData);
+  const std::vector<std::string> options;
+  data->Returns[info->ThreadID] =
+    DWIConvertToImage(*data->FileNames,options,
+                      data->Results[info->ThreadID]);
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+/** whether two conversions gave the same voxels, gradients, b-values
+ *  and measurement frame */
+bool
+SameResult(const DWIConvertResult &a, const DWIConvertResult &b)
+{
+  if(a.Image.IsNull() || b.Image.IsNull() ||
+     a.Image->GetLargestPossibleRegion() != b.Image->GetLargestPossibleRegion() ||
+     a.Image->GetNumberOfComponentsPerPixel() !=
+     b.Image->GetNumberOfComponentsPerPixel())
+    {
+    return false;
+    }
+  const size_t nValues = a.Image->GetPixelContainer()->Size();
+  if(b.Image->GetPixelContainer()->Size() != nValues ||
+     !std::equal(a.Image->GetBufferPointer(),
+                 a.Image->GetBufferPointer() + nValues,
+                 b.Image->GetBufferPointer()))
+    {
+    return false;
+    }
+  return a.Gradients == b.Gradients && a.BValues == b.BValues &&
+    a.BValue == b.BValue && a.MeasurementFrame == b.MeasurementFrame;
+}
+
+/** Convert a synthetic series with DWIConvertToImage in several
+ *  threads at once, and check that each thread got what a conversion
+ *  on its own gets, so that state shared between conversions -- the
+ *  codecs, the dictionary, the log -- is caught if it isn't safe.
+ */
+int DWIConvertToImageThreadsTest(int argc, char *argv[])
+{
+  if(argc < 2)
+    {
+    std::cerr << "Usage: DWIConvertToImageThreadsTest <scratch directory>"
+              << " [number of threads]" << std::endl;
+    return EXIT_FAILURE;
+    }
+  const std::string directory(argv[1]);
+  const unsigned int nThreads = argc > 2 ? atoi(argv[2]) : 4;
+  if(nThreads < 2)
+    {
+    std::cerr << "Needs at least 2 threads" << std::endl;
+    return EXIT_FAILURE;
+    }
+  const std::string dicomDirectory = directory + "/dicom";
+  itksys::SystemTools::RemoveADirectory(dicomDirectory.c_str());
+
+  DWISyntheticSeriesParameters parameters;
+  parameters.Rows = parameters.Columns = 32;
+  parameters.SlicesPerVolume = 8;
+  parameters.Gradients = 6;
+  std::vector<std::string> fileNames;
+  if(WriteDWISyntheticSeries(dicomDirectory,parameters,fileNames) != EXIT_SUCCESS)
+    {
+    return EXIT_FAILURE;
+    }
+
+  DWIConvertResult expected;
+  if(DWIConvertToImage(fileNames,std::vector<std::string>(),expected) !=
+     EXIT_SUCCESS)
+    {
+    std::cerr << "Conversion of the synthetic series failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+  const unsigned int nVolumes = parameters.Baselines + parameters.Gradients;
+  if(expected.Image->GetNumberOfComponentsPerPixel() != nVolumes)
+    {
+    std::cerr << expected.Image->GetNumberOfComponentsPerPixel()
+              << " volumes converted, expected " << nVolumes << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  ToImageThreadsData data;
+  data.FileNames = &fileNames;
+  data.Results.resize(nThreads);
+  data.Returns.resize(nThreads,EXIT_FAILURE);
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetNumberOfThreads(nThreads);
+  if(threader->GetNumberOfThreads() != nThreads)
+    {
+    std::cerr << "Can't run " << nThreads << " threads" << std::endl;
+    return EXIT_FAILURE;
+    }
+  threader->SetSingleMethod(ToImageThread,&data);
+  threader->SingleMethodExecute();
+
+  int result = EXIT_SUCCESS;
+  for(unsigned int i = 0; i < nThreads; ++i)
+    {
+    if(data.Returns[i] != EXIT_SUCCESS)
+      {
+      std::cerr << "Conversion in thread " << i << " failed" << std::endl;
+      result = EXIT_FAILURE;
+      }
+    else if(!SameResult(expected,data.Results[i]))
+      {
+      std::cerr << "Conversion in thread " << i << " differs from the one"
+                << " converted alone" << std::endl;
+      result = EXIT_FAILURE;
+      }
+    }
+  return result;
+}
+
+/** Convert a synthetic GE series with I/O accounting on, and check
+ *  how often each slice is opened, and how often its header is
+ *  parsed or its pixels decoded.  Today a slice is parsed by the
+ *  directory scan (twice), by the header load, and by the image
+ *  reader, and decoded by the scan and the image reader; the first
+ *  and last slices are read once more for the series geometry.  A
+ *  count above these limits is a redundant read creeping back in.
+ */
+int DWIConvertIOAccountingTest(int argc, char *argv[])
+{
+  if(argc < 2)
+    {
+    std::cerr << "Usage: DWIConvertIOAccountingTest <scratch directory>"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+  const unsigned int maxHeaderParses = 5;
+  const unsigned int maxPixelDecodes = 3;
+
+  const std::string directory(argv[1]);
+  const std::string dicomDirectory = directory + "/dicom";
+  const std::string outputVolume = directory + "/IOAccountingTest.nrrd";
+  itksys::SystemTools::RemoveADirectory(dicomDirectory.c_str());
+
+  DWISyntheticSeriesParameters parameters;
+  parameters.Rows = parameters.Columns = 16;
+  parameters.SlicesPerVolume = 4;
+  parameters.Gradients = 3;
+  std::vector<std::string> fileNames;
+  if(WriteDWISyntheticSeries(dicomDirectory,parameters,fileNames) != EXIT_SUCCESS)
+    {
+    return EXIT_FAILURE;
+    }
+
+  const char *args[] = { "DWIConvert",
+                         "--inputDicomDirectory", dicomDirectory.c_str(),
+                         "--outputVolume", outputVolume.c_str() };
+  DWIConvertIOAccounting::Start();
+  const int rval = DWIConvertMain(5,const_cast<char **>(args));
+  const DWIConvertIOAccounting::CountsMap counts =
+    DWIConvertIOAccounting::GetCounts();
+  DWIConvertIOAccounting::WriteReport("-");
+  DWIConvertIOAccounting::Stop();
+  if(rval != EXIT_SUCCESS)
+    {
+    std::cerr << "Conversion of the synthetic series failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  int result = EXIT_SUCCESS;
+  for(unsigned int i = 0; i < fileNames.size(); ++i)
+    {
+    const std::string fileName =
+      itksys::SystemTools::CollapseFullPath(fileNames[i].c_str());
+    DWIConvertIOAccounting::CountsMap::const_iterator it =
+      counts.find(fileName);
+    if(it == counts.end() || it->second.PixelDecodes == 0 ||
+       it->second.BytesRead == 0)
+      {
+      std::cerr << fileName << " was never read" << std::endl;
+      result = EXIT_FAILURE;
+      continue;
+      }
+    if(it->second.HeaderParses > maxHeaderParses ||
+       it->second.PixelDecodes > maxPixelDecodes)
+      {
+      std::cerr << fileName << ": " << it->second.HeaderParses
+                << " header parses and " << it->second.PixelDecodes
+                << " pixel decodes, expected at most " << maxHeaderParses
+                << " and " << maxPixelDecodes << std::endl;
+      result = EXIT_FAILURE;
+      }
+    }
+  return result;
+}
+
+/** Check an attached, raw .nrrd DWI volume written from a synthetic
+ *  series: its sizes, its length, and voxels in the first and last
+ *  slices of the first, middle and last volumes, which for a large
+ *  series lie past 4GB.
+ */
+int
+CheckSyntheticVolume(const std::string &fileName,
+                     const DWISyntheticSeriesParameters &parameters)
+{
+  const unsigned int nVolumes = parameters.Baselines + parameters.Gradients;
+  std::ifstream volume(fileName.c_str(),std::ios::in | std::ios::binary);
+  if(!volume.is_open())
+    {
+    std::cerr << "Can't open " << fileName << std::endl;
+    return EXIT_FAILURE;
+    }
+  std::ostringstream expectedSizes;
+  expectedSizes << "sizes: " << parameters.Columns << " " << parameters.Rows
+                << " " << parameters.SlicesPerVolume << " " << nVolumes;
+  std::string line;
+  bool sizesFound = false;
+  while(std::getline(volume,line) && !line.empty())
+    {
+    if(line.compare(0,6,"sizes:") == 0)
+      {
+      if(line != expectedSizes.str())
+        {
+        std::cerr << fileName << " has " << line << ", expected "
+                  << expectedSizes.str() << std::endl;
+        return EXIT_FAILURE;
+        }
+      sizesFound = true;
+      }
+    }
+  if(!sizesFound)
+    {
+    std::cerr << "No sizes in " << fileName << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // the voxels are at the end of the file, whatever the padding of
+  // the header; std::streamoff is 64 bits where unsigned long isn't
+  const std::streamoff slicePixels =
+    static_cast<std::streamoff>(parameters.Rows) * parameters.Columns;
+  const std::streamoff volumePixels = slicePixels * parameters.SlicesPerVolume;
+  const std::streamoff dataSize =
+    volumePixels * nVolumes * static_cast<std::streamoff>(sizeof(short));
+  volume.clear();
+  volume.seekg(0,std::ios::end);
+  const std::streamoff fileSize = volume.tellg();
+  if(fileSize <= dataSize)
+    {
+    std::cerr << fileName << " is " << fileSize << " bytes, too short for "
+              << dataSize << " bytes of voxels" << std::endl;
+    return EXIT_FAILURE;
+    }
+  const std::streamoff dataStart = fileSize - dataSize;
+  std::cout << fileName << ": " << dataSize << " bytes of voxels" << std::endl;
+
+  const unsigned int volumes[] = { 0, nVolumes / 2, nVolumes - 1 };
+  const unsigned int slices[] = { 0, parameters.SlicesPerVolume - 1 };
+  const unsigned int x = parameters.Columns - 1;
+  const unsigned int y = parameters.Rows / 2;
+  for(unsigned int v = 0; v < 3; ++v)
+    {
+    for(unsigned int s = 0; s < 2; ++s)
+      {
+      const std::streamoff index = volumes[v] * volumePixels +
+        slices[s] * slicePixels + static_cast<std::streamoff>(y) * parameters.Columns + x;
+      short value;
+      volume.seekg(dataStart + index * static_cast<std::streamoff>(sizeof(short)));
+      volume.read(reinterpret_cast<char *>(&value),sizeof(short));
+      itk::ByteSwapper<short>::SwapFromSystemToLittleEndian(&value);
+      const short expected =
+        static_cast<short>((x + 3 * y + 7 * slices[s] + 11 * volumes[v]) % 1000);
+      if(!volume.good() || value != expected)
+        {
+        std::cerr << fileName << ": voxel " << x << "," << y << " of slice "
+                  << slices[s] << " of volume " << volumes[v] << " is "
+                  << value << ", expected " << expected << std::endl;
+        return EXIT_FAILURE;
+        }
+      }
+    }
+  return EXIT_SUCCESS;
+}
+
+/** Convert a generated series too big for 16 or 32 bit indices:
+ *    frames: a Philips enhanced multi-frame file of more than 65535
+ *            frames
+ *    large:  a GE series whose volume is more than 4GB
+ *  and check the converted volume.  Further arguments are passed on
+ *  to DWIConvert, e.g. --memoryMapOutput.  The series take minutes to
+ *  write and convert, and large needs about 9GB of disk and as much
+ *  memory, so these tests only run with DWIConvert_STRESS_TESTING on.
+ */
+int DWIConvertStressTest(int argc, char *argv[])
+{
+  if(argc < 3)
+    {
+    std::cerr << "Usage: DWIConvertStressTest <scratch directory> frames|large"
+              << " [DWIConvert options]" << std::endl;
+    return EXIT_FAILURE;
+    }
+  const std::string directory(argv[1]);
+  const std::string series(argv[2]);
+
+  DWISyntheticSeriesParameters parameters;
+  parameters.Baselines = 1;
+  if(series == "frames")
+    {
+    // 257 volumes of 256 slices: 65792 frames
+    parameters.Vendor = "PHILIPS";
+    parameters.MultiFrame = true;
+    parameters.Rows = parameters.Columns = 8;
+    parameters.SlicesPerVolume = 256;
+    parameters.Gradients = 256;
+    }
+  else if(series == "large")
+    {
+    // 65 volumes of 128 512x512 slices: 4160MB
+    parameters.Vendor = "GE";
+    parameters.Rows = parameters.Columns = 512;
+    parameters.SlicesPerVolume = 128;
+    parameters.Gradients = 64;
+    }
+  else
+    {
+    std::cerr << "Unknown stress series " << series << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  const std::string dicomDirectory = directory + "/dicom";
+  const std::string outputVolume = directory + "/" + series + ".nrrd";
+  itksys::SystemTools::RemoveADirectory(directory.c_str());
+  std::vector<std::string> fileNames;
+  if(WriteDWISyntheticSeries(dicomDirectory,parameters,fileNames) != EXIT_SUCCESS)
+    {
+    return EXIT_FAILURE;
+    }
+
+  std::vector<const char *> args;
+  args.push_back("DWIConvert");
+  args.push_back("--inputDicomDirectory");
+  args.push_back(dicomDirectory.c_str());
+  args.push_back("--outputVolume");
+  args.push_back(outputVolume.c_str());
+  for(int i = 3; i < argc; ++i)
+    {
+    args.push_back(argv[i]);
+    }
+  if(DWIConvertMain(static_cast<int>(args.size()),
+                    const_cast<char **>(&args[0])) != EXIT_SUCCESS)
+    {
+    std::cerr << "Conversion of the " << series << " series failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if(CheckSyntheticVolume(outputVolume,parameters) != EXIT_SUCCESS)
+    {
+    return EXIT_FAILURE;
+    }
+  // don't leave gigabytes behind
+  itksys::SystemTools::RemoveADirectory(directory.c_str());
+  return EXIT_SUCCESS;
+}
+
+/** Convert a synthetic series in memory, streamed and memory-mapped
+ *  with --writeVolumeDigests, and check that the digests match the
+ *  voxels of each output, and each other; then convert it again
+ *  without digests, which must remove the old ones.
+ */
+int DWIConvertVolumeDigestTest(int argc, char *argv[])
+{
+  if(argc < 2)
+    {
+    std::cerr << "Usage: DWIConvertVolumeDigestTest <scratch directory>"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+  const std::string directory(argv[1]);
+  const std::string dicomDirectory = directory + "/dicom";
+  itksys::SystemTools::RemoveADirectory(dicomDirectory.c_str());
+
+  DWISyntheticSeriesParameters parameters;
+  parameters.Rows = parameters.Columns = 16;
+  parameters.SlicesPerVolume = 4;
+  parameters.Gradients = 3;
+  std::vector<std::string> fileNames;
+  if(WriteDWISyntheticSeries(dicomDirectory,parameters,fileNames) != EXIT_SUCCESS)
+    {
+    return EXIT_FAILURE;
+    }
+  const unsigned int nVolumes = parameters.Baselines + parameters.Gradients;
+  const size_t volumeBytes = static_cast<size_t>(parameters.Rows) *
+    parameters.Columns * parameters.SlicesPerVolume * sizeof(short);
+
+  const char *modes[] = { "", "--streamOutput", "--memoryMapOutput" };
+  std::vector<std::string> outputVolumes;
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    std::ostringstream outputVolume;
+    outputVolume << directory << "/VolumeDigestTest" << i << ".nrrd";
+    outputVolumes.push_back(outputVolume.str());
+    std::vector<const char *> args;
+    args.push_back("DWIConvert");
+    args.push_back("--inputDicomDirectory");
+    args.push_back(dicomDirectory.c_str());
+    args.push_back("--outputVolume");
+    args.push_back(outputVolumes.back().c_str());
+    args.push_back("--writeVolumeDigests");
+    if(*modes[i] != '\0')
+      {
+      args.push_back(modes[i]);
+      }
+    if(DWIConvertMain(static_cast<int>(args.size()),
+                      const_cast<char **>(&args[0])) != EXIT_SUCCESS)
+      {
+      std::cerr << "Conversion " << i << " of the synthetic series failed"
+                << std::endl;
+      return EXIT_FAILURE;
+      }
+
+    DWIConvertVolumeDigests digests;
+    if(digests.Read(outputVolumes.back()) != EXIT_SUCCESS)
+      {
+      return EXIT_FAILURE;
+      }
+    if(digests.GetDigests().size() != nVolumes)
+      {
+      std::cerr << outputVolumes.back() << ": " << digests.GetDigests().size()
+                << " digests for " << nVolumes << " volumes" << std::endl;
+      return EXIT_FAILURE;
+      }
+    // the voxels are at the end of the file
+    std::ifstream volume(outputVolumes.back().c_str(),
+                         std::ios::in | std::ios::binary);
+    std::vector<char> voxels(volumeBytes * nVolumes);
+    volume.seekg(-static_cast<std::streamoff>(voxels.size()),std::ios::end);
+    volume.read(&voxels[0],voxels.size());
+    for(unsigned int v = 0; volume.good() && v < nVolumes; ++v)
+      {
+      if(DWIConvertXXH64(&voxels[v * volumeBytes],volumeBytes) !=
+         digests.GetDigests()[v])
+        {
+        std::cerr << outputVolumes.back() << ": digest of volume " << v
+                  << " doesn't match its voxels" << std::endl;
+        return EXIT_FAILURE;
+        }
+      }
+    if(!volume.good())
+      {
+      std::cerr << "Can't read the voxels of " << outputVolumes.back()
+                << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+
+  for(unsigned int i = 1; i < outputVolumes.size(); ++i)
+    {
+    if(DWIConvertCompareDigests(outputVolumes[0],outputVolumes[i],std::cerr) !=
+       EXIT_SUCCESS)
+      {
+      std::cerr << outputVolumes[0] << " and " << outputVolumes[i]
+                << " differ" << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+
+  // rewritten without digests, an output must not keep the old ones
+  const char *args[] = { "DWIConvert",
+                         "--inputDicomDirectory", dicomDirectory.c_str(),
+                         "--outputVolume", outputVolumes[0].c_str() };
+  if(DWIConvertMain(5,const_cast<char **>(args)) != EXIT_SUCCESS)
+    {
+    std::cerr << "Conversion without digests failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if(itksys::SystemTools::FileExists(
+       DWIConvertDigestFileName(outputVolumes[0]).c_str()))
+    {
+    std::cerr << "Stale digests left beside " << outputVolumes[0] << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+
+/** Convert a synthetic series with --nrrdDataAlignment 4096, in
+ *  memory, streamed and memory-mapped, and check that the header's
+ *  data_offset is a multiple of 4096, that the header ends there, and
+ *  that the first and last voxels are found from it, as a reader
+ *  mapping the data without parsing the header would find them.
+ */
+int DWIConvertDataAlignmentTest(int argc, char *argv[])
+{
+  if(argc < 2)
+    {
+    std::cerr << "Usage: DWIConvertDataAlignmentTest <scratch directory>"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+  const std::streamoff alignment = 4096;
+  const std::string directory(argv[1]);
+  const std::string dicomDirectory = directory + "/dicom";
+  itksys::SystemTools::RemoveADirectory(dicomDirectory.c_str());
+
+  DWISyntheticSeriesParameters parameters;
+  parameters.Rows = parameters.Columns = 16;
+  parameters.SlicesPerVolume = 4;
+  parameters.Gradients = 3;
+  std::vector<std::string> fileNames;
+  if(WriteDWISyntheticSeries(dicomDirectory,parameters,fileNames) != EXIT_SUCCESS)
+    {
+    return EXIT_FAILURE;
+    }
+  const unsigned int nVolumes = parameters.Baselines + parameters.Gradients;
+  const std::streamoff nVoxels = static_cast<std::streamoff>(parameters.Rows) *
+    parameters.Columns * parameters.SlicesPerVolume * nVolumes;
+
+  const char *modes[] = { "", "--streamOutput", "--memoryMapOutput" };
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    std::ostringstream outputVolume;
+    outputVolume << directory << "/DataAlignmentTest" << i << ".nrrd";
+    const std::string fileName = outputVolume.str();
+    std::vector<const char *> args;
+    args.push_back("DWIConvert");
+    args.push_back("--inputDicomDirectory");
+    args.push_back(dicomDirectory.c_str());
+    args.push_back("--outputVolume");
+    args.push_back(fileName.c_str());
+    args.push_back("--nrrdDataAlignment");
+    args.push_back("4096");
+    if(*modes[i] != '\0')
+      {
+      args.push_back(modes[i]);
+      }
+    if(DWIConvertMain(static_cast<int>(args.size()),
+                      const_cast<char **>(&args[0])) != EXIT_SUCCESS)
+      {
+      std::cerr << "Conversion " << i << " of the synthetic series failed"
+                << std::endl;
+      return EXIT_FAILURE;
+      }
+
+    std::ifstream volume(fileName.c_str(),std::ios::in | std::ios::binary);
+    std::string line;
+    std::streamoff offset = -1;
+    while(std::getline(volume,line) && !line.empty())
+      {
+      if(line.compare(0,13,"data_offset:=") == 0)
+        {
+        offset = atol(line.c_str() + 13);
+        }
+      }
+    const std::streamoff headerEnd = volume.tellg();
+    if(offset < 0)
+      {
+      std::cerr << "No data_offset in " << fileName << std::endl;
+      return EXIT_FAILURE;
+      }
+    if(offset % alignment != 0 || offset != headerEnd)
+      {
+      std::cerr << fileName << ": data_offset " << offset << " isn't a multiple"
+                << " of " << alignment << ", or the header ends at "
+                << headerEnd << std::endl;
+      return EXIT_FAILURE;
+      }
+    volume.seekg(0,std::ios::end);
+    const std::streamoff fileSize = volume.tellg();
+    if(fileSize != offset + nVoxels * static_cast<std::streamoff>(sizeof(short)))
+      {
+      std::cerr << fileName << " is " << fileSize << " bytes, expected "
+                << offset << " of header and " << nVoxels << " voxels"
+                << std::endl;
+      return EXIT_FAILURE;
+      }
+
+    // the synthetic voxel of x,y in slice s of volume v is
+    // (x + 3y + 7s + 11v) % 1000
+    const std::streamoff index[] = { 0, nVoxels - 1 };
+    const unsigned int x = parameters.Columns - 1;
+    const unsigned int y = parameters.Rows - 1;
+    const short expected[] =
+      {
+      0,
+      static_cast<short>((x + 3 * y + 7 * (parameters.SlicesPerVolume - 1) +
+                          11 * (nVolumes - 1)) % 1000)
+      };
+    for(unsigned int j = 0; j < 2; ++j)
+      {
+      short value;
+      volume.seekg(offset + index[j] * static_cast<std::streamoff>(sizeof(short)));
+      volume.read(reinterpret_cast<char *>(&value),sizeof(short));
+      itk::ByteSwapper<short>::SwapFromSystemToLittleEndian(&value);
+      if(!volume.good() || value != expected[j])
+        {
+        std::cerr << fileName << ": voxel " << index[j] << " at data_offset "
+                  << offset << " is " << value << ", expected "
+                  << expected[j] << std::endl;
+        return EXIT_FAILURE;
+        }
+      }
+    }
+  return EXIT_SUCCESS;
+}
+
+/** Convert a series with the given log options, returning what it
+ *  printed to standard output in captured. */
+int
+ConvertCapturingLog(const std::string &dicomDirectory,
+                    const std::string &outputVolume,
+                    const char *logLevel, const char *logFormat,
+                    std::string &captured)
+{
+  const char *args[] = { "DWIConvert",
+                         "--inputDicomDirectory", dicomDirectory.c_str(),
+                         "--outputVolume", outputVolume.c_str(),
+                         "--logLevel", logLevel,
+                         "--logFormat", logFormat };
+  std::ostringstream output;
+  std::streambuf * const coutBuffer = std::cout.rdbuf(output.rdbuf());
+  const int rval = DWIConvertMain(9,const_cast<char **>(args));
+  std::cout.rdbuf(coutBuffer);
+  captured = output.str();
+  if(rval != EXIT_SUCCESS)
+    {
+    std::cerr << "Conversion with --logLevel " << logLevel
+              << " --logFormat " << logFormat << " failed" << std::endl;
+    }
+  return rval;
+}
+
+/** Convert a generated series with --logLevel debug --logFormat json,
+ *  and check that every line printed is a JSON message and that there
+ *  is a debug message with the gradient of each volume; then convert
+ *  it with --logLevel quiet, which prints nothing for a clean series.
+ */
+int DWIConvertLogTest(int argc, char *argv[])
+{
+  if(argc < 2)
+    {
+    std::cerr << "Usage: DWIConvertLogTest <scratch directory>"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+  const std::string directory(argv[1]);
+  const std::string dicomDirectory = directory + "/dicom";
+  const std::string outputVolume = directory + "/LogTest.nrrd";
+  itksys::SystemTools::RemoveADirectory(dicomDirectory.c_str());
+
+  DWISyntheticSeriesParameters parameters;
+  parameters.Rows = parameters.Columns = 16;
+  parameters.SlicesPerVolume = 4;
+  parameters.Gradients = 3;
+  std::vector<std::string> fileNames;
+  if(WriteDWISyntheticSeries(dicomDirectory,parameters,fileNames) != EXIT_SUCCESS)
+    {
+    return EXIT_FAILURE;
+    }
+  const unsigned int nVolumes = parameters.Baselines + parameters.Gradients;
+
+  std::string captured;
+  if(ConvertCapturingLog(dicomDirectory,outputVolume,"debug","json",
+                         captured) != EXIT_SUCCESS)
+    {
+    return EXIT_FAILURE;
+    }
+  std::istringstream lines(captured);
+  std::string line;
+  unsigned int nInfo = 0, nGradients = 0;
+  while(std::getline(lines,line))
+    {
+    if(line.empty() || line.compare(0,8,"{\"time\":") != 0 ||
+       line[line.size() - 1] != '}')
+      {
+      std::cerr << "Not a JSON message: " << line << std::endl;
+      return EXIT_FAILURE;
+      }
+    if(line.find("\"level\":\"info\"") != std::string::npos)
+      {
+      ++nInfo;
+      }
+    if(line.find("\"level\":\"debug\",\"message\":\"B-value: ") !=
+       std::string::npos)
+      {
+      ++nGradients;
+      }
+    }
+  if(nInfo == 0 || nGradients != nVolumes)
+    {
+    std::cerr << nInfo << " info messages and " << nGradients
+              << " gradient messages, expected some and " << nVolumes
+              << std::endl << captured;
+    return EXIT_FAILURE;
+    }
+
+  if(ConvertCapturingLog(dicomDirectory,outputVolume,"quiet","text",
+                         captured) != EXIT_SUCCESS)
+    {
+    return EXIT_FAILURE;
+    }
+  if(!captured.empty())
+    {
+    std::cerr << "--logLevel quiet printed:" << std::endl << captured;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+
+/** what the storage SCP thread of DWIConvertStorageSCPTest runs */
+struct StorageSCPThreadData
+{
+  std::vector<std::string> Args;
+  int                      Result;
+};
+
+ITK_THREAD_RETURN_TYPE
+StorageSCPThread(void *arg)
+{
+  itk::MultiThreader::ThreadInfoStruct *info =
+    static_cast<itk::MultiThreader::ThreadInfoStruct *>(arg);
+  StorageSCPThreadData *data =
+    static_cast<StorageSCPThreadData *>(info->UserData);
+  std::vector<char *> args;
+  for(unsigned int i = 0; i < data->Args.size(); ++i)
+    {
+    args.push_back(const_cast<char *>(data->Args[i].c_str()));
+    }
+  args.push_back(0);
+  data->Result = DWIConvertMain(static_cast<int>(data->Args.size()),&args[0]);
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+/** Send files with C-STORE, as storescu does, to the storage SCP on
+ *  port of this host, each under its own SOP instance UID unless
+ *  sopInstanceUIDs gives another; statuses gets the status the SCP
+ *  answered each with.  The SCP may not listen yet, so the
+ *  association is retried for a while.
+ */
+int
+SendFiles(int port,
+          const std::vector<std::string> &fileNames,
+          const std::vector<std::string> &sopInstanceUIDs,
+          std::vector<unsigned short> &statuses)
+{
+  // the SOP classes to propose, one presentation context each
+  std::vector<std::string> sopClasses;
+  for(unsigned int i = 0; i < fileNames.size(); ++i)
+    {
+    DcmFileFormat fileFormat;
+    OFString sopClass;
+    if(fileFormat.loadFile(fileNames[i].c_str()).bad() ||
+       fileFormat.getDataset()->findAndGetOFString(DCM_SOPClassUID,
+                                                   sopClass).bad())
+      {
+      std::cerr << "Can't read the SOP class of " << fileNames[i] << std::endl;
+      return EXIT_FAILURE;
+      }
+    if(std::find(sopClasses.begin(),sopClasses.end(),sopClass.c_str()) ==
+       sopClasses.end())
+      {
+      sopClasses.push_back(sopClass.c_str());
+      }
+    }
+
+  T_ASC_Network *network = 0;
+  OFCondition cond = ASC_initializeNetwork(NET_REQUESTOR,0,30,&network);
+  if(cond.bad())
+    {
+    std::cerr << "Can't initialize the network: " << cond.text() << std::endl;
+    return EXIT_FAILURE;
+    }
+  std::ostringstream peer;
+  peer << "localhost:" << port;
+  const char *transferSyntaxes[] =
+    {
+      UID_LittleEndianExplicitTransferSyntax,
+      UID_LittleEndianImplicitTransferSyntax
+    };
+  T_ASC_Association *assoc = 0;
+  for(unsigned int attempt = 0; attempt < 50; ++attempt)
+    {
+    T_ASC_Parameters *params = 0;
+    ASC_createAssociationParameters(&params,ASC_DEFAULTMAXPDU);
+    ASC_setAPTitles(params,"STORESCU","DWICONVERT",NULL);
+    ASC_setPresentationAddresses(params,"localhost",peer.str().c_str());
+    for(unsigned int i = 0; i < sopClasses.size(); ++i)
+      {
+      // presentation context IDs are odd
+      ASC_addPresentationContext(params,2 * i + 1,sopClasses[i].c_str(),
+                                 transferSyntaxes,2);
+      }
+    cond = ASC_requestAssociation(network,params,&assoc);
+    if(cond.good())
+      {
+      break;
+      }
+    if(assoc != 0)
+      {
+      ASC_destroyAssociation(&assoc);
+      }
+    else
+      {
+      ASC_destroyAssociationParameters(&params);
+      }
+    itksys::SystemTools::Delay(200);
+    }
+  if(cond.bad())
+    {
+    std::cerr << "No association with " << peer.str() << ": "
+              << cond.text() << std::endl;
+    ASC_dropNetwork(&network);
+    return EXIT_FAILURE;
+    }
+
+  int rval = EXIT_SUCCESS;
+  for(unsigned int i = 0; rval == EXIT_SUCCESS && i < fileNames.size(); ++i)
+    {
+    DcmFileFormat fileFormat;
+    fileFormat.loadFile(fileNames[i].c_str());
+    DcmDataset *dataset = fileFormat.getDataset();
+    OFString sopClass, sopInstance;
+    dataset->findAndGetOFString(DCM_SOPClassUID,sopClass);
+    dataset->findAndGetOFString(DCM_SOPInstanceUID,sopInstance);
+    if(sopInstanceUIDs[i] != "")
+      {
+      sopInstance = sopInstanceUIDs[i].c_str();
+      }
+    const T_ASC_PresentationContextID presID =
+      ASC_findAcceptedPresentationContextID(assoc,sopClass.c_str());
+    if(presID == 0)
+      {
+      std::cerr << "The SCP didn't accept SOP class " << sopClass << std::endl;
+      rval = EXIT_FAILURE;
+      break;
+      }
+    T_DIMSE_C_StoreRQ req;
+    memset(&req,0,sizeof(req));
+    req.MessageID = assoc->nextMsgID++;
+    OFStandard::strlcpy(req.AffectedSOPClassUID,sopClass.c_str(),
+                        sizeof(req.AffectedSOPClassUID));
+    OFStandard::strlcpy(req.AffectedSOPInstanceUID,sopInstance.c_str(),
+                        sizeof(req.AffectedSOPInstanceUID));
+    req.DataSetType = DIMSE_DATASET_PRESENT;
+    req.Priority = DIMSE_PRIORITY_MEDIUM;
+    T_DIMSE_C_StoreRSP rsp;
+    DcmDataset *statusDetail = 0;
+    cond = DIMSE_storeUser(assoc,presID,&req,NULL,dataset,NULL,NULL,
+                           DIMSE_BLOCKING,0,&rsp,&statusDetail);
+    delete statusDetail;
+    if(cond.bad())
+      {
+      std::cerr << "C-STORE of " << fileNames[i] << " failed: "
+                << cond.text() << std::endl;
+      rval = EXIT_FAILURE;
+      break;
+      }
+    statuses.push_back(rsp.DimseStatus);
+    }
+  if(rval == EXIT_SUCCESS)
+    {
+    ASC_releaseAssociation(assoc);
+    }
+  else
+    {
+    ASC_abortAssociation(assoc);
+    }
+  ASC_destroyAssociation(&assoc);
+  ASC_dropNetwork(&network);
+  return rval;
+}
+
+/** Run DWIConvert as a storage SCP on the given port of this host,
+ *  send it a synthetic series with C-STORE, and check that the
+ *  volume it converts from the images it kept in memory is the one
+ *  converted from the series' directory.  The first image is sent
+ *  once more under a SOP instance UID that is a relative path, which
+ *  the SCP must refuse.
+ */
+int DWIConvertStorageSCPTest(int argc, char *argv[])
+{
+  if(argc < 3)
+    {
+    std::cerr << "Usage: DWIConvertStorageSCPTest <scratch directory> <port>"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+  const std::string directory(argv[1]);
+  const std::string port(argv[2]);
+  const std::string dicomDirectory = directory + "/dicom";
+  itksys::SystemTools::RemoveADirectory(directory.c_str());
+
+  DWISyntheticSeriesParameters parameters;
+  parameters.Rows = parameters.Columns = 16;
+  parameters.SlicesPerVolume = 4;
+  parameters.Gradients = 3;
+  std::vector<std::string> fileNames;
+  if(WriteDWISyntheticSeries(dicomDirectory,parameters,fileNames) != EXIT_SUCCESS)
+    {
+    return EXIT_FAILURE;
+    }
+  std::string seriesUID;
+  if(!itk::DCMTKFileReader::ReadSeriesUID(fileNames[0],seriesUID))
+    {
+    std::cerr << "No series UID in " << fileNames[0] << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // what the SCP must convert to
+  const std::string directVolume = directory + "/direct.nrrd";
+  const char *directArgs[] = { "DWIConvert",
+                               "--inputDicomDirectory", dicomDirectory.c_str(),
+                               "--outputVolume", directVolume.c_str(),
+                               "--writeVolumeDigests" };
+  if(DWIConvertMain(6,const_cast<char **>(directArgs)) != EXIT_SUCCESS)
+    {
+    std::cerr << "Conversion of " << dicomDirectory << " failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // the SCP exits once it has been idle, with the series converted,
+  // for watchIdleExit seconds
+  const std::string scpVolume = directory + "/scp.nrrd";
+  StorageSCPThreadData data;
+  data.Args.push_back("DWIConvert");
+  data.Args.push_back("--storageSCPPort");
+  data.Args.push_back(port);
+  data.Args.push_back("--watchSettleTime");
+  data.Args.push_back("1");
+  data.Args.push_back("--watchIdleExit");
+  data.Args.push_back("5");
+  data.Args.push_back("--outputVolume");
+  data.Args.push_back(scpVolume);
+  data.Args.push_back("--writeVolumeDigests");
+  data.Result = EXIT_FAILURE;
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  const int threadID = threader->SpawnThread(StorageSCPThread,&data);
+  if(threadID < 0)
+    {
+    std::cerr << "Can't start the storage SCP" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  std::vector<std::string> sendNames(fileNames);
+  std::vector<std::string> sendUIDs(fileNames.size());
+  sendNames.push_back(fileNames[0]);
+  sendUIDs.push_back("../../DWIConvertStorageSCPTest");
+  std::vector<unsigned short> statuses;
+  const int sent = SendFiles(atoi(port.c_str()),sendNames,sendUIDs,statuses);
+  // waits for the thread to return
+  threader->TerminateThread(threadID);
+  if(sent != EXIT_SUCCESS)
+    {
+    return EXIT_FAILURE;
+    }
+  for(unsigned int i = 0; i < fileNames.size(); ++i)
+    {
+    if(statuses[i] != STATUS_Success)
+      {
+      std::cerr << "The SCP answered the C-STORE of " << fileNames[i]
+                << " with status 0x" << std::hex << statuses[i] << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+  if(statuses.back() == STATUS_Success)
+    {
+    std::cerr << "The SCP accepted SOP instance UID " << sendUIDs.back()
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+  if(data.Result != EXIT_SUCCESS)
+    {
+    std::cerr << "The storage SCP failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  const std::string seriesVolume = directory + "/scp_" + seriesUID + ".nrrd";
+  if(CheckSyntheticVolume(seriesVolume,parameters) != EXIT_SUCCESS)
+    {
+    return EXIT_FAILURE;
+    }
+  if(DWIConvertCompareDigests(directVolume,seriesVolume,std::cerr) !=
+     EXIT_SUCCESS)
+    {
+    std::cerr << directVolume << " and " << seriesVolume << " differ"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+
+/** Convert the files listed in list, one per line, with
+ *  --inputDicomFileList and --writeVolumeDigests; the list is a file
+ *  in directory, or standard input if fromStandardInput. */
+int
+ConvertFileList(const std::string &directory,
+                const std::string &list,
+                bool fromStandardInput,
+                const std::string &outputVolume)
+{
+  std::string listName("-");
+  std::istringstream input(list);
+  std::streambuf * const cinBuffer = std::cin.rdbuf();
+  if(fromStandardInput)
+    {
+    std::cin.rdbuf(input.rdbuf());
+    }
+  else
+    {
+    listName = directory + "/files.txt";
+    std::ofstream listFile(listName.c_str());
+    listFile << list;
+    }
+  const char *args[] = { "DWIConvert",
+                         "--inputDicomFileList", listName.c_str(),
+                         "--outputVolume", outputVolume.c_str(),
+                         "--writeVolumeDigests" };
+  const int rval = DWIConvertMain(6,const_cast<char **>(args));
+  std::cin.rdbuf(cinBuffer);
+  return rval;
+}
+
+/** Convert a synthetic series from a shuffled --inputDicomFileList,
+ *  read from a file and from standard input, and check that both
+ *  give the volume converted from the series' directory; then check
+ *  that a list mixing the files of two series is refused.
+ */
+int DWIConvertFileListTest(int argc, char *argv[])
+{
+  if(argc < 2)
+    {
+    std::cerr << "Usage: DWIConvertFileListTest <scratch directory>"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+  const std::string directory(argv[1]);
+  const std::string dicomDirectory = directory + "/dicom";
+  const std::string otherDirectory = directory + "/other";
+  itksys::SystemTools::RemoveADirectory(directory.c_str());
+
+  DWISyntheticSeriesParameters parameters;
+  parameters.Rows = parameters.Columns = 16;
+  parameters.SlicesPerVolume = 4;
+  parameters.Gradients = 3;
+  std::vector<std::string> fileNames;
+  std::vector<std::string> otherFileNames;
+  if(WriteDWISyntheticSeries(dicomDirectory,parameters,fileNames) != EXIT_SUCCESS ||
+     WriteDWISyntheticSeries(otherDirectory,parameters,otherFileNames) != EXIT_SUCCESS)
+    {
+    return EXIT_FAILURE;
+    }
+
+  const std::string directVolume = directory + "/direct.nrrd";
+  const char *directArgs[] = { "DWIConvert",
+                               "--inputDicomDirectory", dicomDirectory.c_str(),
+                               "--outputVolume", directVolume.c_str(),
+                               "--writeVolumeDigests" };
+  if(DWIConvertMain(6,const_cast<char **>(directArgs)) != EXIT_SUCCESS)
+    {
+    std::cerr << "Conversion of " << dicomDirectory << " failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // out of instance number order, with the comments, blank lines and
+  // trailing blanks a list may have
+  std::vector<std::string> shuffled(fileNames);
+  srand(1);
+  std::random_shuffle(shuffled.begin(),shuffled.end());
+  std::ostringstream list;
+  list << "# shuffled" << std::endl << std::endl;
+  for(unsigned int i = 0; i < shuffled.size(); ++i)
+    {
+    list << shuffled[i] << (i % 2 == 0 ? " " : "") << std::endl;
+    }
+
+  for(unsigned int fromStandardInput = 0; fromStandardInput < 2;
+      ++fromStandardInput)
+    {
+    const std::string listVolume = directory +
+      (fromStandardInput ? "/stdin.nrrd" : "/list.nrrd");
+    if(ConvertFileList(directory,list.str(),fromStandardInput != 0,
+                       listVolume) != EXIT_SUCCESS)
+      {
+      std::cerr << "Conversion of the shuffled list"
+                << (fromStandardInput ? " on standard input" : "")
+                << " failed" << std::endl;
+      return EXIT_FAILURE;
+      }
+    if(CheckSyntheticVolume(listVolume,parameters) != EXIT_SUCCESS)
+      {
+      return EXIT_FAILURE;
+      }
+    if(DWIConvertCompareDigests(directVolume,listVolume,std::cerr) !=
+       EXIT_SUCCESS)
+      {
+      std::cerr << directVolume << " and " << listVolume << " differ"
+                << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+
+  // every file of the series, and one of another series
+  const std::string mixed = list.str() + otherFileNames[0] + "\n";
+  std::ostringstream errors;
+  std::streambuf * const cerrBuffer = std::cerr.rdbuf(errors.rdbuf());
+  const int mixedResult =
+    ConvertFileList(directory,mixed,false,directory + "/mixed.nrrd");
+  std::cerr.rdbuf(cerrBuffer);
+  if(mixedResult == EXIT_SUCCESS ||
+     errors.str().find("belong to more than one series") == std::string::npos)
+    {
+    std::cerr << "A list mixing two series wasn't refused as such:"
+              << std::endl << errors.str();
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+
+/** Convert a synthetic series from a directory that holds another
+ *  one too, with --inputSeriesUID and I/O accounting on, and check
+ *  that the volume is the one converted from the series' own
+ *  directory, and that the files of the other series were only
+ *  probed for their series UID: parsed once, never decoded.  Each of
+ *  the two series is converted in turn.
+ */
+int DWIConvertSeriesUIDTest(int argc, char *argv[])
+{
+  if(argc < 2)
+    {
+    std::cerr << "Usage: DWIConvertSeriesUIDTest <scratch directory>"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+  const std::string directory(argv[1]);
+  const std::string mixedDirectory = directory + "/mixed";
+  itksys::SystemTools::RemoveADirectory(directory.c_str());
+
+  DWISyntheticSeriesParameters parameters;
+  parameters.Rows = parameters.Columns = 16;
+  parameters.SlicesPerVolume = 4;
+  parameters.Gradients = 3;
+  std::vector<std::string> seriesUIDs(2);
+  std::vector<std::string> directVolumes(2);
+  // the files of each series in mixedDirectory
+  std::vector< std::vector<std::string> > mixedFileNames(2);
+  for(unsigned int s = 0; s < 2; ++s)
+    {
+    std::ostringstream seriesDirectory;
+    seriesDirectory << directory << "/series" << s;
+    const std::string seriesDirectoryName = seriesDirectory.str();
+    std::vector<std::string> fileNames;
+    if(WriteDWISyntheticSeries(seriesDirectoryName,parameters,
+                               fileNames) != EXIT_SUCCESS)
+      {
+      return EXIT_FAILURE;
+      }
+    if(!itk::DCMTKFileReader::ReadSeriesUID(fileNames[0],seriesUIDs[s]))
+      {
+      std::cerr << "No series UID in " << fileNames[0] << std::endl;
+      return EXIT_FAILURE;
+      }
+    // what --inputSeriesUID must convert to
+    directVolumes[s] = seriesDirectoryName + ".nrrd";
+    const char *directArgs[] = { "DWIConvert",
+                                 "--inputDicomDirectory",
+                                 seriesDirectoryName.c_str(),
+                                 "--outputVolume", directVolumes[s].c_str(),
+                                 "--writeVolumeDigests" };
+    if(DWIConvertMain(6,const_cast<char **>(directArgs)) != EXIT_SUCCESS)
+      {
+      std::cerr << "Conversion of " << seriesDirectoryName << " failed"
+                << std::endl;
+      return EXIT_FAILURE;
+      }
+    // the generated files of both series have the same names
+    itksys::SystemTools::MakeDirectory(mixedDirectory.c_str());
+    for(unsigned int i = 0; i < fileNames.size(); ++i)
+      {
+      std::ostringstream mixedFileName;
+      mixedFileName << mixedDirectory << "/series" << s << "_"
+                    << itksys::SystemTools::GetFilenameName(fileNames[i]);
+      mixedFileNames[s].push_back(
+        itksys::SystemTools::CollapseFullPath(mixedFileName.str().c_str()));
+      if(!itksys::SystemTools::CopyFileAlways(fileNames[i].c_str(),
+                                              mixedFileName.str().c_str()))
+        {
+        std::cerr << "Can't copy " << fileNames[i] << std::endl;
+        return EXIT_FAILURE;
+        }
+      }
+    }
+
+  for(unsigned int s = 0; s < 2; ++s)
+    {
+    const std::string outputVolume = directory + "/SeriesUIDTest.nrrd";
+    const char *args[] = { "DWIConvert",
+                           "--inputDicomDirectory", mixedDirectory.c_str(),
+                           "--inputSeriesUID", seriesUIDs[s].c_str(),
+                           "--outputVolume", outputVolume.c_str(),
+                           "--writeVolumeDigests" };
+    DWIConvertIOAccounting::Start();
+    const int rval = DWIConvertMain(8,const_cast<char **>(args));
+    const DWIConvertIOAccounting::CountsMap counts =
+      DWIConvertIOAccounting::GetCounts();
+    DWIConvertIOAccounting::Stop();
+    if(rval != EXIT_SUCCESS)
+      {
+      std::cerr << "Conversion of series " << seriesUIDs[s] << " of "
+                << mixedDirectory << " failed" << std::endl;
+      return EXIT_FAILURE;
+      }
+    if(DWIConvertCompareDigests(directVolumes[s],outputVolume,std::cerr) !=
+       EXIT_SUCCESS)
+      {
+      std::cerr << "Series " << seriesUIDs[s] << " of " << mixedDirectory
+                << " isn't the one converted from its own directory"
+                << std::endl;
+      return EXIT_FAILURE;
+      }
+
+    const std::vector<std::string> &otherFileNames = mixedFileNames[1 - s];
+    for(unsigned int i = 0; i < otherFileNames.size(); ++i)
+      {
+      DWIConvertIOAccounting::CountsMap::const_iterator it =
+        counts.find(otherFileNames[i]);
+      if(it == counts.end() || it->second.HeaderParses != 1 ||
+         it->second.PixelDecodes != 0)
+        {
+        std::cerr << otherFileNames[i] << ", of another series, was ";
+        if(it == counts.end())
+          {
+          std::cerr << "never probed";
+          }
+        else
+          {
+          std::cerr << "parsed " << it->second.HeaderParses
+                    << " times and decoded " << it->second.PixelDecodes
+                    << " times, expected once and never";
+          }
+        std::cerr << std::endl;
+        return EXIT_FAILURE;
+        }
+      }
+    }
+  return EXIT_SUCCESS;
+}
@@ -12,10 +12,16 @@
 #include "itksys/SystemTools.hxx"
 #include <itkImageRegionIterator.h>
 #include <itkImageRegionConstIterator.h>
-#include <itkSubtractImageFilter.h>
-#include <itkStatisticsImageFilter.h>
+#include <itkMultiThreader.h>
+#include <itkSimpleFastMutexLock.h>
+#include <itkByteSwapper.h>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <cstdlib>
 #include <vcl_algorithm.h>
 #include "DWIConvertUtils.h"
+#include "DWIConvertDigest.h"
 #include "DWISimpleCompareCLP.h"
 
 namespace
@@ -60,8 +66,452 @@ RecoverGVector(typename itk::Image<PixelType,DIMENSION>::Pointer &img)
   return rval;
 }
 
+/** what the threads comparing a chunk of the volumes share */
+template <class ImageType>
+struct CompareChunkInfo
+{
+  typedef typename ImageType::RegionType RegionType;
+  typedef typename ImageType::IndexType  IndexType;
+
+  const ImageType          *First;
+  const ImageType          *Second;
+  /** gets first - second, if not 0 */
+  ImageType                *Difference;
+  RegionType                Region;
+  unsigned int              NumberOfThreads;
+  double                    Tolerance;
+  itk::SimpleFastMutexLock  Mutex;
+  /** set by the first thread to find voxels that differ; the others
+   *  stop unless there is a difference volume to fill.  Read and
+   *  written with Mutex held. */
+  bool                      Differs;
+  IndexType                 DifferingIndex;
+  double                    DifferingFirst;
+  double                    DifferingSecond;
+  double                    MinimumDifference;
+  double                    MaximumDifference;
+};
+
+/** piece of count pieces of region, split along its outermost
+ *  dimension of more than one voxel; false if the piece is empty */
+template <class RegionType>
+bool
+SplitRegion(const RegionType &region, unsigned int piece, unsigned int count,
+            RegionType &pieceRegion)
+{
+  pieceRegion = region;
+  int dim = RegionType::ImageDimension - 1;
+  while(dim > 0 && region.GetSize(dim) == 1)
+    {
+    --dim;
+    }
+  const itk::SizeValueType size = region.GetSize(dim);
+  const itk::SizeValueType begin = (size * piece) / count;
+  const itk::SizeValueType end = (size * (piece + 1)) / count;
+  if(begin == end)
+    {
+    return false;
+    }
+  pieceRegion.SetIndex(dim,region.GetIndex(dim) + begin);
+  pieceRegion.SetSize(dim,end - begin);
+  return true;
+}
+
+template <class ImageType>
+ITK_THREAD_RETURN_TYPE
+CompareChunkThread(void *arg)
+{
+  typedef typename ImageType::PixelType PixelType;
+  itk::MultiThreader::ThreadInfoStruct *threadInfo =
+    static_cast<itk::MultiThreader::ThreadInfoStruct *>(arg);
+  CompareChunkInfo<ImageType> *info =
+    static_cast<CompareChunkInfo<ImageType> *>(threadInfo->UserData);
+
+  typename ImageType::RegionType region;
+  if(!SplitRegion(info->Region,threadInfo->ThreadID,info->NumberOfThreads,region))
+    {
+    return ITK_THREAD_RETURN_VALUE;
+    }
+  itk::ImageRegionConstIterator<ImageType> firstIt(info->First,region);
+  itk::ImageRegionConstIterator<ImageType> secondIt(info->Second,region);
+  itk::ImageRegionIterator<ImageType> differenceIt;
+  if(info->Difference != 0)
+    {
+    differenceIt = itk::ImageRegionIterator<ImageType>(info->Difference,region);
+    }
+  double minimum = 0.0, maximum = 0.0;
+  bool differs = false;
+  typename ImageType::IndexType differingIndex;
+  double differingFirst = 0.0, differingSecond = 0.0;
+  unsigned long count = 0;
+  for(firstIt.GoToBegin(), secondIt.GoToBegin();
+      !firstIt.IsAtEnd(); ++firstIt, ++secondIt)
+    {
+    const PixelType first = firstIt.Get();
+    const PixelType second = secondIt.Get();
+    if(info->Difference != 0)
+      {
+      differenceIt.Set(static_cast<PixelType>(first - second));
+      ++differenceIt;
+      }
+    const double difference =
+      static_cast<double>(first) - static_cast<double>(second);
+    if(difference < minimum)
+      {
+      minimum = difference;
+      }
+    if(difference > maximum)
+      {
+      maximum = difference;
+      }
+    if(!differs && vcl_fabs(difference) > info->Tolerance)
+      {
+      differs = true;
+      differingIndex = firstIt.GetIndex();
+      differingFirst = first;
+      differingSecond = second;
+      if(info->Difference == 0)
+        {
+        break;
+        }
+      }
+    // look now and then whether another thread found a difference
+    if(info->Difference == 0 && (++count & 0xffff) == 0)
+      {
+      info->Mutex.Lock();
+      const bool otherDiffers = info->Differs;
+      info->Mutex.Unlock();
+      if(otherDiffers)
+        {
+        break;
+        }
+      }
+    }
+
+  info->Mutex.Lock();
+  if(minimum < info->MinimumDifference)
+    {
+    info->MinimumDifference = minimum;
+    }
+  if(maximum > info->MaximumDifference)
+    {
+    info->MaximumDifference = maximum;
+    }
+  if(differs && !info->Differs)
+    {
+    info->Differs = true;
+    info->DifferingIndex = differingIndex;
+    info->DifferingFirst = differingFirst;
+    info->DifferingSecond = differingSecond;
+    }
+  info->Mutex.Unlock();
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+/** where the voxels of a raw encoded NRRD file are */
+struct RawNrrdData
+{
+  std::string                FileName;
+  std::streamoff             Offset;
+  bool                       BigEndian;
+  /** the sizes of the axes, fastest first */
+  std::vector<unsigned long> Sizes;
+};
+
+/** Find the voxels of the NRRD file headerName, attached or detached,
+ *  when they are raw encoded in one data file, pixelSize bytes each;
+ *  false for other encodings and layouts, which only the ImageIO can
+ *  read, and then only as a whole. */
+bool
+FindRawNrrdData(const std::string &headerName, size_t pixelSize,
+                RawNrrdData &data)
+{
+  std::ifstream header(headerName.c_str(),std::ios::in | std::ios::binary);
+  std::string line;
+  if(!std::getline(header,line) || line.compare(0,4,"NRRD") != 0)
+    {
+    return false;
+    }
+  std::string dataFile, encoding, endian;
+  long lineSkip = 0, byteSkip = 0;
+  while(std::getline(header,line))
+    {
+    if(!line.empty() && line[line.size() - 1] == '\r')
+      {
+      line.erase(line.size() - 1);
+      }
+    if(line.empty())
+      {
+      // the end of an attached header
+      break;
+      }
+    const std::string::size_type colon = line.find(": ");
+    if(line[0] == '#' || line.find(":=") != std::string::npos ||
+       colon == std::string::npos)
+      {
+      continue;
+      }
+    const std::string key = line.substr(0,colon);
+    const std::string value = line.substr(colon + 2);
+    if(key == "data file" || key == "datafile")
+      {
+      dataFile = value;
+      }
+    else if(key == "encoding")
+      {
+      encoding = value;
+      }
+    else if(key == "endian")
+      {
+      endian = value;
+      }
+    else if(key == "line skip" || key == "lineskip")
+      {
+      lineSkip = atol(value.c_str());
+      }
+    else if(key == "byte skip" || key == "byteskip")
+      {
+      byteSkip = atol(value.c_str());
+      }
+    else if(key == "sizes")
+      {
+      std::istringstream sizes(value);
+      unsigned long size;
+      while(sizes >> size)
+        {
+        data.Sizes.push_back(size);
+        }
+      }
+    }
+  // a list or pattern of data files has spaces in it
+  if(encoding != "raw" || dataFile.find(' ') != std::string::npos ||
+     dataFile.compare(0,4,"LIST") == 0)
+    {
+    return false;
+    }
+  std::streamoff dataSize = pixelSize;
+  for(size_t i = 0; i < data.Sizes.size(); ++i)
+    {
+    dataSize *= data.Sizes[i];
+    }
+  std::streamoff offset = 0;
+  if(dataFile == "")
+    {
+    data.FileName = headerName;
+    offset = header.tellg();
+    }
+  else if(itksys::SystemTools::FileIsFullPath(dataFile.c_str()))
+    {
+    data.FileName = dataFile;
+    }
+  else
+    {
+    const std::string directory =
+      itksys::SystemTools::GetFilenamePath(headerName);
+    data.FileName = directory == "" ? dataFile : directory + "/" + dataFile;
+    }
+  std::ifstream dataStream(data.FileName.c_str(),std::ios::in | std::ios::binary);
+  dataStream.seekg(offset);
+  for(long i = 0; i < lineSkip && std::getline(dataStream,line); ++i)
+    {
+    }
+  if(!dataStream.good() || offset < 0)
+    {
+    return false;
+    }
+  offset = dataStream.tellg();
+  const std::streamoff fileSize = static_cast<std::streamoff>(
+    itksys::SystemTools::FileLength(data.FileName.c_str()));
+  // -1 puts the data at the end of the file
+  data.Offset = byteSkip == -1 ? fileSize - dataSize : offset + byteSkip;
+  data.BigEndian = endian == "big";
+  return data.Offset >= 0 && data.Offset + dataSize <= fileSize;
+}
+
+/** read chunk's buffered region from the raw data of a file, at
+ *  chunkOffset bytes into it */
+template <class ImageType>
+bool
+ReadRawChunk(std::ifstream &file, const RawNrrdData &data,
+             std::streamoff chunkOffset, ImageType *chunk)
+{
+  typedef typename ImageType::PixelType PixelType;
+  const size_t nPixels = chunk->GetBufferedRegion().GetNumberOfPixels();
+  PixelType *pixels = chunk->GetBufferPointer();
+  file.seekg(data.Offset + chunkOffset);
+  file.read(reinterpret_cast<char *>(pixels),nPixels * sizeof(PixelType));
+  if(!file.good())
+    {
+    return false;
+    }
+  if(data.BigEndian)
+    {
+    itk::ByteSwapper<PixelType>::SwapRangeFromSystemToBigEndian(pixels,nPixels);
+    }
+  else
+    {
+    itk::ByteSwapper<PixelType>::SwapRangeFromSystemToLittleEndian(pixels,nPixels);
+    }
+  return true;
+}
+
+/** Compare the voxels of the volumes the readers read, a chunk at a
+ *  time; the readers' headers must be read and agree.  Raw encoded
+ *  NRRD files are read a chunk at a time here, since the NRRD ImageIO
+ *  can't stream; other files are read whole by the readers. */
+template <class ImageType>
+int
+CompareVoxels(itk::ImageFileReader<ImageType> *firstReader,
+              itk::ImageFileReader<ImageType> *secondReader,
+              const std::string &outputDifference,
+              double tolerance,
+              int numberOfThreads)
+{
+  int rval(EXIT_SUCCESS);
+  typename ImageType::Pointer firstImage = firstReader->GetOutput();
+  typename ImageType::Pointer secondImage = secondReader->GetOutput();
+  const typename ImageType::RegionType region =
+    firstImage->GetLargestPossibleRegion();
+
+  typename ImageType::Pointer differenceImage;
+  if(outputDifference != "")
+    {
+    differenceImage = ImageType::New();
+    differenceImage->CopyInformation(firstImage);
+    differenceImage->SetRegions(region);
+    differenceImage->Allocate();
+    }
+
+  CompareChunkInfo<ImageType> info;
+  info.Difference = differenceImage.GetPointer();
+  info.Tolerance = tolerance;
+  info.Differs = false;
+  info.MinimumDifference = info.MaximumDifference = 0.0;
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  if(numberOfThreads > 0)
+    {
+    threader->SetNumberOfThreads(numberOfThreads);
+    }
+  // SetNumberOfThreads clamps to the global maximum
+  info.NumberOfThreads = threader->GetNumberOfThreads();
+  threader->SetSingleMethod(CompareChunkThread<ImageType>,&info);
+
+  // a chunk is a gradient volume, or a slice of a single volume
+  unsigned int chunkDim = ImageType::GetImageDimension() - 1;
+  while(chunkDim > 0 && region.GetSize(chunkDim) == 1)
+    {
+    --chunkDim;
+    }
+  typedef typename ImageType::PixelType PixelType;
+  typename ImageType::RegionType chunkRegion = region;
+  chunkRegion.SetSize(chunkDim,1);
+  const std::streamoff chunkBytes =
+    static_cast<std::streamoff>(chunkRegion.GetNumberOfPixels()) * sizeof(PixelType);
+
+  // the voxels can be read a chunk at a time if both files store
+  // them raw, as the pixel type, with the axes of the image
+  const itk::ImageIOBase *firstIO = firstReader->GetImageIO();
+  const itk::ImageIOBase *secondIO = secondReader->GetImageIO();
+  RawNrrdData firstData, secondData;
+  bool rawChunks =
+    firstIO->GetComponentType() == secondIO->GetComponentType() &&
+    firstIO->GetComponentSize() == sizeof(PixelType) &&
+    FindRawNrrdData(firstReader->GetFileName(),sizeof(PixelType),firstData) &&
+    FindRawNrrdData(secondReader->GetFileName(),sizeof(PixelType),secondData) &&
+    firstData.Sizes == secondData.Sizes &&
+    firstData.Sizes.size() <= ImageType::GetImageDimension();
+  for(unsigned int i = 0; rawChunks && i < ImageType::GetImageDimension(); ++i)
+    {
+    const unsigned long size =
+      i < firstData.Sizes.size() ? firstData.Sizes[i] : 1;
+    rawChunks = size == region.GetSize(i);
+    }
+  std::ifstream firstFile, secondFile;
+  typename ImageType::Pointer firstChunk, secondChunk;
+  if(rawChunks)
+    {
+    firstFile.open(firstData.FileName.c_str(),std::ios::in | std::ios::binary);
+    secondFile.open(secondData.FileName.c_str(),std::ios::in | std::ios::binary);
+    firstChunk = ImageType::New();
+    firstChunk->SetRegions(chunkRegion);
+    firstChunk->Allocate();
+    secondChunk = ImageType::New();
+    secondChunk->SetRegions(chunkRegion);
+    secondChunk->Allocate();
+    }
+  try
+    {
+    for(itk::SizeValueType chunk = 0; chunk < region.GetSize(chunkDim); ++chunk)
+      {
+      info.Region = chunkRegion;
+      info.Region.SetIndex(chunkDim,region.GetIndex(chunkDim) + chunk);
+      if(rawChunks)
+        {
+        // same buffers, moved to this chunk
+        firstChunk->SetRegions(info.Region);
+        secondChunk->SetRegions(info.Region);
+        if(!ReadRawChunk<ImageType>(firstFile,firstData,chunk * chunkBytes,
+                                    firstChunk.GetPointer()) ||
+           !ReadRawChunk<ImageType>(secondFile,secondData,chunk * chunkBytes,
+                                    secondChunk.GetPointer()))
+          {
+          std::cerr << "Can't read the voxels of "
+                    << firstReader->GetFileName() << " or "
+                    << secondReader->GetFileName() << std::endl;
+          return EXIT_FAILURE;
+          }
+        info.First = firstChunk.GetPointer();
+        info.Second = secondChunk.GetPointer();
+        }
+      else
+        {
+        // the first chunk reads the whole of both files
+        firstImage->SetRequestedRegion(info.Region);
+        secondImage->SetRequestedRegion(info.Region);
+        firstReader->Update();
+        secondReader->Update();
+        info.First = firstImage.GetPointer();
+        info.Second = secondImage.GetPointer();
+        }
+      threader->SingleMethodExecute();
+      if(info.Differs && differenceImage.IsNull())
+        {
+        break;
+        }
+      }
+    }
+  catch( itk::ExceptionObject& e )
+    {
+    std::cerr << "Exception detected while comparing "
+              << firstReader->GetFileName() << "  "
+              << secondReader->GetFileName() << e.GetDescription();
+    return EXIT_FAILURE;
+    }
+  if(info.Differs)
+    {
+    std::cerr << "Image Data Differs -- at " << info.DifferingIndex
+              << " " << info.DifferingFirst << " != "
+              << info.DifferingSecond << std::endl;
+    if(differenceImage.IsNotNull())
+      {
+      std::cerr << "min diff " << info.MinimumDifference
+                << " max diff " << info.MaximumDifference << std::endl;
+      typedef typename itk::ImageFileWriter<ImageType> ImageWriter;
+      typename ImageWriter::Pointer writer = ImageWriter::New();
+      writer->SetInput(differenceImage);
+      writer->SetFileName(outputDifference);
+      writer->Write();
+      }
+    rval = EXIT_FAILURE;
+    }
+  return rval;
+}
+
 template <class PixelType>
-int DoIt( const std::string &inputVolume1, const std::string &inputVolume2, PixelType, bool CheckDWIData )
+int DoIt( const std::string &inputVolume1, const std::string &inputVolume2, PixelType, bool CheckDWIData,
+          bool digestOnly, const std::string &outputDifference,
+          double tolerance, int numberOfThreads )
 {
 
   int rval(EXIT_SUCCESS);
@@ -74,7 +524,8 @@ int DoIt( const std::string &inputVolume1, const std::string &inputVolume2, Pixe
   firstReader->SetFileName( inputVolume1.c_str() );
   secondReader->SetFileName( inputVolume2.c_str() );
 
-  firstReader->Update(); secondReader->Update();
+  // only the header for now; the voxels are read a chunk at a time
+  firstReader->UpdateOutputInformation(); secondReader->UpdateOutputInformation();
   typename ImageType::Pointer firstImage = firstReader->GetOutput();
   typename ImageType::Pointer secondImage = secondReader->GetOutput();
   //
@@ -89,62 +540,58 @@ int DoIt( const std::string &inputVolume1, const std::string &inputVolume2, Pixe
               << " " << secondOrigin << std::endl;
     return EXIT_FAILURE;
     }
-  else if(distance > 1.0E-6)
-    {
-    // if there is a small difference make them the same
-    firstImage->SetOrigin(secondOrigin);
-    }
   // same deal with spacing, can be slightly off due to numerical error
   typename ImageType::SpacingType firstSpacing(firstImage->GetSpacing());
   typename ImageType::SpacingType secondSpacing(secondImage->GetSpacing());
   for(unsigned int i = 0; i < ImageType::GetImageDimension(); ++i)
     {
     double diff = vcl_fabs(firstSpacing[i] - secondSpacing[i]);
-    if(diff > 1.0e-6 && diff < 1.0e-4)
+    if(diff >= 1.0e-4)
       {
-      firstSpacing[i] = secondSpacing[i];
+      std::cerr << "Spacings differ " << firstSpacing
+                << " " << secondSpacing << std::endl;
+      return EXIT_FAILURE;
       }
     }
-  firstImage->SetSpacing(firstSpacing);
-  typedef itk::SubtractImageFilter<ImageType> SubtractFilterType;
-  typename SubtractFilterType::Pointer subtractFilter =
-    SubtractFilterType::New();
-  subtractFilter->SetInput1(firstReader->GetOutput());
-  subtractFilter->SetInput2(secondReader->GetOutput());
-  subtractFilter->Update();
-
-  typename ImageType::Pointer subtractImage = subtractFilter->GetOutput();
-
-  typedef itk::StatisticsImageFilter<ImageType> StatisticsFilterType;
-  typename StatisticsFilterType::Pointer statisticsFilter =
-    StatisticsFilterType::New();
-  statisticsFilter->SetInput(subtractImage);
-  try
+  const typename ImageType::DirectionType &firstDirection =
+    firstImage->GetDirection();
+  const typename ImageType::DirectionType &secondDirection =
+    secondImage->GetDirection();
+  for(unsigned int i = 0; i < ImageType::GetImageDimension(); ++i)
     {
-    statisticsFilter->Update();
+    for(unsigned int j = 0; j < ImageType::GetImageDimension(); ++j)
+      {
+      if(vcl_fabs(firstDirection[i][j] - secondDirection[i][j]) > 1.0e-6)
+        {
+        std::cerr << "Directions differ " << std::endl << firstDirection
+                  << secondDirection << std::endl;
+        return EXIT_FAILURE;
+        }
+      }
     }
-  catch( itk::ExceptionObject& e )
+  const typename ImageType::RegionType region =
+    firstImage->GetLargestPossibleRegion();
+  if(region != secondImage->GetLargestPossibleRegion())
     {
-    std::cerr << "Exception detected while comparing "
-              << inputVolume1 << "  "
-              << inputVolume2 << e.GetDescription();
+    std::cerr << "Image sizes differ " << region.GetSize() << " "
+              << secondImage->GetLargestPossibleRegion().GetSize() << std::endl;
     return EXIT_FAILURE;
     }
-  if(vcl_fabs(static_cast<float>(statisticsFilter->GetMaximum())) > 0.0001 ||
-     vcl_fabs(static_cast<float>(statisticsFilter->GetMinimum())) > 0.0001)
-    {
-    std::cerr << "Image Data Differs -- min diff "
-              << statisticsFilter->GetMinimum() << " max diff "
-              << statisticsFilter->GetMaximum() << std::endl;
-    typedef typename itk::ImageFileWriter<ImageType> ImageWriter;
-    typename ImageWriter::Pointer writer = ImageWriter::New();
-    writer->SetInput(subtractImage);
-    std::string filename =
-      itksys::SystemTools::GetFilenameWithoutExtension(inputVolume1);
-    filename = itksys::SystemTools::GetFilenameName(filename);
-    filename += "-diff.nrrd";
-    writer->SetFileName(filename);
-    writer->Write();
+
+  if(digestOnly)
+    {
+    // the headers are compared as usual, the voxels by the digests
+    // DWIConvert wrote beside them
+    if(DWIConvertCompareDigests(inputVolume1,inputVolume2,std::cerr) != EXIT_SUCCESS)
+      {
+      std::cerr << "Image Data Differs" << std::endl;
+      rval = EXIT_FAILURE;
+      }
+    }
+  else if(CompareVoxels<ImageType>(firstReader,secondReader,
+                                   outputDifference,tolerance,
+                                   numberOfThreads) != EXIT_SUCCESS)
+    {
     rval = EXIT_FAILURE;
     }
   if(!CheckDWIData)
@@ -236,31 +683,40 @@ int main( int argc, char * argv[] )
     switch( componentType )
       {
       case itk::ImageIOBase::UCHAR:
-        rval = DoIt( inputVolume1, inputVolume2, static_cast<unsigned char>(0),CheckDWIData );
+        rval = DoIt( inputVolume1, inputVolume2, static_cast<unsigned char>(0),CheckDWIData,
+                     digestOnly, outputDifference, tolerance, numberOfThreads );
         break;
       case itk::ImageIOBase::CHAR:
-        rval = DoIt( inputVolume1, inputVolume2, static_cast<char>(0),CheckDWIData );
+        rval = DoIt( inputVolume1, inputVolume2, static_cast<char>(0),CheckDWIData,
+                     digestOnly, outputDifference, tolerance, numberOfThreads );
         break;
       case itk::ImageIOBase::USHORT:
-        rval = DoIt( inputVolume1, inputVolume2, static_cast<unsigned short>(0),CheckDWIData );
+        rval = DoIt( inputVolume1, inputVolume2, static_cast<unsigned short>(0),CheckDWIData,
+                     digestOnly, outputDifference, tolerance, numberOfThreads );
         break;
       case itk::ImageIOBase::SHORT:
-        rval = DoIt( inputVolume1, inputVolume2, static_cast<short>(0),CheckDWIData );
+        rval = DoIt( inputVolume1, inputVolume2, static_cast<short>(0),CheckDWIData,
+                     digestOnly, outputDifference, tolerance, numberOfThreads );
         break;
       case itk::ImageIOBase::UINT:
-        rval = DoIt( inputVolume1, inputVolume2, static_cast<unsigned int>(0),CheckDWIData );
+        rval = DoIt( inputVolume1, inputVolume2, static_cast<unsigned int>(0),CheckDWIData,
+                     digestOnly, outputDifference, tolerance, numberOfThreads );
         break;
       case itk::ImageIOBase::INT:
-        rval = DoIt( inputVolume1, inputVolume2, static_cast<int>(0),CheckDWIData );
+        rval = DoIt( inputVolume1, inputVolume2, static_cast<int>(0),CheckDWIData,
+                     digestOnly, outputDifference, tolerance, numberOfThreads );
         break;
       case itk::ImageIOBase::ULONG:
-        rval = DoIt( inputVolume1, inputVolume2, static_cast<unsigned long>(0),CheckDWIData );
+        rval = DoIt( inputVolume1, inputVolume2, static_cast<unsigned long>(0),CheckDWIData,
+                     digestOnly, outputDifference, tolerance, numberOfThreads );
         break;
       case itk::ImageIOBase::LONG:
-        rval = DoIt( inputVolume1, inputVolume2, static_cast<long>(0),CheckDWIData );
+        rval = DoIt( inputVolume1, inputVolume2, static_cast<long>(0),CheckDWIData,
+                     digestOnly, outputDifference, tolerance, numberOfThreads );
         break;
       case itk::ImageIOBase::FLOAT:
-        rval = DoIt( inputVolume1, inputVolume2, static_cast<float>(0),CheckDWIData );
+        rval = DoIt( inputVolume1, inputVolume2, static_cast<float>(0),CheckDWIData,
+                     digestOnly, outputDifference, tolerance, numberOfThreads );
         // std::cout << "FLOAT type not currently supported." << std::endl;
         break;
       case itk::ImageIOBase::DOUBLE:
@@ -32,6 +32,9 @@ if(NOT EXISTS ${TEST_BASELINE})
   message( FATAL_ERROR "Failed: Baseline image ${TEST_BASELINE} does not exist!\n")
 endif( NOT EXISTS ${TEST_BASELINE})
 
+# TEST_PROGRAM_ARGS may hold several space separated arguments
+separate_arguments(TEST_PROGRAM_ARGS)
+
 # run the test program, capture the stdout/stderr and the result var
 set(Test_Command_Line
   ${TEST_PROGRAM} --inputDicomDirectory ${TEST_INPUT} --outputVolume ${TEST_TEMP_OUTPUT} ${TEST_PROGRAM_ARGS}
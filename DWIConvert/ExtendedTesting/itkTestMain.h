@@ -28,10 +28,12 @@
 #include "itkWin32Header.h"
 #include <map>
 #include <string>
+#include <vector>
 #include <iostream>
 #include <fstream>
 #include "itkNumericTraits.h"
 #include "itkMultiThreader.h"
+#include "itkSimpleFastMutexLock.h"
 #include "itkImage.h"
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
@@ -53,10 +55,30 @@ std::map<std::string, MainFuncPointer> StringToTestFunctionMap;
   extern int test(int, char * [] ); \
   StringToTestFunctionMap[#test] = test
 
+typedef itk::Image<double, ITK_TEST_DIMENSION_MAX> RegressionTestImageType;
+
 int RegressionTestImage(const char *testImageFilename, const char *baselineImageFilename, int reportErrors,
                         double intensityTolerance = 2.0, unsigned int numberOfPixelsTolerance = 0,
                         unsigned int radiusTolerance = 0);
 
+// Compare a test image already read against one baseline; numberOfThreads
+// of 0 lets the difference filter use the default
+int RegressionTestImage(RegressionTestImageType *testImage, const char *testImageFilename,
+                        const char *baselineImageFilename, int reportErrors,
+                        double intensityTolerance, unsigned int numberOfPixelsTolerance,
+                        unsigned int radiusTolerance, unsigned int numberOfThreads = 0);
+
+int ReadRegressionTestImage(const char *testImageFilename,
+                            RegressionTestImageType::Pointer &testImage);
+
+// Compare a test image against all of its baselines in parallel,
+// stopping once one matches; the status of baselines not compared
+// is left at itk::NumericTraits<int>::max()
+void RegressionTestAllBaselines(RegressionTestImageType *testImage, const char *testImageFilename,
+                                const std::vector<std::string> &baselines, std::vector<int> &status,
+                                double intensityTolerance, unsigned int numberOfPixelsTolerance,
+                                unsigned int radiusTolerance);
+
 std::map<std::string, int> RegressionTestBaselines(char *);
 
 void RegisterTests();
@@ -182,33 +204,43 @@ int main(int ac, char* av[] )
         char *                               baselineFilename = compareList[i].first;
         char *                               testFilename = compareList[i].second;
         std::map<std::string, int>           baselines = RegressionTestBaselines(baselineFilename);
-        std::map<std::string, int>::iterator baseline = baselines.begin();
-        std::string                          bestBaseline;
-        int                                  bestBaselineStatus = itk::NumericTraits<int>::max();
-        while( baseline != baselines.end() )
+        std::vector<std::string>             baselineNames;
+        for( std::map<std::string, int>::const_iterator baseline = baselines.begin();
+             baseline != baselines.end(); ++baseline )
+          {
+          baselineNames.push_back(baseline->first);
+          }
+        // the test image is read once, for all of the baselines
+        RegressionTestImageType::Pointer testImage;
+        std::vector<int>                 baselineStatus(baselineNames.size(), 1000);
+        if( ReadRegressionTestImage(testFilename, testImage) == 0 )
+          {
+          RegressionTestAllBaselines(testImage, testFilename, baselineNames, baselineStatus,
+                                     intensityTolerance,
+                                     numberOfPixelsTolerance,
+                                     radiusTolerance );
+          }
+        // the first baseline that matches, or else the closest
+        std::string bestBaseline = baselineNames[0];
+        int         bestBaselineStatus = itk::NumericTraits<int>::max();
+        for( unsigned int b = 0; b < baselineNames.size(); ++b )
           {
-          baseline->second = RegressionTestImage(testFilename,
-                                                 (baseline->first).c_str(),
-                                                 0,
-                                                 intensityTolerance,
-                                                 numberOfPixelsTolerance,
-                                                 radiusTolerance );
-          if( baseline->second < bestBaselineStatus )
+          if( baselineStatus[b] < bestBaselineStatus )
             {
-            bestBaseline = baseline->first;
-            bestBaselineStatus = baseline->second;
+            bestBaseline = baselineNames[b];
+            bestBaselineStatus = baselineStatus[b];
             }
-          if( baseline->second == 0 )
+          if( bestBaselineStatus == 0 )
             {
             break;
             }
-          ++baseline;
           }
 
         // if the best we can do still has errors, generate the error images
-        if( bestBaselineStatus )
+        if( bestBaselineStatus && testImage.IsNotNull() )
           {
-          RegressionTestImage(testFilename,
+          RegressionTestImage(testImage,
+                              testFilename,
                               bestBaseline.c_str(),
                               1,
                               intensityTolerance,
@@ -250,6 +282,27 @@ int main(int ac, char* av[] )
 
 // Regression Testing Code
 
+// Use the factory mechanism to read the test file and convert it to double
+int ReadRegressionTestImage(const char *testImageFilename,
+                            RegressionTestImageType::Pointer &testImage)
+{
+  typedef itk::ImageFileReader<RegressionTestImageType> ReaderType;
+  ReaderType::Pointer testReader = ReaderType::New();
+  testReader->SetFileName(testImageFilename);
+  try
+    {
+    testReader->UpdateLargestPossibleRegion();
+    }
+  catch( itk::ExceptionObject& e )
+    {
+    std::cerr << "Exception detected while reading " << testImageFilename << " : "  << e.GetDescription() << std::endl;
+    return 1000;
+    }
+  testImage = testReader->GetOutput();
+  testImage->DisconnectPipeline();
+  return 0;
+}
+
 int RegressionTestImage(const char *testImageFilename,
                         const char *baselineImageFilename,
                         int reportErrors,
@@ -257,9 +310,117 @@ int RegressionTestImage(const char *testImageFilename,
                         unsigned int numberOfPixelsTolerance,
                         unsigned int radiusTolerance )
 {
-  // Use the factory mechanism to read the test and baseline files and convert
-  // them to double
-  typedef itk::Image<double, ITK_TEST_DIMENSION_MAX>        ImageType;
+  RegressionTestImageType::Pointer testImage;
+  const int status = ReadRegressionTestImage(testImageFilename, testImage);
+  if( status != 0 )
+    {
+    return status;
+    }
+  return RegressionTestImage(testImage, testImageFilename, baselineImageFilename, reportErrors,
+                             intensityTolerance, numberOfPixelsTolerance, radiusTolerance);
+}
+
+// what the threads comparing baselines share
+struct RegressionTestBaselineInfo
+{
+  RegressionTestImageType        *TestImage;
+  const char                     *TestImageFilename;
+  const std::vector<std::string> *Baselines;
+  std::vector<int>               *Status;
+  double                          IntensityTolerance;
+  unsigned int                    NumberOfPixelsTolerance;
+  unsigned int                    RadiusTolerance;
+  itk::SimpleFastMutexLock        Mutex;
+  unsigned int                    NextBaseline;
+  bool                            Matched;
+};
+
+ITK_THREAD_RETURN_TYPE RegressionTestBaselineThread(void *arg)
+{
+  itk::MultiThreader::ThreadInfoStruct *threadInfo =
+    static_cast<itk::MultiThreader::ThreadInfoStruct *>(arg);
+  RegressionTestBaselineInfo *info =
+    static_cast<RegressionTestBaselineInfo *>(threadInfo->UserData);
+
+  // each thread has its own image object sharing the test image's
+  // voxels, as the pipeline sets the requested region of its inputs
+  RegressionTestImageType::Pointer testImage = RegressionTestImageType::New();
+  testImage->CopyInformation(info->TestImage);
+  testImage->SetRegions(info->TestImage->GetLargestPossibleRegion() );
+  testImage->SetPixelContainer(info->TestImage->GetPixelContainer() );
+  for(;; )
+    {
+    info->Mutex.Lock();
+    if( info->Matched || info->NextBaseline >= info->Baselines->size() )
+      {
+      info->Mutex.Unlock();
+      break;
+      }
+    const unsigned int baseline = info->NextBaseline++;
+    info->Mutex.Unlock();
+
+    // the baselines are compared in parallel, not the voxels of each
+    const int status = RegressionTestImage(testImage, info->TestImageFilename,
+                                           (*info->Baselines)[baseline].c_str(), 0,
+                                           info->IntensityTolerance,
+                                           info->NumberOfPixelsTolerance,
+                                           info->RadiusTolerance,
+                                           info->Baselines->size() > 1 ? 1 : 0);
+    info->Mutex.Lock();
+    (*info->Status)[baseline] = status;
+    if( status == 0 )
+      {
+      info->Matched = true;
+      }
+    info->Mutex.Unlock();
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+void RegressionTestAllBaselines(RegressionTestImageType *testImage, const char *testImageFilename,
+                                const std::vector<std::string> &baselines, std::vector<int> &status,
+                                double intensityTolerance, unsigned int numberOfPixelsTolerance,
+                                unsigned int radiusTolerance)
+{
+  status.assign(baselines.size(), itk::NumericTraits<int>::max() );
+  RegressionTestBaselineInfo info;
+  info.TestImage = testImage;
+  info.TestImageFilename = testImageFilename;
+  info.Baselines = &baselines;
+  info.Status = &status;
+  info.IntensityTolerance = intensityTolerance;
+  info.NumberOfPixelsTolerance = numberOfPixelsTolerance;
+  info.RadiusTolerance = radiusTolerance;
+  info.NextBaseline = 0;
+  info.Matched = false;
+
+  unsigned int numberOfThreads = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+  if( numberOfThreads > baselines.size() )
+    {
+    numberOfThreads = baselines.size();
+    }
+  if( numberOfThreads < 1 )
+    {
+    numberOfThreads = 1;
+    }
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetNumberOfThreads(numberOfThreads);
+  threader->SetSingleMethod(RegressionTestBaselineThread, &info);
+  threader->SingleMethodExecute();
+}
+
+int RegressionTestImage(RegressionTestImageType *testImage,
+                        const char *testImageFilename,
+                        const char *baselineImageFilename,
+                        int reportErrors,
+                        double intensityTolerance,
+                        unsigned int numberOfPixelsTolerance,
+                        unsigned int radiusTolerance,
+                        unsigned int numberOfThreads )
+{
+  // Use the factory mechanism to read the baseline file and convert
+  // it to double
+  typedef RegressionTestImageType                           ImageType;
   typedef itk::Image<unsigned char, ITK_TEST_DIMENSION_MAX> OutputType;
   typedef itk::Image<unsigned char, 2>                      DiffOutputType;
   typedef itk::ImageFileReader<ImageType>                   ReaderType;
@@ -277,24 +438,11 @@ int RegressionTestImage(const char *testImageFilename,
     return 1000;
     }
 
-  // Read the file generated by the test
-  ReaderType::Pointer testReader = ReaderType::New();
-  testReader->SetFileName(testImageFilename);
-  try
-    {
-    testReader->UpdateLargestPossibleRegion();
-    }
-  catch( itk::ExceptionObject& e )
-    {
-    std::cerr << "Exception detected while reading " << testImageFilename << " : "  << e.GetDescription() << std::endl;
-    return 1000;
-    }
-
   // The sizes of the baseline and test image must match
   ImageType::SizeType baselineSize;
   baselineSize = baselineReader->GetOutput()->GetLargestPossibleRegion().GetSize();
   ImageType::SizeType testSize;
-  testSize = testReader->GetOutput()->GetLargestPossibleRegion().GetSize();
+  testSize = testImage->GetLargestPossibleRegion().GetSize();
 
   if( baselineSize != testSize )
     {
@@ -310,9 +458,13 @@ int RegressionTestImage(const char *testImageFilename,
   typedef itk::LOCAL_DifferenceImageFilter<ImageType, ImageType> DiffType;
   DiffType::Pointer diff = DiffType::New();
   diff->SetValidInput(baselineReader->GetOutput() );
-  diff->SetTestInput(testReader->GetOutput() );
+  diff->SetTestInput(testImage);
   diff->SetDifferenceThreshold( intensityTolerance );
   diff->SetToleranceRadius( radiusTolerance );
+  if( numberOfThreads > 0 )
+    {
+    diff->SetNumberOfThreads( numberOfThreads );
+    }
   diff->UpdateLargestPossibleRegion();
 
   unsigned long status = 0;
@@ -435,7 +587,7 @@ int RegressionTestImage(const char *testImageFilename,
     testName << testImageFilename << ".test.png";
     try
       {
-      rescale->SetInput(testReader->GetOutput() );
+      rescale->SetInput(testImage);
       rescale->Update();
       }
     catch( const std::exception& e )
@@ -20,7 +20,8 @@ int
 FSLToNrrd(const std::string &inputVolume,
           const std::string &outputVolume,
           const std::string &inputBValues,
-          const std::string &inputBVectors)
+          const std::string &inputBVectors,
+          unsigned int dataAlignment)
 {
   if(CheckArg<std::string>("Input Volume",inputVolume,"") == EXIT_FAILURE ||
      CheckArg<std::string>("Output Volume",outputVolume,"") == EXIT_FAILURE ||
@@ -73,10 +74,7 @@ FSLToNrrd(const std::string &inputVolume,
   VolumeType::PointType inputOrigin = inputVol->GetOrigin();
   VolumeType::DirectionType inputDirection = inputVol->GetDirection();
 
-  std::ofstream header;
-  //std::string headerFileName = outputDir + "/" + outputFileName;
-
-  header.open (outputVolume.c_str(), std::ios::out | std::ios::binary);
+  std::ostringstream header;
   header << "NRRD0005" << std::endl;
   header << "type: short" << std::endl;
   header << "dimension: 4" << std::endl;
@@ -143,11 +141,13 @@ FSLToNrrd(const std::string &inputVolume,
     }
 
   // write data in the same file is .nrrd was chosen
-  header << std::endl;;
-  unsigned long nVoxels = inputVol->GetLargestPossibleRegion().GetNumberOfPixels();
-  header.write( reinterpret_cast<char *>(inputVol->GetBufferPointer()),
-                nVoxels*sizeof(short) );
-  header.close();
+  std::ofstream headerFile;
+  headerFile.open (outputVolume.c_str(), std::ios::out | std::ios::binary);
+  headerFile << FinishNrrdHeader(header.str(),dataAlignment);
+  const size_t nVoxels = inputVol->GetLargestPossibleRegion().GetNumberOfPixels();
+  headerFile.write( reinterpret_cast<char *>(inputVol->GetBufferPointer()),
+                    nVoxels*sizeof(short) );
+  headerFile.close();
   return EXIT_SUCCESS;
 }
 
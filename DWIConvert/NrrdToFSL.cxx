@@ -45,24 +45,12 @@ VolumeType::Pointer CreateVolume(VectorVolumeType::Pointer &inputVol)
   return niftiVolume;
 }
 
-int NrrdToFSL(const std::string &inputVolume,
-              const std::string &outputVolume,
-              const std::string &outputBValues,
-              const std::string &outputBVectors)
+/** Copy component k of each voxel of inputVol into volume k of
+ *  niftiVolume, which CreateVolume made for it.
+ */
+void VectorImageToVolumes(VectorVolumeType::Pointer &inputVol,
+                          VolumeType::Pointer &niftiVolume)
 {
-  if(CheckArg<std::string>("Input Volume",inputVolume,"") == EXIT_FAILURE ||
-     CheckArg<std::string>("Output Volume",outputVolume,"") == EXIT_FAILURE ||
-     CheckArg<std::string>("B Values", outputBValues, "") == EXIT_FAILURE ||
-     CheckArg<std::string>("B Vectors", outputBVectors, ""))
-    {
-    return EXIT_FAILURE;
-    }
-  VectorVolumeType::Pointer inputVol;
-  if(ReadVolume<VectorVolumeType>( inputVol, inputVolume ) != EXIT_SUCCESS)
-    {
-    return EXIT_FAILURE;
-    }
-  VolumeType::Pointer niftiVolume = CreateVolume(inputVol);
   VectorVolumeType::SizeType inputSize =
     inputVol->GetLargestPossibleRegion().GetSize();
   int vecLength = inputVol->GetNumberOfComponentsPerPixel();
@@ -86,6 +74,27 @@ int NrrdToFSL(const std::string &inputVolume,
         }
       }
     }
+}
+
+int NrrdToFSL(const std::string &inputVolume,
+              const std::string &outputVolume,
+              const std::string &outputBValues,
+              const std::string &outputBVectors)
+{
+  if(CheckArg<std::string>("Input Volume",inputVolume,"") == EXIT_FAILURE ||
+     CheckArg<std::string>("Output Volume",outputVolume,"") == EXIT_FAILURE ||
+     CheckArg<std::string>("B Values", outputBValues, "") == EXIT_FAILURE ||
+     CheckArg<std::string>("B Vectors", outputBVectors, ""))
+    {
+    return EXIT_FAILURE;
+    }
+  VectorVolumeType::Pointer inputVol;
+  if(ReadVolume<VectorVolumeType>( inputVol, inputVolume ) != EXIT_SUCCESS)
+    {
+    return EXIT_FAILURE;
+    }
+  VolumeType::Pointer niftiVolume = CreateVolume(inputVol);
+  VectorImageToVolumes(inputVol,niftiVolume);
   if(WriteVolume<VolumeType>(niftiVolume,outputVolume) != EXIT_SUCCESS)
     {
     return EXIT_FAILURE;
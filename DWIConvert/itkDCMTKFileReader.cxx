@@ -40,9 +40,26 @@
 #include "dcvrda.h"          /* for DcmDate */
 #include "dcvrpn.h"          /* for DcmPersonName */
 #include "dcmimage.h"        /* fore DicomImage */
+#include "dcmtk/dcmjpeg/djdecode.h"  /* for DJDecoderRegistration */
+#include "dcmtk/dcmdata/dcrledrg.h"  /* for DcmRLEDecoderRegistration */
 // #include "diregist.h"     /* include to support color images */
 #include "vnl/vnl_cross.h"
+#include "itkSimpleFastMutexLock.h"
+#include <algorithm>
+#include <map>
+#include "StringContains.h"
+#include "DWIConvertTrace.h"
+#include "DWIConvertIOAccounting.h"
+
+namespace
+{
+itk::SimpleFastMutexLock CodecRegistrationLock;
+unsigned int             CodecRegistrationCount(0);
 
+// the datasets LoadFile finds in memory, by file name
+itk::SimpleFastMutexLock           MemoryDatasetLock;
+std::map<std::string,DcmDataset *> MemoryDatasets;
+}
 
 namespace itk
 {
@@ -97,7 +114,7 @@ DCMTKSequence
   this->m_DcmSequenceOfItems = seq;
 }
 
-int
+unsigned long
 DCMTKSequence
 ::card()
 {
@@ -298,7 +315,7 @@ DCMTKSequence
 
 int
 DCMTKSequence
-::GetElementItem(unsigned short index,
+::GetElementItem(unsigned long index,
                  DCMTKItem &target,
                  bool throwException)
 {
@@ -362,6 +379,11 @@ bool
 DCMTKFileReader
 ::CanReadFile(const std::string &filename)
 {
+  if(FindMemoryDataset(filename) != 0)
+    {
+    return true;
+    }
+  DWIConvertIOAccess access(filename,DWIConvertIOAccounting::HeaderParse);
   DcmFileFormat *DFile = new DcmFileFormat();
   bool rval(true);
   if(DFile != 0 && DFile->loadFile(filename.c_str(),
@@ -385,7 +407,8 @@ DCMTKFileReader
   bool rval = DCMTKFileReader::CanReadFile(filename);
   if(rval != false)
     {
-    DicomImage *image = new DicomImage(filename.c_str());
+    DWIConvertIOAccess access(filename,DWIConvertIOAccounting::PixelDecode);
+    DicomImage *image = NewDicomImage(filename);
     if(image != 0)
       {
       if(!image->getStatus() != EIS_Normal &&
@@ -407,6 +430,46 @@ DCMTKFileReader
   return rval;
 }
 
+bool
+DCMTKFileReader
+::ReadSeriesUID(const std::string &filename,
+                std::string &seriesUID)
+{
+  // values longer than this are skipped over, not read
+  const Uint32 maxReadLength = 256;
+  DWIConvertIOAccess access(filename,DWIConvertIOAccounting::HeaderParse);
+  DcmFileFormat fileFormat;
+#if defined(DWIConvert_HAVE_LOADFILEUNTILTAG)
+  // (0020,000e) is the last tag parsed
+  OFCondition cond =
+    fileFormat.loadFileUntilTag(filename.c_str(),
+                                EXS_Unknown,
+                                EGL_noChange,
+                                maxReadLength,
+                                ERM_autoDetect,
+                                DcmTagKey(0x0020,0x000f));
+#else
+  OFCondition cond =
+    fileFormat.loadFile(filename.c_str(),
+                        EXS_Unknown,
+                        EGL_noChange,
+                        maxReadLength);
+#endif
+  if(cond != EC_Normal)
+    {
+    return false;
+    }
+  OFString uid;
+  // the same value GetElementUI returns
+  if(fileFormat.getDataset()->findAndGetOFStringArray(DCM_SeriesInstanceUID,
+                                                      uid).bad())
+    {
+    return false;
+    }
+  seriesUID = uid.c_str();
+  return true;
+}
+
 void
 DCMTKFileReader
 ::LoadFile()
@@ -418,7 +481,29 @@ DCMTKFileReader
   if(this->m_DFile != 0)
     {
     delete this->m_DFile;
+    this->m_DFile = 0;
+    }
+  this->m_Dataset = FindMemoryDataset(this->m_FileName);
+  if(this->m_Dataset == 0)
+    {
+    this->ReadFile();
+    }
+  this->m_Xfer = this->m_Dataset->getOriginalXfer();
+  if(this->m_Dataset->findAndGetSint32(DCM_NumberOfFrames,this->m_FrameCount).bad())
+    {
+    this->m_FrameCount = 1;
     }
+  int fnum;
+  this->GetElementIS(0x0020,0x0013,fnum);
+  this->m_FileNumber = fnum;
+}
+
+void
+DCMTKFileReader
+::ReadFile()
+{
+  DWIConvertTraceSpan span("LoadFile",this->m_FileName);
+  DWIConvertIOAccess access(this->m_FileName,DWIConvertIOAccounting::HeaderParse);
   this->m_DFile = new DcmFileFormat();
   OFCondition cond = this->m_DFile->loadFile(this->m_FileName.c_str());
                                              // /* transfer syntax, autodetect */
@@ -438,13 +523,89 @@ DCMTKFileReader
     itkGenericExceptionMacro(<< cond.text() << ": reading file " << this->m_FileName);
     }
   this->m_Dataset = this->m_DFile->getDataset();
+}
+
+DcmDataset *
+DCMTKFileReader
+::TakeDataset()
+{
+  if(this->m_DFile == 0)
+    {
+    return 0;
+    }
+  DcmDataset *dataset = this->m_DFile->getAndRemoveDataset();
+  this->m_Dataset = 0;
+  return dataset;
+}
+
+void
+DCMTKFileReader
+::AddMemoryDataset(const std::string &fileName, DcmDataset *dataset)
+{
+  MemoryDatasetLock.Lock();
+  DcmDataset *&entry = MemoryDatasets[fileName];
+  if(entry != dataset)
+    {
+    delete entry;
+    entry = dataset;
+    }
+  MemoryDatasetLock.Unlock();
+}
+
+void
+DCMTKFileReader
+::RemoveMemoryDataset(const std::string &fileName)
+{
+  MemoryDatasetLock.Lock();
+  std::map<std::string,DcmDataset *>::iterator it =
+    MemoryDatasets.find(fileName);
+  if(it != MemoryDatasets.end())
+    {
+    delete it->second;
+    MemoryDatasets.erase(it);
+    }
+  MemoryDatasetLock.Unlock();
+}
+
+DcmDataset *
+DCMTKFileReader
+::FindMemoryDataset(const std::string &fileName)
+{
+  MemoryDatasetLock.Lock();
+  std::map<std::string,DcmDataset *>::const_iterator it =
+    MemoryDatasets.find(fileName);
+  DcmDataset *dataset = it == MemoryDatasets.end() ? 0 : it->second;
+  MemoryDatasetLock.Unlock();
+  return dataset;
+}
+
+DicomImage *
+DCMTKFileReader
+::NewDicomImage(const std::string &fileName)
+{
+  DcmDataset *dataset = FindMemoryDataset(fileName);
+  if(dataset == 0)
+    {
+    return new DicomImage(fileName.c_str());
+    }
+  // the image only refers to the dataset, which stays where it is
+  return new DicomImage(dataset,dataset->getOriginalXfer());
+}
+
+void
+DCMTKFileReader
+::SetDataset(DcmDataset *dataset)
+{
+  delete this->m_DFile;
+  this->m_DFile = 0;
+  this->m_Dataset = dataset;
   this->m_Xfer = this->m_Dataset->getOriginalXfer();
   if(this->m_Dataset->findAndGetSint32(DCM_NumberOfFrames,this->m_FrameCount).bad())
     {
     this->m_FrameCount = 1;
     }
-  int fnum;
-  this->GetElementIS(0x0020,0x0013,fnum);
+  ::itk::int32_t fnum(0);
+  this->GetElementIS(0x0020,0x0013,fnum,false);
   this->m_FileNumber = fnum;
 }
 
@@ -1357,6 +1518,133 @@ DCMTKFileReader
   return m_FileNumber;
 }
 
+bool
+DCMTKFileReader
+::HasElement(unsigned short group,
+             unsigned short element) const
+{
+  if(this->m_Dataset == 0)
+    {
+    return false;
+    }
+  DcmTagKey tagkey(group,element);
+  return this->m_Dataset->tagExistsWithValue(tagkey,OFTrue);
+}
+
+bool
+DCMTKFileReader
+::IsDiffusionWeighted()
+{
+  if(this->m_Dataset == 0)
+    {
+    return false;
+    }
+  // enhanced MR files keep it in the functional group sequences
+  Float64 b(0.0);
+  if(this->m_Dataset->findAndGetFloat64(DcmTagKey(0x0018,0x9087),b,
+                                        0,OFTrue).good() && b != 0.0)
+    {
+    return true;
+    }
+  std::string vendor;
+  if(this->GetElementLO(0x0008,0x0070,vendor,false) != EXIT_SUCCESS)
+    {
+    return false;
+    }
+  strupper(vendor);
+  try
+    {
+    if(StringContains(vendor,"GE"))
+      {
+      ::itk::int32_t intB(0);
+      if(this->GetElementISorOB(0x0043,0x1039,intB,false) == EXIT_SUCCESS &&
+         intB != 0)
+        {
+        return true;
+        }
+      for(unsigned short element = 0x10bb; element <= 0x10bd; ++element)
+        {
+        double direction(0.0);
+        if(this->GetElementDSorOB<double>(0x0019,element,direction,false) ==
+           EXIT_SUCCESS && direction != 0.0)
+          {
+          return true;
+          }
+        }
+      }
+    else if(StringContains(vendor,"SIEMENS"))
+      {
+      ::itk::int32_t intB(0);
+      if(this->GetElementISorOB(0x0019,0x100c,intB,false) == EXIT_SUCCESS &&
+         intB != 0)
+        {
+        return true;
+        }
+      for(unsigned long i = 0; i < 3; ++i)
+        {
+        Float64 direction(0.0);
+        if(this->m_Dataset->findAndGetFloat64(DcmTagKey(0x0019,0x100e),
+                                              direction,i).good() &&
+           direction != 0.0)
+          {
+          return true;
+          }
+        }
+      }
+    else if(StringContains(vendor,"PHILIPS"))
+      {
+      float floatB(0.0f);
+      if(this->GetElementFLorOB(0x2001,0x1003,floatB,false) == EXIT_SUCCESS &&
+         floatB != 0.0f)
+        {
+        return true;
+        }
+      for(unsigned short element = 0x10b0; element <= 0x10b2; ++element)
+        {
+        Float32 direction(0.0f);
+        if(this->m_Dataset->findAndGetFloat32(DcmTagKey(0x2005,element),
+                                              direction).good() &&
+           direction != 0.0f)
+          {
+          return true;
+          }
+        }
+      }
+    }
+  catch(...)
+    {
+    // a private element that can't be read as either type
+    }
+  return false;
+}
+
+void
+DCMTKFileReader
+::RegisterCodecs()
+{
+  CodecRegistrationLock.Lock();
+  if(CodecRegistrationCount++ == 0)
+    {
+    // needed for lossless JPeg and RLE compressed images
+    DJDecoderRegistration::registerCodecs();
+    DcmRLEDecoderRegistration::registerCodecs();
+    }
+  CodecRegistrationLock.Unlock();
+}
+
+void
+DCMTKFileReader
+::UnregisterCodecs()
+{
+  CodecRegistrationLock.Lock();
+  if(CodecRegistrationCount > 0 && --CodecRegistrationCount == 0)
+    {
+    DJDecoderRegistration::cleanup();
+    DcmRLEDecoderRegistration::cleanup();
+    }
+  CodecRegistrationLock.Unlock();
+}
+
 void
 DCMTKFileReader
 ::AddDictEntry(DcmDictEntry *entry)
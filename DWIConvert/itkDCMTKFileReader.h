@@ -38,6 +38,7 @@
 class DcmSequenceOfItems;
 class DcmFileFormat;
 class DcmDictEntry;
+class DicomImage;
 
 // Don't print error messages if you're not throwing
 // an exception
@@ -79,7 +80,7 @@ class DCMTKSequence
 public:
   DCMTKSequence() : m_DcmSequenceOfItems(0) {}
   void SetDcmSequenceOfItems(DcmSequenceOfItems *seq);
-  int card();
+  unsigned long card();
   int GetSequence(unsigned long index,
                   DCMTKSequence &target,bool throwException = true);
   int GetStack(unsigned short group,
@@ -127,7 +128,7 @@ public:
   template <typename TType>
   int  GetElementDSorOB(unsigned short group,
                         unsigned short element,
-                        int count,
+                        unsigned long count,
                         TType  *target,
                         bool throwException = true)
     {
@@ -144,7 +145,7 @@ public:
         }
       const char *data = val.c_str();
       const TType *fptr = reinterpret_cast<const TType *>(data);
-      for(unsigned i = 0; i < count; ++i)
+      for(unsigned long i = 0; i < count; ++i)
         {
         target[i] = fptr[i];
         }
@@ -174,7 +175,7 @@ public:
   template <typename TType>
   int GetElementDS(unsigned short group,
                    unsigned short element,
-                   unsigned short count,
+                   unsigned long count,
                    TType  *target,
                    bool throwException = true)
     {
@@ -208,7 +209,7 @@ public:
                        << doubleVals.size() << std::dec);
 
         }
-      for(unsigned i = 0; i < count; i++)
+      for(unsigned long i = 0; i < count; i++)
         {
         target[i] = static_cast<TType>(doubleVals[i]);
         }
@@ -218,7 +219,7 @@ public:
                    unsigned short element,
                    DCMTKSequence &target,
                    bool throwException = true);
-  int GetElementItem(unsigned short itemIndex,
+  int GetElementItem(unsigned long itemIndex,
                      DCMTKItem &target,
                      bool throwException = true);
 
@@ -230,6 +231,13 @@ private:
   DcmSequenceOfItems *m_DcmSequenceOfItems;
 };
 
+/** \class DCMTKFileReader
+ *  Reads the header of one DICOM file.  Each reader owns its dataset,
+ *  so readers may be used concurrently, one reader per thread.  The
+ *  shared DCMTK state -- the codecs and the data dictionary -- is
+ *  only changed through RegisterCodecs/UnregisterCodecs and
+ *  AddDictEntry, which are thread-safe.
+ */
 class DCMTKFileReader
 {
 public:
@@ -248,8 +256,15 @@ public:
 
   const std::string &GetFileName() const;
 
+  /** read the header of the file, or find it in memory if a dataset
+   *  was added under its name with AddMemoryDataset */
   void LoadFile();
 
+  /** read the header from a dataset already in memory, e.g. one
+   *  received over the network, instead of loading the file; the
+   *  caller keeps the dataset, which must outlive the reader */
+  void SetDataset(DcmDataset *dataset);
+
   int GetElementLO(unsigned short group,
                    unsigned short element,
                    std::string &target,
@@ -265,7 +280,7 @@ public:
   template <typename TType>
   int  GetElementDS(unsigned short group,
                     unsigned short element,
-                    unsigned short count,
+                    unsigned long count,
                     TType  *target,
                     bool throwException = true)
     {
@@ -300,7 +315,7 @@ public:
                        << doubleVals.size() << std::dec);
 
         }
-      for(unsigned i = 0; i < count; i++)
+      for(unsigned long i = 0; i < count; i++)
         {
         target[i] = static_cast<TType>(doubleVals[i]);
         }
@@ -453,13 +468,73 @@ public:
   E_TransferSyntax GetTransferSyntax() const;
 
   long GetFileNumber() const;
+
+  /** true if the tag is present with a value, anywhere in the
+   *  dataset, including inside sequences
+   */
+  bool HasElement(unsigned short group,
+                  unsigned short element) const;
+
+  /** true if the header is that of a diffusion weighted image: a
+   *  non-zero DiffusionBValue or, for the manufacturer named in the
+   *  header, a non-zero GE, Siemens or Philips private b-value or
+   *  diffusion direction.  The private tags are only looked at for
+   *  their own manufacturer, since others use the same elements for
+   *  other things.  The b=0 images of a DWI series don't qualify;
+   *  a series is DWI if any of its images does.
+   */
+  bool IsDiffusionWeighted();
+
+  /** add to the global data dictionary, under its write lock */
   static void
   AddDictEntry(DcmDictEntry *entry);
 
+  /** Register the DCMTK decompression codecs.  Registrations are
+   *  counted, and the codecs are unregistered when the last one is
+   *  released, so conversions in several threads can share them.
+   */
+  static void RegisterCodecs();
+  static void UnregisterCodecs();
+
   static bool CanReadFile(const std::string &filename);
   static bool IsImageFile(const std::string &filename);
 
+  /** Read the SeriesInstanceUID of a file, parsing no further than
+   *  that tag when DCMTK supports it, and never loading long values
+   *  such as pixel data.  Returns false if the file isn't DICOM or
+   *  has no series UID.
+   */
+  static bool ReadSeriesUID(const std::string &filename,
+                            std::string &seriesUID);
+
+  /** Hand the dataset LoadFile read over to the caller, e.g. to keep
+   *  it with AddMemoryDataset; the reader can't be used afterwards.
+   *  Returns 0 if the dataset didn't come from a file this reader
+   *  loaded.
+   */
+  DcmDataset *TakeDataset();
+
+  /** Keep a parsed dataset in memory under a file name, so that
+   *  LoadFile finds it there instead of parsing the file again, e.g.
+   *  the headers parsed as files arrive in a watched directory.
+   *  Takes ownership of dataset, replacing one already kept under
+   *  the name.  A dataset must not be added or removed while readers
+   *  that found it are in use; each is used by one thread at a time.
+   */
+  static void AddMemoryDataset(const std::string &fileName,
+                               DcmDataset *dataset);
+  /** delete the dataset kept under fileName, if there is one */
+  static void RemoveMemoryDataset(const std::string &fileName);
+  static DcmDataset *FindMemoryDataset(const std::string &fileName);
+  /** Decode the pixel data of a file, or of the dataset kept under
+   *  its name with AddMemoryDataset; the caller deletes the image.
+   *  The name of a dataset kept in memory needn't be that of a file.
+   */
+  static DicomImage *NewDicomImage(const std::string &fileName);
+
 private:
+  /** parse the file into m_DFile */
+  void ReadFile();
 
   std::string          m_FileName;
   DcmFileFormat*       m_DFile;
@@ -21,12 +21,12 @@
 #include "itkByteSwapper.h"
 #include "itksys/SystemTools.hxx"
 #include "itkDCMTKFileReader.h"
+#include "DWIConvertTrace.h"
+#include "DWIConvertIOAccounting.h"
 #include <iostream>
 
 #include "dcmtk/dcmimgle/dcmimage.h"
-#include "dcmtk/dcmjpeg/djdecode.h"
 #include "dcmtk/dcmjpls/djdecode.h"
-#include "dcmtk/dcmdata/dcrledrg.h"
 
 namespace itk
 {
@@ -47,6 +47,9 @@ DCMTKImageIO::DCMTKImageIO()
   m_UseJPLSCodec = false;
   m_UseRLECodec  = false;
 
+  // the codecs stay registered as long as any DCMTKImageIO exists
+  DCMTKFileReader::RegisterCodecs();
+
   this->AddSupportedWriteExtension(".dcm");
   this->AddSupportedWriteExtension(".DCM");
   this->AddSupportedWriteExtension(".dicom");
@@ -60,7 +63,9 @@ DCMTKImageIO::DCMTKImageIO()
 
 /** Destructor */
 DCMTKImageIO::~DCMTKImageIO()
-{}
+{
+  DCMTKFileReader::UnregisterCodecs();
+}
 
 bool DCMTKImageIO::CanReadFile(const char *filename)
 {
@@ -142,7 +147,10 @@ DCMTKImageIO
     }
   if( m_DImage == NULL )
     {
-    m_DImage = new DicomImage( m_FileName.c_str() );
+    // DicomImage decodes the pixel data as it is constructed
+    DWIConvertTraceSpan span("decode",this->m_FileName);
+    DWIConvertIOAccess access(this->m_FileName,DWIConvertIOAccounting::PixelDecode);
+    m_DImage = DCMTKFileReader::NewDicomImage(this->m_FileName);
     this->m_LastFileName = this->m_FileName;
     }
   if(this->m_DImage == 0)
@@ -156,6 +164,8 @@ void
 DCMTKImageIO
 ::Read(void *buffer)
 {
+  DWIConvertTraceSpan span("DCMTKImageIO::Read",this->m_FileName,
+                           this->GetImageSizeInBytes());
   this->OpenDicomImage();
   if (m_DImage->getStatus() == EIS_Normal)
     {
@@ -212,7 +222,7 @@ DCMTKImageIO
                           ImageIOBase::GetComponentTypeAsString(this->m_ComponentType));
         break;
       }
-    unsigned voxelSize(scalarSize);
+    size_t voxelSize(scalarSize);
     switch(this->m_PixelType)
       {
       case VECTOR:
@@ -231,7 +241,7 @@ DCMTKImageIO
     const DiPixel *interData = m_DImage->getInterData();
     memcpy(buffer,
            interData->getData(),
-           interData->getCount() * voxelSize);
+           static_cast<size_t>(interData->getCount()) * voxelSize);
 
     }
   else
@@ -248,10 +258,6 @@ DCMTKImageIO
  */
 void DCMTKImageIO::ReadImageInformation()
 {
-
-  DJDecoderRegistration::registerCodecs();
-  DcmRLEDecoderRegistration::registerCodecs();
-
   DCMTKFileReader reader;
   reader.SetFileName(this->m_FileName);
   try
@@ -21,6 +21,7 @@
 #include "itkProgressReporter.h"
 #include "itkDCMTKFileReader.h"
 #include "itksys/Directory.hxx"
+#include "DWIConvertTrace.h"
 #include <algorithm>
 
 namespace itk
@@ -77,15 +78,25 @@ DCMTKSeriesFileNames
   this->Modified();
 }
 
-void
-DCMTKSeriesFileNames
-::GetDicomData(const std::string &series, bool saveFileNames)
+namespace
+{
+/** a file found by the scan, sortable by instance number */
+struct ScannedFile
 {
-  if(saveFileNames)
+  long        FileNumber;
+  std::string FileName;
+  bool operator<(const ScannedFile &other) const
     {
-    this->m_InputFileNames.clear();
+      return this->FileNumber < other.FileNumber;
     }
-  this->m_SeriesUIDs.clear();
+};
+}
+
+void
+DCMTKSeriesFileNames
+::ListInputDirectory(FilenamesContainer &fileNames) const
+{
+  fileNames.clear();
 
   // make an absolute path from whatever is passed in
   std::string fullPath =
@@ -104,8 +115,6 @@ DCMTKSeriesFileNames
 
   unsigned int numFiles = directory.GetNumberOfFiles();
 
-  std::vector<DCMTKFileReader *> allHeaders;
-
   for(unsigned int i = 0; i < numFiles; i++)
     {
     std::string curFile = directory.GetFile(i);
@@ -119,60 +128,159 @@ DCMTKSeriesFileNames
     itksys::SystemTools::ConvertToOutputPath(localFilePath.c_str());
     if(!itksys::SystemTools::FileIsDirectory(localFilePath.c_str()))
       {
-      if(!DCMTKFileReader::IsImageFile(localFilePath))
-        {
-        continue;
-        }
-      DCMTKFileReader *reader = new DCMTKFileReader;
-      try
-        {
-        reader->SetFileName(localFilePath);
-        reader->LoadFile();
-        }
-      catch(...)
-        {
-        delete reader;
-        continue;
-        }
-      std::string uid;
-      reader->GetElementUI(0x0020,0x000e,uid);
-      //
-      // if you've restricked it to a particular series instance ID
-      if(series == "" || series == uid)
-        {
-        allHeaders.push_back(reader);
-        }
-      else
+      fileNames.push_back(localFilePath);
+      }
+    }
+}
+
+void
+DCMTKSeriesFileNames
+::BuildSeriesCatalog()
+{
+  if(this->m_SeriesCatalogTime.GetMTime() > this->GetMTime())
+    {
+    return;
+    }
+  this->m_SeriesCatalog.clear();
+  this->m_SeriesUIDs.clear();
+  this->m_AllFileNames.clear();
+
+  FilenamesContainer directoryFiles;
+  this->ListInputDirectory(directoryFiles);
+
+  std::vector<ScannedFile> allFiles;
+  std::map<std::string, std::vector<ScannedFile> > seriesFiles;
+
+  for(unsigned int i = 0; i < directoryFiles.size(); i++)
+    {
+    const std::string &localFilePath = directoryFiles[i];
+    {
+    DWIConvertTraceSpan span("probe",localFilePath);
+    if(!DCMTKFileReader::IsImageFile(localFilePath))
+      {
+      continue;
+      }
+    }
+    DCMTKFileReader reader;
+    try
+      {
+      reader.SetFileName(localFilePath);
+      reader.LoadFile();
+      }
+    catch(...)
+      {
+      continue;
+      }
+    std::string uid;
+    reader.GetElementUI(0x0020,0x000e,uid,false);
+
+    SeriesCatalogType::iterator it = this->m_SeriesCatalog.find(uid);
+    if(it == this->m_SeriesCatalog.end())
+      {
+      // the per-series attributes come from its first file
+      SeriesInfo info;
+      info.SeriesUID = uid;
+      reader.GetElementCS(0x0008,0x0060,info.Modality,false);
+      reader.GetElementLO(0x0008,0x0070,info.Manufacturer,false);
+      reader.GetElementLO(0x0008,0x103e,info.SeriesDescription,false);
+      ::itk::int32_t seriesNumber(0);
+      if(reader.GetElementIS(0x0020,0x0011,seriesNumber,false) == EXIT_SUCCESS)
         {
-        delete reader;
+        info.SeriesNumber = seriesNumber;
         }
-      //
-      // save the UID at any rate
+      it = this->m_SeriesCatalog.insert(std::make_pair(uid,info)).first;
       this->m_SeriesUIDs.push_back(uid);
       }
-    }
+    SeriesInfo &info = it->second;
+    info.NumberOfBytes += itksys::SystemTools::FileLength(localFilePath.c_str());
+    if(!info.HasDiffusionTags)
+      {
+      info.HasDiffusionTags = reader.IsDiffusionWeighted();
+      }
 
-  if(saveFileNames)
-    {
-    std::sort(allHeaders.begin(),allHeaders.end(), CompareDCMTKFileReaders);
+    ScannedFile file;
+    file.FileNumber = reader.GetFileNumber();
+    file.FileName = reader.GetFileName();
+    seriesFiles[uid].push_back(file);
+    allFiles.push_back(file);
     }
-  //
-  // save the filenames, and delete the headers
-  for(unsigned i = 0; i < allHeaders.size(); ++i)
+
+  for(std::map<std::string, std::vector<ScannedFile> >::iterator it =
+        seriesFiles.begin(); it != seriesFiles.end(); ++it)
     {
-    if(saveFileNames)
+    std::stable_sort(it->second.begin(),it->second.end());
+    FilenamesContainer &fileNames = this->m_SeriesCatalog[it->first].FileNames;
+    for(unsigned i = 0; i < it->second.size(); ++i)
       {
-      m_InputFileNames.push_back(allHeaders[i]->GetFileName());
+      fileNames.push_back(it->second[i].FileName);
       }
-    delete allHeaders[i];
     }
+  std::stable_sort(allFiles.begin(),allFiles.end());
+  for(unsigned i = 0; i < allFiles.size(); ++i)
+    {
+    this->m_AllFileNames.push_back(allFiles[i].FileName);
+    }
+  this->m_SeriesCatalogTime.Modified();
 }
 
 const DCMTKSeriesFileNames::FilenamesContainer &
 DCMTKSeriesFileNames
 ::GetFileNames(const std::string series)
 {
-  this->GetDicomData(series,true);
+  this->m_InputFileNames.clear();
+  if(this->m_SeriesCatalogTime.GetMTime() > this->GetMTime())
+    {
+    SeriesCatalogType::const_iterator it = this->m_SeriesCatalog.find(series);
+    if(it != this->m_SeriesCatalog.end())
+      {
+      this->m_InputFileNames = it->second.FileNames;
+      }
+    return m_InputFileNames;
+    }
+
+  // Without a catalog, only the files of this series are read in
+  // full; the others are rejected once their series UID is known.
+  FilenamesContainer directoryFiles;
+  this->ListInputDirectory(directoryFiles);
+
+  std::vector<ScannedFile> files;
+  for(unsigned int i = 0; i < directoryFiles.size(); i++)
+    {
+    std::string uid;
+    {
+    DWIConvertTraceSpan span("probe",directoryFiles[i]);
+    if(!DCMTKFileReader::ReadSeriesUID(directoryFiles[i],uid) ||
+       uid != series)
+      {
+      continue;
+      }
+    }
+    DCMTKFileReader reader;
+    try
+      {
+      reader.SetFileName(directoryFiles[i]);
+      reader.LoadFile();
+      }
+    catch(...)
+      {
+      continue;
+      }
+    // an image file, judged from the header rather than by decoding
+    // the pixel data as the catalog does
+    if(!reader.HasElement(0x7fe0,0x0010))
+      {
+      continue;
+      }
+    ScannedFile file;
+    file.FileNumber = reader.GetFileNumber();
+    file.FileName = reader.GetFileName();
+    files.push_back(file);
+    }
+  std::stable_sort(files.begin(),files.end());
+  for(unsigned i = 0; i < files.size(); ++i)
+    {
+    this->m_InputFileNames.push_back(files[i].FileName);
+    }
   return m_InputFileNames;
 }
 
@@ -180,17 +288,25 @@ const DCMTKSeriesFileNames::SeriesUIDContainer &
 DCMTKSeriesFileNames::
 GetSeriesUIDs()
 {
-  this->GetDicomData("",false);
+  this->BuildSeriesCatalog();
   return this->m_SeriesUIDs;
 }
 
+const DCMTKSeriesFileNames::SeriesCatalogType &
+DCMTKSeriesFileNames
+::GetSeriesCatalog()
+{
+  this->BuildSeriesCatalog();
+  return this->m_SeriesCatalog;
+}
 
 const DCMTKSeriesFileNames::FilenamesContainer &
 DCMTKSeriesFileNames
 ::GetInputFileNames()
 {
   // Do not specify any UID
-  this->GetDicomData("",true);
+  this->BuildSeriesCatalog();
+  this->m_InputFileNames = this->m_AllFileNames;
   return this->m_InputFileNames;
 }
 
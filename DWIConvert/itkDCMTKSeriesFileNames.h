@@ -21,7 +21,9 @@
 #include "itkProcessObject.h"
 #include "itkObjectFactory.h"
 #include "itkMacro.h"
+#include "itkIntTypes.h"
 #include <vector>
+#include <map>
 
 namespace itk
 {
@@ -43,6 +45,11 @@ namespace itk
  *    dicom objects, you may want to try calling ->SetUseSeriesDetails(true)
  *    prior to calling SetDirectory().
  *
+ *  The directory is scanned once into a catalog of the series it
+ *  holds; GetSeriesUIDs, GetFileNames, GetInputFileNames and
+ *  GetSeriesCatalog are all answered from that catalog until the
+ *  directory or the loading options change.
+ *
  * \ingroup IOFilters
  *
  * \ingroup ITKIODCMTK
@@ -58,6 +65,26 @@ public:
   typedef std::vector< std::string > FilenamesContainer;
   typedef std::vector< std::string > SeriesUIDContainer;
 
+  /** What the directory scan records about each series */
+  struct SeriesInfo
+    {
+    std::string        SeriesUID;
+    /** sorted by instance number */
+    FilenamesContainer FileNames;
+    std::string        Modality;
+    std::string        Manufacturer;
+    std::string        SeriesDescription;
+    int                SeriesNumber;
+    /** total size of the series' files */
+    uint64_t           NumberOfBytes;
+    /** any file is diffusion weighted, as
+     *  DCMTKFileReader::IsDiffusionWeighted decides */
+    bool               HasDiffusionTags;
+    SeriesInfo() : SeriesNumber(0), NumberOfBytes(0), HasDiffusionTags(false) {}
+    };
+  /** map from SeriesInstanceUID to series */
+  typedef std::map< std::string, SeriesInfo > SeriesCatalogType;
+
   /** Method for creation through the object factory. */
   itkNewMacro(Self);
 
@@ -102,6 +129,9 @@ public:
    * All DICOM files have the same exact UID equal to the one user's
    * specified.  An extended UID may be returned/used if
    * SetUseSeriesDetails(true) has been called.
+   * Unless the catalog has already been built, each file is only
+   * parsed as far as its series UID, and only the files of this
+   * series have their headers read.
    */
   const FilenamesContainer & GetFileNames(const std::string serie);
 
@@ -112,6 +142,9 @@ public:
    */
   const SeriesUIDContainer & GetSeriesUIDs();
 
+  /** Returns the catalog of all series in the input directory. */
+  const SeriesCatalogType & GetSeriesCatalog();
+
   /** Recursively parse the input directory */
   itkSetMacro(Recursive, bool);
   itkGetConstMacro(Recursive, bool);
@@ -167,8 +200,11 @@ private:
   DCMTKSeriesFileNames(const Self &); //purposely not implemented
   void operator=(const Self &);      //purposely not implemented
 
-  /** internal method for reading out filenames and UID lists */
-  void GetDicomData(const std::string &series, bool saveFileNames);
+  /** scan the input directory into the series catalog, unless
+   *  that's already been done since the last modification */
+  void BuildSeriesCatalog();
+  /** the files, not directories, in the input directory */
+  void ListInputDirectory(FilenamesContainer &fileNames) const;
   /** Contains the input directory where the DICOM serie is found */
   std::string m_InputDirectory;
 
@@ -184,6 +220,12 @@ private:
   /** Internal structure to keep the list of series UIDs */
   SeriesUIDContainer m_SeriesUIDs;
 
+  /** series found by the last scan, and every file found, in
+   *  instance number order */
+  SeriesCatalogType  m_SeriesCatalog;
+  FilenamesContainer m_AllFileNames;
+  TimeStamp          m_SeriesCatalogTime;
+
   bool m_UseSeriesDetails;
   bool m_Recursive;
   bool m_LoadSequences;